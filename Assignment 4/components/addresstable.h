@@ -0,0 +1,137 @@
+#ifndef ADDRESSTABLE_H
+#define ADDRESSTABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+
+// Open-addressed (linear probing) map from a guest address to the state of an
+// in-flight memory transaction. Only live transactions are stored, so lookups
+// stay O(1) and the table stays small however large guest memory is.
+template <typename Value>
+class AddressTable {
+public:
+    explicit AddressTable(size_t capacity = 64) {
+        size_t size = 8;
+        while (size < capacity) size <<= 1;
+        resize(size);
+    }
+
+    Value* find(uint32_t address) {
+        size_t i = locate(address);
+        return slots[i].used ? &slots[i].value : nullptr;
+    }
+
+    const Value* find(uint32_t address) const {
+        size_t i = locate(address);
+        return slots[i].used ? &slots[i].value : nullptr;
+    }
+
+    // Entry for address, inserting a value-initialised one if missing.
+    // The reference is only valid until the next insertion.
+    Value& operator[](uint32_t address) {
+        size_t i = locate(address);
+        if (slots[i].used) return slots[i].value;
+
+        if ((count + 1) * 2 > slots.size()) {
+            grow();
+            i = locate(address);
+        }
+        slots[i].used = true;
+        slots[i].address = address;
+        slots[i].value = Value();
+        count++;
+        return slots[i].value;
+    }
+
+    void erase(uint32_t address) {
+        size_t i = locate(address);
+        if (!slots[i].used) return;
+
+        // Backward-shift deletion: pull later entries of the probe run into the hole
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (!slots[j].used) break;
+            size_t k = home(slots[j].address);
+            bool movable = (i <= j) ? (k <= i || k > j) : (k <= i && k > j);
+            if (movable) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i].used = false;
+        count--;
+    }
+
+    size_t size() const { return count; }
+
+private:
+    struct Slot {
+        uint32_t address = 0;
+        bool used = false;
+        Value value = Value();
+    };
+
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    unsigned shift = 0;
+    size_t count = 0;
+
+    // Fibonacci hashing; word addresses differ only above bit 2
+    size_t home(uint32_t address) const { return (uint32_t(address * 2654435761u) >> shift) & mask; }
+
+    // Slot holding address, or the empty slot where it would go
+    size_t locate(uint32_t address) const {
+        size_t i = home(address);
+        while (slots[i].used && slots[i].address != address) i = (i + 1) & mask;
+        return i;
+    }
+
+    void resize(size_t size) {
+        slots.assign(size, Slot());
+        mask = size - 1;
+        shift = 32;
+        for (size_t s = size; s > 1; s >>= 1) shift--;
+        count = 0;
+    }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots);
+        resize(old.size() * 2);
+        for (const Slot& slot : old) {
+            if (!slot.used) continue;
+            size_t i = locate(slot.address);
+            slots[i] = slot;
+            count++;
+        }
+    }
+};
+
+// Tables the cores of a parallel run share are split by word address, so transactions
+// on different words probe (and are locked in) different shards
+const size_t ADDRESS_SHARDS = 16;
+
+inline size_t addressShard(uint32_t address) { return (address >> 2) & (ADDRESS_SHARDS - 1); }
+
+template <typename Value>
+class ShardedAddressTable {
+public:
+    Value* find(uint32_t address) { return shards[addressShard(address)].find(address); }
+    const Value* find(uint32_t address) const { return shards[addressShard(address)].find(address); }
+    Value& operator[](uint32_t address) { return shards[addressShard(address)][address]; }
+    void erase(uint32_t address) { shards[addressShard(address)].erase(address); }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const AddressTable<Value>& shard : shards) total += shard.size();
+        return total;
+    }
+
+private:
+    std::array<AddressTable<Value>, ADDRESS_SHARDS> shards;
+};
+
+#endif // ADDRESSTABLE_H
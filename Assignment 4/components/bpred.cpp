@@ -0,0 +1,287 @@
+#include "bpred.h"
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+
+BranchPredictorConfig parse_bpred_config(const std::string& spec) {
+    BranchPredictorConfig config;
+    std::stringstream fields(spec);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        if (field.empty()) continue;
+        size_t eq = field.find('=');
+        if (eq == std::string::npos) {
+            throw std::invalid_argument("Branch predictor option needs key=value: " + field);
+        }
+        std::string key = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+
+        if (key == "btb") config.btbEntries = std::stoul(value, nullptr, 0);
+        else if (key == "ras") config.rasEntries = std::stoul(value, nullptr, 0);
+        else if (key == "bits") config.tableBits = std::stoul(value, nullptr, 0);
+        else if (key == "history") config.historyBits = std::stoul(value, nullptr, 0);
+        else if (key == "predictor") {
+            if (value == "static") config.kind = PREDICT_STATIC;
+            else if (value == "bimodal") config.kind = PREDICT_BIMODAL;
+            else if (value == "gshare") config.kind = PREDICT_GSHARE;
+            else if (value == "tage") config.kind = PREDICT_TAGE;
+            else throw std::invalid_argument("Unknown branch predictor: " + value);
+        }
+        else throw std::invalid_argument("Unknown branch predictor option: " + key);
+    }
+    if (config.btbEntries == 0 || (config.btbEntries & (config.btbEntries - 1)) != 0) {
+        throw std::invalid_argument("BTB entries must be a power of two.");
+    }
+    if (config.rasEntries == 0) {
+        throw std::invalid_argument("The return stack needs at least one entry.");
+    }
+    if (config.tableBits < 1 || config.tableBits > 24) {
+        throw std::invalid_argument("Predictor table bits must be between 1 and 24.");
+    }
+    if (config.historyBits < 1 || config.historyBits > 64) {
+        throw std::invalid_argument("Branch history must be between 1 and 64 bits.");
+    }
+    return config;
+}
+
+// ra and t0 are the link registers of the calling convention
+static bool is_link(int reg) {
+    return reg == 1 || reg == 5;
+}
+
+BranchKind branch_kind(const DecodedOp& decoded) {
+    switch (decoded.op) {
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU:
+            return BRANCH_CONDITIONAL;
+        case OP_JAL:
+            return is_link(decoded.rd) ? BRANCH_CALL : BRANCH_JUMP;
+        case OP_JALR:
+            if (is_link(decoded.rd)) return BRANCH_CALL;
+            if (decoded.rd == 0 && is_link(decoded.rs1)) return BRANCH_RETURN;
+            return BRANCH_INDIRECT;
+        default:
+            return BRANCH_NONE;
+    }
+}
+
+// XOR the newest `length` bits of history down to `bits` bits
+static uint32_t fold(uint64_t history, uint32_t length, uint32_t bits) {
+    if (length < 64) history &= (uint64_t(1) << length) - 1;
+    uint32_t mask = (1u << bits) - 1;
+    uint32_t folded = 0;
+    for (uint32_t i = 0; i < length; i += bits) {
+        folded ^= static_cast<uint32_t>(history >> i) & mask;
+    }
+    return folded;
+}
+
+BranchPredictor::BranchPredictor(const BranchPredictorConfig& config)
+    : config(config), btb(config.btbEntries, BtbEntry()), ras(config.rasEntries, 0),
+      counters(size_t(1) << config.tableBits, 1) {     // Weakly not taken
+    if (config.kind == PREDICT_TAGE) {
+        // Geometric history lengths from 4 bits up to the configured history
+        double shortest = std::min<uint32_t>(4, config.historyBits);
+        double ratio = std::pow(config.historyBits / shortest, 1.0 / (TAGE_TABLES - 1));
+        uint32_t previous = 0;
+        for (int i = 0; i < TAGE_TABLES; i++) {
+            uint32_t length = static_cast<uint32_t>(std::lround(shortest * std::pow(ratio, i)));
+            tageHistory[i] = std::min<uint32_t>(std::max(length, previous + 1), 64);
+            previous = tageHistory[i];
+            tage[i].assign(size_t(1) << config.tableBits, TageEntry());
+        }
+    }
+}
+
+Prediction BranchPredictor::predict(uint32_t pc, const DecodedOp& decoded) {
+    Prediction prediction = {pc + 4, branch_kind(decoded), false, history, rasTop, rasDepth, ras[rasTop]};
+
+    uint32_t target = 0;
+    bool btbHit = lookupTarget(pc, target);
+    switch (prediction.kind) {
+        case BRANCH_NONE:
+            break;
+        case BRANCH_CONDITIONAL:
+            prediction.taken = direction(pc, target, btbHit, history);
+            // Speculative: resolve() puts the history back if the guess was wrong
+            history = (history << 1) | prediction.taken;
+            if (prediction.taken && btbHit) prediction.next = target;
+            break;
+        case BRANCH_RETURN:
+            if (rasDepth > 0) {
+                prediction.next = pop();
+                break;
+            }
+            if (btbHit) prediction.next = target;
+            break;
+        case BRANCH_CALL:
+            push(pc + 4);
+            if (btbHit) prediction.next = target;
+            break;
+        case BRANCH_JUMP: case BRANCH_INDIRECT:
+            if (btbHit) prediction.next = target;
+            break;
+    }
+    return prediction;
+}
+
+bool BranchPredictor::resolve(uint32_t pc, const Prediction& prediction, bool taken, uint32_t target) {
+    uint32_t next = taken ? target : pc + 4;
+    bool wrong = next != prediction.next;
+
+    if (prediction.kind == BRANCH_CONDITIONAL) {
+        stats.branches++;
+        if (taken != prediction.taken) stats.branchMisses++;
+        else if (wrong) stats.btbMisses++;
+        train(pc, prediction.history, taken);
+    } else {
+        stats.jumps++;
+        if (wrong) stats.jumpMisses++;
+        if (prediction.kind == BRANCH_RETURN) {
+            stats.returns++;
+            if (wrong && prediction.rasDepth > 0) stats.rasMisses++;
+        }
+        if (wrong && (prediction.kind != BRANCH_RETURN || prediction.rasDepth == 0)) stats.btbMisses++;
+    }
+
+    if (taken) btb[(pc >> 2) & (btb.size() - 1)] = {pc, target, true};
+
+    if (wrong || (prediction.kind == BRANCH_CONDITIONAL && taken != prediction.taken)) {
+        // Drop whatever the wrong path did, then redo this instruction's own update
+        history = prediction.history;
+        rasTop = prediction.rasTop;
+        rasDepth = prediction.rasDepth;
+        ras[rasTop] = prediction.rasValue;
+        if (prediction.kind == BRANCH_CONDITIONAL) history = (history << 1) | taken;
+        else if (prediction.kind == BRANCH_CALL) push(pc + 4);
+        else if (prediction.kind == BRANCH_RETURN && rasDepth > 0) pop();
+    }
+    return wrong;
+}
+
+bool BranchPredictor::lookupTarget(uint32_t pc, uint32_t& target) const {
+    const BtbEntry& entry = btb[(pc >> 2) & (btb.size() - 1)];
+    if (!entry.valid || entry.pc != pc) return false;
+    target = entry.target;
+    return true;
+}
+
+bool BranchPredictor::direction(uint32_t pc, uint32_t target, bool btbHit, uint64_t history) const {
+    switch (config.kind) {
+        case PREDICT_STATIC:
+            return btbHit && target < pc;
+        case PREDICT_BIMODAL: case PREDICT_GSHARE:
+            return counters[counterIndex(pc, history)] >= 2;
+        case PREDICT_TAGE: {
+            int alternate;
+            int provider = tageProvider(pc, history, alternate);
+            if (provider < 0) return counters[counterIndex(pc, history)] >= 2;
+            return tage[provider][tageIndex(provider, pc, history)].counter >= 0;
+        }
+    }
+    return false;
+}
+
+void BranchPredictor::train(uint32_t pc, uint64_t history, bool taken) {
+    if (config.kind == PREDICT_STATIC) return;
+
+    uint8_t& base = counters[counterIndex(pc, history)];
+    if (config.kind != PREDICT_TAGE) {
+        if (taken && base < 3) base++;
+        if (!taken && base > 0) base--;
+        return;
+    }
+
+    int alternate;
+    int provider = tageProvider(pc, history, alternate);
+    bool basePrediction = base >= 2;
+    bool predicted = basePrediction;
+    if (provider >= 0) {
+        TageEntry& entry = tage[provider][tageIndex(provider, pc, history)];
+        bool alternatePrediction = alternate >= 0
+            ? tage[alternate][tageIndex(alternate, pc, history)].counter >= 0 : basePrediction;
+        predicted = entry.counter >= 0;
+        // Usefulness only moves when the provider decided against the alternative
+        if (predicted != alternatePrediction) {
+            if (predicted == taken && entry.useful < 3) entry.useful++;
+            if (predicted != taken && entry.useful > 0) entry.useful--;
+        }
+        if (taken && entry.counter < 3) entry.counter++;
+        if (!taken && entry.counter > -4) entry.counter--;
+    } else {
+        if (taken && base < 3) base++;
+        if (!taken && base > 0) base--;
+    }
+
+    // A wrong guess takes an entry in a longer-history table, or ages the ones in the way
+    if (predicted != taken && provider < TAGE_TABLES - 1) {
+        bool allocated = false;
+        for (int i = provider + 1; i < TAGE_TABLES && !allocated; i++) {
+            TageEntry& entry = tage[i][tageIndex(i, pc, history)];
+            if (entry.useful == 0) {
+                entry = {tageTag(i, pc, history), static_cast<int8_t>(taken ? 0 : -1), 0};
+                allocated = true;
+            }
+        }
+        if (!allocated) {
+            for (int i = provider + 1; i < TAGE_TABLES; i++) {
+                TageEntry& entry = tage[i][tageIndex(i, pc, history)];
+                if (entry.useful > 0) entry.useful--;
+            }
+        }
+    }
+
+    // Periodically age every entry so stale ones can be replaced
+    if (++tageUpdates % (uint64_t(1) << 18) == 0) {
+        for (auto& table : tage) {
+            for (auto& entry : table) entry.useful >>= 1;
+        }
+    }
+}
+
+uint32_t BranchPredictor::counterIndex(uint32_t pc, uint64_t history) const {
+    uint32_t index = pc >> 2;
+    if (config.kind == PREDICT_GSHARE) index ^= fold(history, config.historyBits, config.tableBits);
+    return index & (counters.size() - 1);
+}
+
+uint32_t BranchPredictor::tageIndex(int table, uint32_t pc, uint64_t history) const {
+    uint32_t index = (pc >> 2) ^ (pc >> (2 + config.tableBits)) ^ fold(history, tageHistory[table], config.tableBits);
+    return index & (tage[table].size() - 1);
+}
+
+uint16_t BranchPredictor::tageTag(int table, uint32_t pc, uint64_t history) const {
+    uint32_t tag = (pc >> 2) ^ fold(history, tageHistory[table], TAGE_TAG_BITS)
+                 ^ (fold(history, tageHistory[table], TAGE_TAG_BITS - 1) << 1);
+    return static_cast<uint16_t>(tag & ((1u << TAGE_TAG_BITS) - 1));
+}
+
+// Longest-history table whose entry matches, or -1; alternate is the next longest match
+int BranchPredictor::tageProvider(uint32_t pc, uint64_t history, int& alternate) const {
+    int provider = -1;
+    alternate = -1;
+    for (int i = TAGE_TABLES - 1; i >= 0; i--) {
+        if (tage[i][tageIndex(i, pc, history)].tag != tageTag(i, pc, history)) continue;
+        if (provider < 0) {
+            provider = i;
+        } else {
+            alternate = i;
+            break;
+        }
+    }
+    return provider;
+}
+
+// The return stack wraps, overwriting its oldest entry when full
+void BranchPredictor::push(uint32_t address) {
+    rasTop = (rasTop + 1) % ras.size();
+    ras[rasTop] = address;
+    rasDepth = std::min<uint32_t>(rasDepth + 1, ras.size());
+}
+
+uint32_t BranchPredictor::pop() {
+    uint32_t address = ras[rasTop];
+    rasTop = (rasTop + ras.size() - 1) % ras.size();
+    rasDepth--;
+    return address;
+}
@@ -0,0 +1,120 @@
+#ifndef BPRED_H
+#define BPRED_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "decoder.h"
+
+enum PredictorKind : uint8_t {
+    PREDICT_STATIC,     // Backward taken, forward not taken
+    PREDICT_BIMODAL,    // 2-bit counter per branch address
+    PREDICT_GSHARE,     // 2-bit counters indexed by address xor global history
+    PREDICT_TAGE        // Bimodal base plus tagged tables over geometric history lengths
+};
+
+struct BranchPredictorConfig {
+    PredictorKind kind = PREDICT_BIMODAL;
+    uint32_t btbEntries = 64;       // Direct mapped, a power of two
+    uint32_t rasEntries = 8;
+    uint32_t tableBits = 10;        // log2 of the entries in each counter table
+    uint32_t historyBits = 12;      // Global history for gshare; TAGE's longest history (up to 64)
+};
+
+// Parse "predictor=static|bimodal|gshare|tage,btb=64,ras=8,bits=10,history=12".
+// Keys may be left out to keep the defaults.
+BranchPredictorConfig parse_bpred_config(const std::string& spec);
+
+// Control transfers, as Fetch sees them from the predecoded word
+enum BranchKind : uint8_t {
+    BRANCH_NONE,
+    BRANCH_CONDITIONAL,
+    BRANCH_JUMP,            // jal without a link, or with one that is not a call
+    BRANCH_CALL,            // jal or jalr linking ra (or t0)
+    BRANCH_RETURN,          // jalr x0 through ra (or t0)
+    BRANCH_INDIRECT         // Any other jalr
+};
+
+BranchKind branch_kind(const DecodedOp& decoded);
+
+// What Fetch guessed for one instruction, with the state to put back if it guessed wrong
+struct Prediction {
+    uint32_t next;          // Address fetched after it
+    BranchKind kind;
+    bool taken;             // Direction guessed for a conditional branch
+    uint64_t history;       // Global history before this instruction
+    uint32_t rasTop;        // Return stack before this instruction
+    uint32_t rasDepth;
+    uint32_t rasValue;
+};
+
+struct BranchStats {
+    uint64_t branches = 0;          // Conditional branches resolved
+    uint64_t branchMisses = 0;      // ...whose direction was guessed wrong
+    uint64_t jumps = 0;             // Jumps, calls and returns resolved
+    uint64_t jumpMisses = 0;        // ...that Fetch did not follow to the right target
+    uint64_t returns = 0;
+    uint64_t rasMisses = 0;         // Returns the return stack had the wrong address for
+    uint64_t btbMisses = 0;         // Taken transfers guessed right but with no target in the BTB
+    uint64_t squashed = 0;          // Wrong-path instructions flushed from Decode
+    uint64_t penaltyCycles = 0;     // Cycles from a redirect until the right path was fetched
+};
+
+// Per-core branch prediction for Fetch: a BTB for targets, a return address stack and a
+// direction predictor for conditional branches. Fetch calls predict() for every word and
+// Execute calls resolve() for every control transfer, oldest first.
+class BranchPredictor {
+public:
+    explicit BranchPredictor(const BranchPredictorConfig& config);
+
+    Prediction predict(uint32_t pc, const DecodedOp& decoded);
+
+    // Train on the outcome. Returns true if Fetch went the wrong way; global history and the
+    // return stack are then put back as if only this instruction had been fetched.
+    bool resolve(uint32_t pc, const Prediction& prediction, bool taken, uint32_t target);
+
+    const BranchPredictorConfig& getConfig() const { return config; }
+    const BranchStats& getStats() const { return stats; }
+    BranchStats& getStats() { return stats; }
+
+private:
+    struct BtbEntry {
+        uint32_t pc;
+        uint32_t target;
+        bool valid;
+    };
+
+    // Entry of a TAGE tagged table
+    struct TageEntry {
+        uint16_t tag;
+        int8_t counter;     // -4..3, taken when >= 0
+        uint8_t useful;     // 0..3
+    };
+
+    static const int TAGE_TABLES = 4;
+    static const uint32_t TAGE_TAG_BITS = 9;
+
+    BranchPredictorConfig config;
+    BranchStats stats;
+    uint64_t history = 0;
+    std::vector<BtbEntry> btb;
+    std::vector<uint32_t> ras;
+    uint32_t rasTop = 0;
+    uint32_t rasDepth = 0;
+    std::vector<uint8_t> counters;      // 2-bit counters: bimodal, gshare, and TAGE's base
+    std::vector<TageEntry> tage[TAGE_TABLES];
+    uint32_t tageHistory[TAGE_TABLES];  // History length of each tagged table
+    uint64_t tageUpdates = 0;
+
+    bool lookupTarget(uint32_t pc, uint32_t& target) const;
+    bool direction(uint32_t pc, uint32_t target, bool btbHit, uint64_t history) const;
+    void train(uint32_t pc, uint64_t history, bool taken);
+    uint32_t counterIndex(uint32_t pc, uint64_t history) const;
+    uint32_t tageIndex(int table, uint32_t pc, uint64_t history) const;
+    uint16_t tageTag(int table, uint32_t pc, uint64_t history) const;
+    int tageProvider(uint32_t pc, uint64_t history, int& alternate) const;
+    void push(uint32_t address);
+    uint32_t pop();
+};
+
+#endif // BPRED_H
@@ -0,0 +1,461 @@
+#include "cache.h"
+#include "membus.h"
+#include "ram.h"
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+static bool is_power_of_two(uint32_t value) {
+    return value && !(value & (value - 1));
+}
+
+static uint32_t log2_of(uint32_t value) {
+    uint32_t bits = 0;
+    while (value > 1) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+CacheConfig parse_cache_config(const std::string& spec, const CacheConfig& defaults) {
+    CacheConfig config = defaults;
+    std::stringstream fields(spec);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        if (field.empty()) continue;
+        size_t eq = field.find('=');
+        if (eq == std::string::npos) {
+            throw std::invalid_argument("Cache option needs key=value: " + field);
+        }
+        std::string key = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+
+        if (key == "size") config.size = std::stoul(value, nullptr, 0);
+        else if (key == "line") config.lineSize = std::stoul(value, nullptr, 0);
+        else if (key == "ways") config.associativity = std::stoul(value, nullptr, 0);
+        else if (key == "hit") config.hitLatency = std::stoul(value, nullptr, 0);
+        else if (key == "policy") {
+            if (value == "lru") config.policy = REPLACE_LRU;
+            else if (value == "fifo") config.policy = REPLACE_FIFO;
+            else if (value == "random") config.policy = REPLACE_RANDOM;
+            else throw std::invalid_argument("Unknown replacement policy: " + value);
+        }
+        else if (key == "write") {
+            if (value == "back") config.writeBack = true;
+            else if (value == "through") config.writeBack = false;
+            else throw std::invalid_argument("Unknown write policy: " + value);
+        }
+        else if (key == "allocate") config.writeAllocate = value != "0" && value != "no";
+        else throw std::invalid_argument("Unknown cache option: " + key);
+    }
+    return config;
+}
+
+Cache::Cache(const CacheConfig& config, Membus* membus, int core_id, RAM* memory)
+    : config(config), membus(membus), core_id(core_id), memory(memory) {
+    if (!is_power_of_two(config.lineSize) || config.lineSize < 4) {
+        throw std::invalid_argument("Cache line size must be a power of two of at least 4 bytes.");
+    }
+    if (config.associativity == 0 || config.size % (config.lineSize * config.associativity) != 0) {
+        throw std::invalid_argument("Cache size must be a multiple of line size times associativity.");
+    }
+    numSets = config.size / (config.lineSize * config.associativity);
+    if (!is_power_of_two(numSets)) {
+        throw std::invalid_argument("Cache set count must be a power of two.");
+    }
+    if (config.hitLatency == 0) {
+        throw std::invalid_argument("Cache hit latency must be at least one cycle.");
+    }
+
+    offsetBits = log2_of(config.lineSize);
+    setBits = log2_of(numSets);
+    lines.resize(numSets * config.associativity);
+    for (auto& l : lines) {
+        l.data.assign(config.lineSize, 0);
+    }
+}
+
+MemResult Cache::read(uint32_t addr, uint32_t bytes) {
+    if (!drain(addr, false)) return pending();
+    if (phase == PHASE_IDLE) start(addr, false, 0, bytes);
+    return step();
+}
+
+MemResult Cache::write(uint32_t addr, uint32_t data, uint32_t bytes) {
+    if (!drain(addr, true)) return pending();
+    if (phase == PHASE_IDLE) start(addr, true, data, bytes);
+    return step();
+}
+
+// A different access arrived while one is in flight (e.g. fetch was redirected).
+// The old one keeps the cache busy until it completes; its result is dropped.
+bool Cache::drain(uint32_t addr, bool write) {
+    if (phase == PHASE_IDLE || matches(addr, write)) return true;
+    step();
+    return phase == PHASE_IDLE;
+}
+
+bool Cache::matches(uint32_t addr, bool write) const {
+    return address == addr && isWrite == write;
+}
+
+Cache::Line* Cache::lookup(uint32_t addr) {
+    return const_cast<Line*>(static_cast<const Cache*>(this)->lookup(addr));
+}
+
+const Cache::Line* Cache::lookup(uint32_t addr) const {
+    const Line* set = &lines[setIndex(addr) * config.associativity];
+    uint32_t tag = tagOf(addr);
+    for (uint32_t way = 0; way < config.associativity; way++) {
+        if (set[way].state != MESI_INVALID && set[way].tag == tag) return &set[way];
+    }
+    return nullptr;
+}
+
+void Cache::setState(Line& l, MesiState state) {
+    if (l.state == state) return;
+    stats.transitions[l.state][state]++;
+    l.state = state;
+}
+
+// Untimed copy of a line to the next level: RAM for the L2, the Membus (L2 or RAM) for an L1
+void Cache::writeLine(uint32_t base, const Line& l) {
+    if (memory) {
+        memory->writeBlock(base, l.data.data(), config.lineSize);
+    } else {
+        membus->writeBlock(base, l.data.data(), config.lineSize);
+    }
+}
+
+Cache::Line* Cache::chooseVictim(uint32_t set) {
+    Line* ways = &lines[set * config.associativity];
+    for (uint32_t way = 0; way < config.associativity; way++) {
+        if (ways[way].state == MESI_INVALID) return &ways[way];
+    }
+
+    if (config.policy == REPLACE_RANDOM) {
+        // xorshift32, seeded the same every run so results are reproducible
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        return &ways[randomState % config.associativity];
+    }
+
+    // LRU stamps on every use, FIFO only on fill; either way evict the oldest
+    Line* victim = &ways[0];
+    for (uint32_t way = 1; way < config.associativity; way++) {
+        if (ways[way].stamp < victim->stamp) victim = &ways[way];
+    }
+    return victim;
+}
+
+// Look the access up and pick the phase it starts in
+void Cache::start(uint32_t addr, bool write, uint32_t data, uint32_t bytes) {
+    address = addr;
+    isWrite = write;
+    value = data;
+    size = bytes;
+    clock++;
+
+    // An access straddling two lines goes to memory directly, after both lines are dropped
+    if ((addr & (config.lineSize - 1)) + bytes > config.lineSize) {
+        stats.misses++;
+        evict(addr);
+        evict(addr + 4);
+        line = nullptr;
+        phase = PHASE_UNCACHED;
+        return;
+    }
+
+    line = lookup(addr);
+    if (line) {
+        stats.hits++;
+        if (config.policy == REPLACE_LRU) line->stamp = clock;
+        line->touched |= wordBit(addr);
+        if (write && !config.writeBack) {
+            std::memcpy(line->data.data() + (addr & (config.lineSize - 1)), &data, bytes);
+            phase = PHASE_WRITE_THROUGH;
+        } else {
+            phase = (write && line->state == MESI_SHARED) ? PHASE_UPGRADE : PHASE_HIT;
+            remaining = config.hitLatency;
+        }
+        return;
+    }
+
+    stats.misses++;
+    if (write && !config.writeAllocate) {
+        phase = PHASE_WRITE_THROUGH;
+        return;
+    }
+
+    line = chooseVictim(setIndex(addr));
+    if (line->state != MESI_INVALID) stats.evictions++;
+    if (line->state == MESI_MODIFIED) {
+        phase = PHASE_WRITEBACK;
+    } else {
+        setState(*line, MESI_INVALID);
+        phase = PHASE_FILL;
+    }
+}
+
+// One poll of the access in flight
+MemResult Cache::step() {
+    switch (phase) {
+        case PHASE_HIT:
+            if (--remaining > 0) return pending();
+            return finish();
+
+        case PHASE_UPGRADE:
+            // The invalidation is a bus broadcast taking the hit latency
+            if (--remaining > 0) return pending();
+            if (line->state == MESI_INVALID) {
+                // Another writer took the line meanwhile: retry as a miss
+                start(address, isWrite, value, size);
+                return pending();
+            }
+            membus->snoop(this, address, BUS_UPGRADE);
+            stats.upgrades++;
+            return finish();
+
+        case PHASE_WRITEBACK: {
+            uint32_t victim = lineAddress(*line, setIndex(address));
+
+            // The bus transaction times the burst; the whole line moves when it completes
+            MemResult result = membus->lineWrite(core_id, victim, config.lineSize);
+            if (result.status != MEM_DONE) return pending();
+            // A snoop may already have written it back
+            if (line->state == MESI_MODIFIED) {
+                writeLine(victim, *line);
+                stats.writebacks++;
+            }
+            setState(*line, MESI_INVALID);
+            phase = PHASE_FILL;
+            return pending();
+        }
+
+        case PHASE_FILL: {
+            uint32_t base = lineBase(address);
+
+            MemResult result = membus->lineRead(core_id, base, config.lineSize);
+            if (result.status != MEM_DONE) return pending();
+            bool shared = membus->snoop(this, address, isWrite ? BUS_READ_EXCLUSIVE : BUS_READ);
+            membus->readBlock(base, line->data.data(), config.lineSize);
+            line->tag = tagOf(address);
+            line->stamp = clock;
+            line->touched = wordBit(address);
+            setState(*line, shared ? MESI_SHARED : MESI_EXCLUSIVE);
+            return finish();
+        }
+
+        case PHASE_WRITE_THROUGH: {
+            MemResult result = membus->write(core_id, address, value, 0, false, this, size);
+            if (result.status != MEM_DONE) return pending();
+            phase = PHASE_IDLE;
+            line = nullptr;
+            return {MEM_DONE, 0, 0, 0};
+        }
+
+        case PHASE_UNCACHED: {
+            MemResult result = isWrite ? membus->write(core_id, address, value, 0, false, this, size)
+                                       : membus->read(core_id, address, false, this, size);
+            if (result.status != MEM_DONE) return pending();
+            phase = PHASE_IDLE;
+            return {MEM_DONE, result.data, 0, 0};
+        }
+
+        default:
+            return {MEM_BLOCKED, 0, 0, 0};
+    }
+}
+
+// The line is present: complete the access against it
+MemResult Cache::finish() {
+    uint8_t* word = line->data.data() + (address & (config.lineSize - 1));
+
+    if (isWrite) {
+        if (config.writeBack) {
+            // Snoops during the hit latency can take the line away or share it
+            if (line->state == MESI_INVALID) {
+                start(address, isWrite, value, size);
+                return pending();
+            }
+            if (line->state == MESI_SHARED && phase != PHASE_UPGRADE) {
+                phase = PHASE_UPGRADE;
+                remaining = config.hitLatency;
+                return pending();
+            }
+        }
+        std::memcpy(word, &value, size);
+        if (!config.writeBack) {
+            phase = PHASE_WRITE_THROUGH;
+            return pending();
+        }
+        setState(*line, MESI_MODIFIED);
+        phase = PHASE_IDLE;
+        line = nullptr;
+        return {MEM_DONE, 0, 0, 0};
+    }
+
+    uint32_t data = 0;
+    std::memcpy(&data, word, size);
+    phase = PHASE_IDLE;
+    line = nullptr;
+    return {MEM_DONE, data, 0, 0};
+}
+
+MemResult Cache::pending() const {
+    return {MEM_PENDING, 0, 0, (phase == PHASE_HIT || phase == PHASE_UPGRADE) ? remaining : 0};
+}
+
+bool Cache::hitsLocally(uint32_t addr, uint32_t bytes, bool write) const {
+    if (!offBus() || (addr & (config.lineSize - 1)) + bytes > config.lineSize) return false;
+    const Line* l = lookup(addr);
+    return l && (!write || (config.writeBack && l->state != MESI_SHARED));
+}
+
+// A hit counting down can only end in an upgrade or a write-through by being a write
+bool Cache::offBus() const {
+    if (phase == PHASE_IDLE) return true;
+    if (phase != PHASE_HIT) return false;
+    return !isWrite || (config.writeBack && line->state != MESI_SHARED && line->state != MESI_INVALID);
+}
+
+// Polls of any address only step the access in flight, so only that one matters here
+uint32_t Cache::idleCycles() const {
+
+    switch (phase) {
+        case PHASE_HIT:
+        case PHASE_UPGRADE:
+            return remaining > 1 ? remaining - 1 : 0;
+        case PHASE_WRITEBACK:
+            return membus->lineIdleCycles(core_id, lineAddress(*line, setIndex(address)), true);
+        case PHASE_FILL:
+            return membus->lineIdleCycles(core_id, lineBase(address), false);
+        case PHASE_WRITE_THROUGH:
+            return membus->idleCycles(core_id, address, true);
+        case PHASE_UNCACHED:
+            return membus->idleCycles(core_id, address, isWrite);
+        default:
+            return 0;
+    }
+}
+
+// Same end state as `cycles` polls that stayed pending, given cycles <= idleCycles()
+void Cache::advance(uint32_t cycles) {
+    if (cycles == 0) return;
+
+    switch (phase) {
+        case PHASE_HIT:
+        case PHASE_UPGRADE:
+            remaining -= cycles;
+            break;
+        case PHASE_WRITEBACK:
+            membus->lineAdvance(core_id, lineAddress(*line, setIndex(address)), cycles, true);
+            break;
+        case PHASE_FILL:
+            membus->lineAdvance(core_id, lineBase(address), cycles, false);
+            break;
+        case PHASE_WRITE_THROUGH:
+            membus->advance(core_id, address, cycles, true);
+            break;
+        case PHASE_UNCACHED:
+            membus->advance(core_id, address, cycles, isWrite);
+            break;
+        default:
+            break;
+    }
+}
+
+// Write back and invalidate the line holding addr, without timing
+void Cache::evict(uint32_t addr) {
+    Line* l = lookup(addr);
+    if (!l) return;
+    if (l->state == MESI_MODIFIED) {
+        writeLine(lineBase(addr), *l);
+        stats.writebacks++;
+    }
+    setState(*l, MESI_INVALID);
+}
+
+void Cache::flush() {
+    for (uint32_t set = 0; set < numSets; set++) {
+        for (uint32_t way = 0; way < config.associativity; way++) {
+            Line& l = lines[set * config.associativity + way];
+            if (l.state == MESI_MODIFIED) {
+                writeLine(lineAddress(l, set), l);
+                stats.writebacks++;
+                setState(l, MESI_EXCLUSIVE);
+            }
+        }
+    }
+}
+
+bool Cache::snoop(uint32_t addr, BusRequest request) {
+    Line* l = lookup(addr);
+    if (!l) return false;
+
+    if (l->state == MESI_MODIFIED) {
+        writeLine(lineBase(addr), *l);
+        stats.snoopWritebacks++;
+    }
+
+    if (request == BUS_READ) {
+        setState(*l, MESI_SHARED);
+        return true;
+    }
+
+    if (request == BUS_EVICT) {
+        stats.backInvalidations++;
+    } else {
+        stats.invalidations++;
+        if (!(l->touched & wordBit(addr))) stats.falseSharing++;
+    }
+    setState(*l, MESI_INVALID);
+    return false;
+}
+
+uint32_t Cache::allocate(uint32_t base, uint32_t missPenalty) {
+    clock++;
+    Line* l = lookup(base);
+    if (l) {
+        stats.hits++;
+        if (config.policy == REPLACE_LRU) l->stamp = clock;
+        return config.hitLatency;
+    }
+
+    stats.misses++;
+    uint32_t latency = config.hitLatency + missPenalty;
+    uint32_t set = setIndex(base);
+    l = chooseVictim(set);
+    if (l->state != MESI_INVALID) {
+        stats.evictions++;
+        // Inclusive: L1 copies go first, writing any modified data into this line
+        uint32_t victim = lineAddress(*l, set);
+        membus->snoop(nullptr, victim, BUS_EVICT);
+        if (l->state == MESI_MODIFIED) {
+            writeLine(victim, *l);
+            stats.writebacks++;
+            latency += missPenalty;
+        }
+        setState(*l, MESI_INVALID);
+    }
+
+    memory->readBlock(base, l->data.data(), config.lineSize);
+    l->tag = tagOf(base);
+    l->stamp = clock;
+    setState(*l, MESI_EXCLUSIVE);
+    return latency;
+}
+
+const uint8_t* Cache::residentData(uint32_t addr) const {
+    const Line* l = lookup(addr);
+    return l ? l->data.data() : nullptr;
+}
+
+uint8_t* Cache::modifyData(uint32_t addr) {
+    Line* l = lookup(addr);
+    if (!l) return nullptr;
+    setState(*l, MESI_MODIFIED);
+    return l->data.data();
+}
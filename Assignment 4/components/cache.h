@@ -0,0 +1,165 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ram.h"
+
+class Membus;
+
+enum ReplacementPolicy : uint8_t {
+    REPLACE_LRU,
+    REPLACE_FIFO,
+    REPLACE_RANDOM
+};
+
+struct CacheConfig {
+    uint32_t size = 4096;           // Total bytes of data
+    uint32_t lineSize = 32;         // Bytes per line, a power of two >= 4
+    uint32_t associativity = 2;     // Ways per set
+    ReplacementPolicy policy = REPLACE_LRU;
+    uint32_t hitLatency = 1;        // Cycles for a hit, counting the cycle that returns the data
+    bool writeBack = true;          // Otherwise write-through
+    bool writeAllocate = true;      // Fill the line on a write miss
+};
+
+// Parse "size=4096,line=32,ways=2,policy=lru|fifo|random,hit=1,write=back|through,allocate=1|0".
+// Keys may be left out to keep the values in defaults.
+CacheConfig parse_cache_config(const std::string& spec, const CacheConfig& defaults = CacheConfig());
+
+// MESI state of a line. Invalid doubles as "not present"; the L2 only uses I, E and M.
+enum MesiState : uint8_t {
+    MESI_INVALID,
+    MESI_SHARED,
+    MESI_EXCLUSIVE,
+    MESI_MODIFIED,
+    MESI_STATE_COUNT
+};
+
+const char* const MesiNames[MESI_STATE_COUNT] = {"I", "S", "E", "M"};
+
+// Requests the other caches snoop on the Membus
+enum BusRequest : uint8_t {
+    BUS_READ,               // Read miss: modified copies write back, everyone drops to Shared
+    BUS_READ_EXCLUSIVE,     // Write miss or uncached write: copies write back and invalidate
+    BUS_UPGRADE,            // Write hit on a Shared line: other copies invalidate
+    BUS_EVICT               // The inclusive L2 dropped the line: copies write back and invalidate
+};
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t writebacks = 0;    // Dirty lines written to memory on eviction
+    uint64_t evictions = 0;     // Valid lines replaced by a fill
+    uint64_t upgrades = 0;          // Write hits that had to invalidate Shared copies first
+    uint64_t snoopWritebacks = 0;   // Modified lines written back because another cache asked for them
+    uint64_t invalidations = 0;     // Lines invalidated by another cache's write
+    uint64_t falseSharing = 0;      // ...where this cache never touched the word being written
+    uint64_t backInvalidations = 0; // Lines dropped because the L2 evicted them
+    uint64_t transitions[MESI_STATE_COUNT][MESI_STATE_COUNT] = {};  // [from][to]
+};
+
+// Set-associative L1 cache owned by one core, sitting in front of the Membus.
+// It follows the same polling protocol as Membus: the core repeats a read or
+// write every cycle until it returns MEM_DONE. One access is in flight at a
+// time; polling a different one first steps the old one to completion.
+// L1s attached to the Membus are kept coherent with MESI by snooping.
+//
+// The same class is the shared L2 when built with a RAM to sit in front of:
+// it is then driven by the Membus through allocate() instead of read/write.
+class Cache {
+public:
+    Cache(const CacheConfig& config, Membus* membus, int core_id, RAM* memory = nullptr);
+
+    // bytes is the access width, 1, 2 or 4; reads zero-extend it
+    MemResult read(uint32_t address, uint32_t bytes = 4);
+    MemResult write(uint32_t address, uint32_t value, uint32_t bytes = 4);
+
+    // Polls the in-flight access can take while only counting down
+    uint32_t idleCycles() const;
+    void advance(uint32_t cycles);
+
+    // True if polling this access next stays inside the cache: it hits a resident line that
+    // needs no upgrade or write-through, and nothing in flight is waiting on the Membus
+    bool hitsLocally(uint32_t address, uint32_t bytes, bool write) const;
+    bool offBus() const;
+
+    // Write every dirty line back to memory without timing (end of run)
+    void flush();
+
+    // Another cache's request for the line holding address (the word being written, for
+    // BUS_READ_EXCLUSIVE and BUS_UPGRADE). Returns true if this cache keeps a copy.
+    bool snoop(uint32_t address, BusRequest request);
+
+    // Shared L2: make the line at base resident in one step and return the cycles that took
+    uint32_t allocate(uint32_t base, uint32_t missPenalty);
+
+    // Shared L2: the resident line holding address, or nullptr. modifyData also marks it Modified.
+    const uint8_t* residentData(uint32_t address) const;
+    uint8_t* modifyData(uint32_t address);
+
+    const CacheConfig& getConfig() const { return config; }
+    const CacheStats& getStats() const { return stats; }
+
+private:
+    struct Line {
+        MesiState state = MESI_INVALID;
+        uint32_t tag = 0;
+        uint64_t stamp = 0;         // Last use (LRU) or fill time (FIFO)
+        uint32_t touched = 0;       // Words accessed since the fill, one bit each (for false sharing)
+        std::vector<uint8_t> data;
+    };
+
+    // Stage of the access in flight
+    enum Phase : uint8_t {
+        PHASE_IDLE,
+        PHASE_HIT,              // Counting down the hit latency
+        PHASE_UPGRADE,          // Invalidating other copies before writing a Shared line
+        PHASE_WRITEBACK,        // Writing the victim line to memory
+        PHASE_FILL,             // Reading the missing line from memory
+        PHASE_WRITE_THROUGH,    // Writing the stored word to memory
+        PHASE_UNCACHED          // Word straddling two lines, sent straight to memory
+    };
+
+    CacheConfig config;
+    Membus* membus;
+    int core_id;
+    RAM* memory;                // Set for the shared L2, which misses straight to RAM
+    uint32_t numSets;
+    uint32_t offsetBits;
+    uint32_t setBits;
+    std::vector<Line> lines;    // numSets * associativity, set-major
+    CacheStats stats;
+    uint64_t clock = 0;         // Access counter used for LRU/FIFO stamps
+    uint32_t randomState = 0x9E3779B9;
+
+    Phase phase = PHASE_IDLE;
+    uint32_t address = 0;
+    bool isWrite = false;
+    uint32_t value = 0;
+    uint32_t size = 4;          // Bytes of the access in flight
+    uint32_t remaining = 0;     // Polls left in PHASE_HIT or PHASE_UPGRADE
+    Line* line = nullptr;       // Line being hit or filled
+
+    uint32_t setIndex(uint32_t addr) const { return (addr >> offsetBits) & (numSets - 1); }
+    uint32_t tagOf(uint32_t addr) const { return addr >> (offsetBits + setBits); }
+    uint32_t lineAddress(const Line& l, uint32_t set) const { return ((l.tag << setBits) | set) << offsetBits; }
+    uint32_t lineBase(uint32_t addr) const { return addr & ~(config.lineSize - 1); }
+    uint32_t wordBit(uint32_t addr) const { return 1u << (((addr & (config.lineSize - 1)) >> 2) & 31); }
+
+    Line* lookup(uint32_t addr);
+    const Line* lookup(uint32_t addr) const;
+    void setState(Line& l, MesiState state);
+    void writeLine(uint32_t base, const Line& l);
+    Line* chooseVictim(uint32_t set);
+    bool matches(uint32_t addr, bool write) const;
+    bool drain(uint32_t addr, bool write);
+    void start(uint32_t addr, bool write, uint32_t data, uint32_t bytes);
+    void evict(uint32_t addr);
+    MemResult step();
+    MemResult finish();
+    MemResult pending() const;
+};
+
+#endif // CACHE_H
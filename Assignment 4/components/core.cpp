@@ -1,21 +1,122 @@
 #include "core.h"
 #include "membus.h"
+#include <cfenv>
+#include <cmath>
+#include <sstream>
+
+PipelineConfig parse_pipeline_config(const std::string& spec) {
+    PipelineConfig config;
+    std::stringstream fields(spec);
+    std::string field;
+    std::getline(fields, field, ',');
+    if (field == "scoreboard") config.scoreboard = true;
+    else if (field == "ooo") config.scoreboard = config.out_of_order = true;
+    else if (field != "legacy") throw std::invalid_argument("Unknown pipeline: " + field);
+
+    int int_units = 0, fp_units = 0;
+    bool sized = false;
+    while (std::getline(fields, field, ',')) {
+        if (field.empty()) continue;
+        if (!config.scoreboard) throw std::invalid_argument("The legacy pipeline takes no options: " + field);
+        size_t eq = field.find('=');
+        if (eq == std::string::npos) throw std::invalid_argument("Pipeline option needs key=value: " + field);
+        std::string key = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+
+        if (key == "forward") {
+            if (value != "all" && value != "none" && value != "ex" && value != "mem") {
+                throw std::invalid_argument("Unknown forwarding paths: " + value);
+            }
+            config.forward_execute = value == "all" || value == "ex";
+            config.forward_memory = value == "all" || value == "mem";
+        }
+        else if (key == "width") config.width = std::stoi(value, nullptr, 0);
+        else if (key == "int") int_units = std::stoi(value, nullptr, 0);
+        else if (key == "fp") fp_units = std::stoi(value, nullptr, 0);
+        else if (key == "rob" || key == "rs" || key == "lsq") {
+            int entries = std::stoi(value, nullptr, 0);
+            if (key == "rob") config.rob_entries = entries;
+            else if (key == "rs") config.station_entries = entries;
+            else config.lsq_entries = entries;
+            sized = true;
+        }
+        else throw std::invalid_argument("Unknown pipeline option: " + key);
+    }
+    if (sized && !config.out_of_order) {
+        throw std::invalid_argument("ROB, station and LSQ sizes only apply to the ooo pipeline.");
+    }
+    if (config.rob_entries < 1 || config.rob_entries > MAX_ROB_ENTRIES) {
+        throw std::invalid_argument("ROB entries must be between 1 and " + std::to_string(MAX_ROB_ENTRIES) + ".");
+    }
+    if (config.station_entries < 1 || config.lsq_entries < 1) {
+        throw std::invalid_argument("Reservation stations and the LSQ need at least one entry.");
+    }
+    if (config.width < 1 || config.width > MAX_ISSUE_WIDTH) {
+        throw std::invalid_argument("Issue width must be between 1 and " + std::to_string(MAX_ISSUE_WIDTH) + ".");
+    }
+    config.int_units = int_units ? int_units : config.width;
+    config.fp_units = fp_units ? fp_units : config.width;
+    if (config.int_units < 1 || config.fp_units < 1 || config.int_units > MAX_UNITS || config.fp_units > MAX_UNITS) {
+        throw std::invalid_argument("A pipeline needs 1 to " + std::to_string(MAX_UNITS) + " integer and FP units.");
+    }
+    return config;
+}
+
+FunctionalUnit functional_unit(Operation op) {
+    switch (op) {
+        case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: case OP_FLW: case OP_VLE32_V:
+            return UNIT_LOAD;
+        case OP_SB: case OP_SH: case OP_SW: case OP_FSW: case OP_VSE32_V:
+            return UNIT_STORE;
+        case OP_VFADD_VV: case OP_VFSUB_VV: case OP_VFMUL_VV: case OP_VFMACC_VV:
+            return UNIT_FP;
+        default:
+            break;
+    }
+    const OperationInfo& info = OperationTable[op];
+    return (info.fpRd || info.fpRs1) ? UNIT_FP : UNIT_INT;
+}
+
+uint32_t access_size(Operation op) {
+    switch (op) {
+        case OP_LB: case OP_LBU: case OP_SB:
+            return 1;
+        case OP_LH: case OP_LHU: case OP_SH:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+uint32_t load_result(Operation op, uint32_t data) {
+    switch (op) {
+        case OP_LB: return static_cast<uint32_t>(static_cast<int8_t>(data));
+        case OP_LH: return static_cast<uint32_t>(static_cast<int16_t>(data));
+        case OP_LBU: return data & 0xFF;
+        case OP_LHU: return data & 0xFFFF;
+        default: return data;
+    }
+}
+
+// Any RVV instruction, vsetvli included
+static bool is_vector(Operation op) {
+    return op >= OP_VSETVLI && op <= OP_VFMACC_VV;
+}
+
+static bool is_vector_memory(Operation op) {
+    return op == OP_VLE32_V || op == OP_VSE32_V;
+}
 
 // Constructor
 Core::Core(int start_pc, int core_id, uint32_t initial_sp)
-    : clock_cycle(0), sim_ticks(0), pc(start_pc), halt(false), stall_count(0), ram(nullptr), core_id(core_id) {
+    : instruction_pool(STAGE_COUNT + 2 * MAX_ISSUE_WIDTH + MAX_ROB_ENTRIES), halt(false), stall_count(0), ram(nullptr), core_id(core_id), pc(start_pc) {
     complete = 0;
-    pipeline_registers["Fetch"] = nullptr;
-    pipeline_registers["Decode"] = nullptr;
-    pipeline_registers["Execute"] = nullptr;
-    pipeline_registers["Store"] = nullptr;
     fetching_active = 1;
+    event_list.reserve(EVENT_HISTORY);
+    std::fill(rename_map, rename_map + 64, -1);
+    v_registers.assign(32 * (vlen / 32), 0.0f);
 
-    registers["sp"] = initial_sp; // Use the input value for the stack pointer
-    registers["ra"] = 0;
-    registers["s0"] = 0;
-    registers["a0"] = 0;
-    registers["zero"] = 0;
+    x_registers[2] = initial_sp; // Use the input value for the stack pointer
 }
 
 void Core::set_ram(RAM* ram_ptr) {
@@ -26,133 +127,207 @@ void Core::set_membus(Membus* membus_ptr) {
     membus = membus_ptr;
 }
 
+// Give the core private L1 caches; either may be null to leave that side uncached
+void Core::enable_caches(const CacheConfig* icache_config, const CacheConfig* dcache_config) {
+    if (icache) membus->detach(icache.get());
+    if (dcache) membus->detach(dcache.get());
+    icache.reset(icache_config ? new Cache(*icache_config, membus, core_id) : nullptr);
+    dcache.reset(dcache_config ? new Cache(*dcache_config, membus, core_id) : nullptr);
+    // Both snoop the bus: stores invalidate stale instruction lines as well
+    if (icache) membus->attach(icache.get());
+    if (dcache) membus->attach(dcache.get());
+}
+
+// Predict branches in Fetch; null goes back to fetching straight on
+void Core::enable_branch_prediction(const BranchPredictorConfig* config) {
+    predictor.reset(config ? new BranchPredictor(*config) : nullptr);
+}
+
+// Write dirty data back so RAM holds the final results
+void Core::flush_caches() {
+    if (icache) icache->flush();
+    if (dcache) dcache->flush();
+}
+
+MemResult Core::mem_read(Cache* cache, uint32_t address, uint32_t size) {
+    return cache ? cache->read(address, size) : membus->read(core_id, address, false, nullptr, size);
+}
+
+MemResult Core::mem_write(Cache* cache, uint32_t address, uint32_t value, uint32_t size) {
+    return cache ? cache->write(address, value, size) : membus->write(core_id, address, value, 0, false, nullptr, size);
+}
+
+uint32_t Core::mem_idle_cycles(Cache* cache, uint32_t address, bool write) const {
+    return cache ? cache->idleCycles() : membus->idleCycles(core_id, address, write);
+}
+
+void Core::mem_advance(Cache* cache, uint32_t address, int cycles, bool write) {
+    if (cache) {
+        cache->advance(cycles);
+    } else {
+        membus->advance(core_id, address, cycles, write);
+    }
+}
+
 // Delay function to simulate clock cycle delays
 int Core::delay_cycles(int cycle_count) {
     return cycle_count * 10;  // Convert cycle count to ticks 
 }
 
 void Core::fetch() {
-    if (pipeline_registers["Decode"]){
-        std::cout << "Fetch: Decode is busy." << std::endl;
+    if (pipeline.scoreboard) {
+        // A group of up to width words, ending early at a transfer Fetch follows
+        while (decode_queue.count < pipeline.width) {
+            Instruction* instr = fetch_word();
+            if (!instr) return;
+            decode_queue.push(instr);
+            if (instr->prediction.next != instr->address + 4) return;
+        }
+        LOG(log, LOG_STAGE, "Fetch: Decode is busy.");
         return;
     }
 
+    if (pipeline_registers[STAGE_DECODE]){
+        LOG(log, LOG_STAGE, "Fetch: Decode is busy.");
+        return;
+    }
+    Instruction* instr = fetch_word();
+    if (instr) pipeline_registers[STAGE_DECODE] = instr;
+}
+
+// Poll the word at pc; once it arrives take a slot for it and move pc on
+Instruction* Core::fetch_word() {
     if (pc < start_address) {
         throw std::out_of_range("PC out of bounds.");
-        return;
     } else if (pc <= max_instruction_address) {
         try {
-            std::vector<uint32_t> returnValues = membus->read(core_id, pc, false); // ram->read(pc, false);
-            uint32_t instruction_value = returnValues[0];
+            MemResult result = mem_read(icache.get(), pc); // ram->read(pc, false);
+            uint32_t instruction_value = result.data;
 
-            if (returnValues[0] == UINT32_MAX){
+            if (result.status != MEM_DONE){
                 fetching_active = 1;
-                std::cout << "Fetch: Waiting for instruction to load. " << "Cycles remaining: " << returnValues[2]  << std::endl;
-                return;
+                LOG(log, LOG_STAGE, "Fetch: Waiting for instruction to load. " << "Cycles remaining: " << result.loadDelay);
+                return nullptr;
             }
             fetching_active = 0;
             instruction_count++;
-            std::string hex_value = to_hex_string(instruction_value);
-            Instruction* instr = new Instruction(hex_value, instruction_value, {}, "Binary");
-
-            instr->stage = "Fetch";
-            instr->cycle_entered["Fetch"] = clock_cycle;
-            pipeline_registers["Fetch"] = instr;
-            event_list.push_back({instr->name, "Fetch", clock_cycle});
-            std::cout << "Fetch: Fetching instruction " << instr->name << "." << std::endl;
-            pipeline_registers["Decode"] = instr;
-
-            pc += 4;
+            Instruction* instr = instruction_pool.acquire(instruction_value, pc);
+
+            instr->stage = STAGE_FETCH;
+            instr->cycle_entered[STAGE_FETCH] = active_cycles;
+            pipeline_registers[STAGE_FETCH] = instr;
+            record_event(instr, STAGE_FETCH);
+            LOG(log, LOG_STAGE, "Fetch: Fetching instruction " << to_hex_string(instr->binary)
+                << (symbols.empty() ? "" : " at " + symbols.describe(pc)) << ".");
+
+            // Follow the predicted path as long as it stays inside the program image
+            uint32_t next = pc + 4;
+            if (predictor) {
+                instr->prediction = predictor->predict(pc, decode_cached(pc, instruction_value));
+                if (instr->prediction.next >= start_address && instr->prediction.next <= max_instruction_address + 4) {
+                    next = instr->prediction.next;
+                }
+                if (redirect_cycle >= 0) {
+                    predictor->getStats().penaltyCycles += active_cycles - redirect_cycle;
+                    redirect_cycle = -1;
+                }
+            }
+            instr->prediction.next = next;
+            pc = next;
+            return instr;
         } catch (const std::out_of_range& e) {
             std::cerr << "PC out of bounds: " << e.what() << std::endl;
             halt = true;
-            pipeline_registers["Fetch"] = nullptr;
+            pipeline_registers[STAGE_FETCH] = nullptr;
         }
     } else {
         fetching_active = 0;
-        std::cout << "Fetch: No instructions to fetch." << std::endl;
-        pipeline_registers["Fetch"] = nullptr;
+        LOG(log, LOG_STAGE, "Fetch: No instructions to fetch.");
+        pipeline_registers[STAGE_FETCH] = nullptr;
         halt = true; // No more instructions to fetch
-        return;
     }
+    return nullptr;
 }
 
 void Core::decode() {
-    if (pipeline_registers["Decode"]) {
+    if (pipeline.scoreboard) {
+        decode_group();
+        return;
+    }
+
+    if (pipeline_registers[STAGE_DECODE]) {
         decode_counter = 1;
-        Instruction* fetched_instr = pipeline_registers["Decode"];
+        Instruction* fetched_instr = pipeline_registers[STAGE_DECODE];
         uint32_t instruction_value = fetched_instr->binary;
 
-        // Decode the instruction name
-        std::string decodedName = decoder.decodeInstruction(instruction_value);
-
-        // Decode operands if no delay
-        std::vector<std::string> operands = split_instruction(decodedName);
-        fetched_instr->operands = operands;
-
-        if (decodedName == "Unknown"){
-            std::cout << "Decoder: End of program reached" << std::endl;
-            return;
-        }
+        // Decode the instruction fields
+        fetched_instr->decoded = decode_cached(fetched_instr->address, instruction_value);
 
-        if (!pipeline_registers["Execute"]){
-            std::cout << "Decoder: " << decodedName << std::endl;
+        if (!pipeline_registers[STAGE_EXECUTE]){
+            if (log.enabled(LOG_TRACE))
+                LOG(log, LOG_TRACE, "Decoder: " << decoder.disassemble(fetched_instr->decoded));
+            else
+                LOG(log, LOG_STAGE, "Decoder: " << to_hex_string(fetched_instr->binary));
 
             // Move instruction to Decode stage
-            pipeline_registers["Decode"] = nullptr;
-            pipeline_registers["Execute"] = fetched_instr;
+            pipeline_registers[STAGE_DECODE] = nullptr;
+            pipeline_registers[STAGE_EXECUTE] = fetched_instr;
         }
         else{
-            std::cout << "Decoder: Execute is busy." << std::endl;
+            LOG(log, LOG_STAGE, "Decoder: Execute is busy.");
         }
     } 
     else {
-        std::cout << "Decoder: No instruction to decode." << std::endl;
+        LOG(log, LOG_STAGE, "Decoder: No instruction to decode.");
         decode_counter = 0;
     }
 }
 
+// Scoreboard Decode: move up to width instructions on to the issue queue, in order
+void Core::decode_group() {
+    if (!decode_queue.count) {
+        LOG(log, LOG_STAGE, "Decoder: No instruction to decode.");
+        return;
+    }
+
+    while (decode_queue.count) {
+        Instruction* fetched_instr = decode_queue.front();
+        fetched_instr->decoded = decode_cached(fetched_instr->address, fetched_instr->binary);
+        if (issue_queue.count == pipeline.width) {
+            LOG(log, LOG_STAGE, "Decoder: Execute is busy.");
+            return;
+        }
+
+        if (log.enabled(LOG_TRACE))
+            LOG(log, LOG_TRACE, "Decoder: " << decoder.disassemble(fetched_instr->decoded));
+        else
+            LOG(log, LOG_STAGE, "Decoder: " << to_hex_string(fetched_instr->binary));
+        decode_queue.pop_front();
+        issue_queue.push(fetched_instr);
+    }
+}
+
 void Core::execute() { 
-    Instruction* instr = pipeline_registers["Execute"];
+    Instruction* instr = pipeline_registers[STAGE_EXECUTE];
     if (instr) {
         // If execute_delay_remaining == 0, initialize it based on instruction type
-        if (instr->execute_delay == 0 && instr->store_delay == 0 && !execute_delay_complete) {
-            instr->stage = "Execute";
-            instr->cycle_entered["Execute"] = clock_cycle;
-
-            // Extract operands and validate
-            std::vector<std::string>& operands = instr->operands;
-
-            if (operands.empty()) {
-                std::cout << "Execute: Invalid instruction, no operands provided." << std::endl;
+        if (execute_starting(instr)) {
+            if (vector_ready(instr->decoded) > active_cycles) {
+                LOG(log, LOG_STAGE, "Execute: " << OperationTable[instr->decoded.op].name << " waiting for the vector unit.");
                 return;
             }
+            instr->stage = STAGE_EXECUTE;
+            instr->cycle_entered[STAGE_EXECUTE] = active_cycles;
 
-            // Execute based on instruction name
-            std::string name = operands[0];  // The first operand is the instruction name
-
-            // Handle store instructions
-            // if (name == "sw" || name == "fsw"){
-            //     if (!pipeline_registers["Store"]){
-            //         pipeline_registers["Store"] = instr;
-            //         pipeline_registers["Execute"] = nullptr;
-            //         std::cout << "Execute: Instruction " << name << " sent to Store stage." << std::endl;
-            //         return;
-            //     } else {
-            //         std::cout << "Execute: Store stage busy, cannot send instruction " << name << std::endl;
-            //         return;
-            //     }
-            // }
+            const DecodedOp& decoded = instr->decoded;
+            const char* name = OperationTable[decoded.op].name;
 
-            // Determine delay based on instruction type
-            int delay_amount = (name == "fadd.s" || name == "fsub.s" || name == "flw" || name == "fsw") ? 5 :
-                               ((name == "addi" || name == "and" || name == "or" || name == "xori" ||
-                                 name == "slli" || name == "blt" || name == "jal"|| name == "jalr" ||
-                                 name == "lw" || name == "sw") ? 1 : 0);
+            start_vector_access(instr);
 
-            instr->execute_delay = delay_amount;
+            // Determine delay based on instruction type
+            instr->execute_delay = execute_latency(decoded);
             if (instr->execute_delay > 0) {
-                std::cout << "Execute: Instruction " << name << " delay remaining: " << instr->execute_delay << std::endl;
+                LOG(log, LOG_STAGE, "Execute: Instruction " << name << " delay remaining: " << instr->execute_delay);
                 return; // Do not proceed further this cycle
             }
         } else {
@@ -161,7 +336,7 @@ void Core::execute() {
                 instr->execute_delay--;
                 if (instr->execute_delay > 0) {
                     // Delay not yet expired, keep instruction in Execute stage
-                    std::cout << "Execute: Instruction " << instr->operands[0] << " delay remaining: " << instr->execute_delay << std::endl;
+                    LOG(log, LOG_STAGE, "Execute: Instruction " << OperationTable[instr->decoded.op].name << " delay remaining: " << instr->execute_delay);
                     return;
                 }
             }
@@ -171,357 +346,1706 @@ void Core::execute() {
             }
         }
         execute_delay_complete = true;
+        if (overwrites_store_source(instr)) {
+            LOG(log, LOG_STAGE, "Execute: " << OperationTable[instr->decoded.op].name << " waiting for the Store stage to read its registers.");
+            return;
+        }
         // Now execute_delay_remaining == 0, proceed to execute instruction
-        execute_instruction(instr, instr->operands[0], instr->operands);
+        execute_instruction(instr, instr->decoded);
 
-        event_list.push_back({instr->name, "Execute", clock_cycle});
+        record_event(instr, STAGE_EXECUTE);
 
     } else {
-        std::cout << "Execute: No instruction to execute." << std::endl;
+        LOG(log, LOG_STAGE, "Execute: No instruction to execute.");
     }
 }
 
 void Core::store() {
 
-    Instruction* instr = pipeline_registers["Store"];
+    Instruction* instr = pipeline_registers[STAGE_STORE];
     if (instr) {
         store_counter = 1;
-        instr->stage = "Store";
-        instr->cycle_entered["Store"] = clock_cycle;
-        event_list.push_back({instr->name, "Store", clock_cycle});
+        instr->stage = STAGE_STORE;
+        instr->cycle_entered[STAGE_STORE] = active_cycles;
+        record_event(instr, STAGE_STORE);
 
-        std::vector<std::string>& operands = instr->operands;
-        std::string name = operands[0];
-
-        int added_delay = (name == "fsw") ? 5: 1;
-
-        store_instruction(name, operands, added_delay);
+        store_instruction(instr, instr->decoded);
 
     } else {
-        std::cout << "Store: No instruction to store." << std::endl;
+        LOG(log, LOG_STAGE, "Store: No instruction to store.");
         return;
     }
 
 }
 
-void Core::store_instruction(std::string name, std::vector<std::string> operands, int added_delay){
-    static uint32_t effective_addr = 0;
-    static std::string src_reg;
-
-    if (name == "sw" || name == "fsw") {
-        src_reg = operands[1];
-        std::string addr_reg_offset = operands[2];
-
-        size_t start = addr_reg_offset.find('(');
-        size_t end = addr_reg_offset.find(')');
-        std::string addr_reg = addr_reg_offset.substr(start + 1, end - start - 1);
-        int offset = std::stoi(addr_reg_offset.substr(0, start));
+void Core::store_instruction(Instruction* instr, const DecodedOp& decoded){
+    if (decoded.op == OP_VSE32_V) {
+        // One element per access; the vector unit keeps the data register until the last
+        const char* name = OperationTable[decoded.op].name;
+        if (!elements_done(instr)) {
+            uint32_t address = memory_address(instr);
+            uint32_t value = read_v_bits(decoded.rd, instr->element);
+            float floatValue;
+            std::memcpy(&floatValue, &value, sizeof(floatValue));
+            MemResult result = mem_write(dcache.get(), address, value);
+            if (result.status != MEM_DONE) {
+                LOG(log, LOG_STAGE, "Store: Store operation pending on address " << address << " Cycles remaining: " << result.storeDelay);
+                return;
+            }
+            LOG(log, LOG_STAGE, "Store: " << name << ": Store " << floatValue << " (element " << instr->element << " of v" << +decoded.rd << ") into memory address " << address << " successful.");
+            instr->element = next_element(instr, instr->element + 1);
+            if (!elements_done(instr)) return;
+        }
+        LOG(log, LOG_STAGE, "Store: " << name << ": Stored v" << +decoded.rd << " (" << instr->vector_length << " elements).");
+        vector_done_at = active_cycles;
+    } else if (functional_unit(decoded.op) == UNIT_STORE) {
+        const char* name = OperationTable[decoded.op].name;
 
-        int base_addr = registers[addr_reg];
-        effective_addr = base_addr + offset;
+        int base_addr = x_registers[decoded.rs1];
+        uint32_t effective_addr = base_addr + decoded.immediate;
 
-        uint32_t value = registers[src_reg];
+        uint32_t value = (decoded.op == OP_FSW) ? read_f_bits(decoded.rs2) : x_registers[decoded.rs2];
         
         float floatValue;
         std::memcpy(&floatValue, &value, sizeof(floatValue));
 
-        std::vector<uint32_t> returnValues = membus->write(core_id, effective_addr, value, 0, false); // ram->write(effective_addr, value, 0, false);
+        MemResult result = mem_write(dcache.get(), effective_addr, value, access_size(decoded.op)); // ram->write(effective_addr, value, 0, false);
 
-        if (returnValues[0] && returnValues[0] != UINT32_MAX){
-            if (name == "fsw")
-                std::cout << "Store: " << name << ": Store " << floatValue << " into memory address " << effective_addr << " successful." << std::endl;
+        if (result.status == MEM_DONE){
+            if (decoded.op == OP_FSW)
+                LOG(log, LOG_STAGE, "Store: " << name << ": Store " << floatValue << " into memory address " << effective_addr << " successful.");
             else
-                std::cout << "Store: " << name << ": Store " << value << " into memory address " << effective_addr << " successful." << std::endl;
-            hold_registers[addr_reg] = false;
+                LOG(log, LOG_STAGE, "Store: " << name << ": Store " << value << " into memory address " << effective_addr << " successful.");
+            hold_registers[decoded.rs1] = false;
         }
         else {
-            std::cout << "Store: Store operation pending on address " << effective_addr << " Cycles remaining: " << returnValues[1] << std::endl;
-            hold_registers[addr_reg] = true;
+            LOG(log, LOG_STAGE, "Store: Store operation pending on address " << effective_addr << " Cycles remaining: " << result.storeDelay);
+            hold_registers[decoded.rs1] = true;
             return;
         }
 
     } else {
-        std::cout << "Store: No store instruction to process." << std::endl;
+        LOG(log, LOG_STAGE, "Store: No store instruction to process.");
         return;
     }
-    pipeline_registers["Store"] = nullptr;
+    retire(STAGE_STORE);
     store_delay_complete = 0;
 }
 
-void Core::clean_event_list(Instruction* instr) {
-    for (auto it = event_list.begin(); it != event_list.end();) {
-        if (it->name == instr->name && it->stage == instr->stage) {
-            it = event_list.erase(it);
+// Register file index of each register the instruction reads; returns how many there are
+int Core::source_registers(const DecodedOp& decoded, int sources[3]) const {
+    const OperationInfo& info = OperationTable[decoded.op];
+    int rs1 = decoded.rs1 + (info.fpRs1 ? 32 : 0);
+    int rs2 = decoded.rs2 + (info.fpRs2 ? 32 : 0);
+    switch (decoded.format) {
+        case FORMAT_I:
+            // The immediate CSR forms hold their operand in the rs1 field
+            if (decoded.op == OP_CSRRWI || decoded.op == OP_CSRRSI || decoded.op == OP_CSRRCI) return 0;
+            sources[0] = rs1;
+            return 1;
+        case FORMAT_R:
+            sources[0] = rs1;
+            switch (decoded.op) {
+                // Unary FP operations use the rs2 field to pick the variant
+                case OP_FSQRT_S: case OP_FCVT_W_S: case OP_FCVT_WU_S: case OP_FCVT_S_W:
+                case OP_FCVT_S_WU: case OP_FMV_X_W: case OP_FCLASS_S: case OP_FMV_W_X:
+                    return 1;
+                default:
+                    sources[1] = rs2;
+                    return 2;
+            }
+        case FORMAT_S: case FORMAT_B:
+            sources[0] = rs1;
+            sources[1] = rs2;
+            return 2;
+        case FORMAT_R4:
+            sources[0] = rs1;
+            sources[1] = rs2;
+            sources[2] = decoded.rs3 + 32;
+            return 3;
+        case FORMAT_V:
+            // vsetvli reads the requested length; vector arithmetic only reads vector registers
+            if (decoded.op != OP_VSETVLI) return 0;
+            sources[0] = rs1;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Register file index the instruction writes, or -1 (stores, branches, x0 and vector registers,
+// which the vector unit keeps track of itself)
+int Core::dest_register(const DecodedOp& decoded) const {
+    if (decoded.format == FORMAT_S || decoded.format == FORMAT_B) return -1;
+    if (is_vector(decoded.op) && decoded.op != OP_VSETVLI) return -1;
+    if (OperationTable[decoded.op].fpRd) return decoded.rd + 32;
+    return decoded.rd ? decoded.rd : -1;
+}
+
+// First cycle an instruction can issue with reg as a source
+int Core::ready_cycle(int reg) const {
+    if (complete_at[reg] == INT_MAX) return INT_MAX;
+    bool forwarded = from_memory[reg] ? pipeline.forward_memory : pipeline.forward_execute;
+    return complete_at[reg] + (forwarded ? 0 : 1);
+}
+
+// Cycle the first hazard holding the instruction clears, INT_MAX while that waits on memory
+// or a busy unit. Nothing holds it if this is not past the current cycle; otherwise cause
+// points at the counter for that hazard.
+int Core::blocked_until(const Instruction* instr, uint64_t*& cause) {
+    const DecodedOp& decoded = instr->decoded;
+    int now = active_cycles;
+    cause = nullptr;
+
+    int sources[3];
+    int count = source_registers(decoded, sources);
+    int raw = now;
+    for (int i = 0; i < count; i++) {
+        raw = std::max(raw, ready_cycle(sources[i]));
+    }
+    if (raw > now) {
+        cause = &hazards.raw;
+        return raw;
+    }
+
+    int dest = dest_register(decoded);
+    if (dest >= 0 && complete_at[dest] > now) {
+        cause = &hazards.waw;
+        return complete_at[dest];
+    }
+    if (dest >= 0 && read_by_memory(dest)) {
+        cause = &hazards.war;
+        return INT_MAX;
+    }
+
+    int vector = vector_ready(decoded);
+    if (vector > now) {
+        cause = &hazards.structural;
+        return vector;
+    }
+
+    FunctionalUnit unit = functional_unit(decoded.op);
+    if ((unit == UNIT_LOAD && pipeline_registers[STAGE_LOAD]) || (unit == UNIT_STORE && pipeline_registers[STAGE_STORE])) {
+        cause = &hazards.structural;
+        return INT_MAX;
+    }
+    // Pipelined units take new work every cycle, so those only hold back the rest of a group
+    if (unit == UNIT_INT || unit == UNIT_FP) {
+        int free = unit_ready(unit);
+        if (free > now) {
+            cause = &hazards.structural;
+            return free;
+        }
+    }
+
+    // Legacy branches and jumps are relative to the live PC. The programs written for them
+    // count on Fetch having moved past the next instruction, so wait for that fetch.
+    bool pc_relative = decoded.format == FORMAT_B || decoded.op == OP_JAL || decoded.op == OP_JALR || decoded.op == OP_AUIPC;
+    if (isa == ISA_LEGACY && pc_relative && uint32_t(pc) == instr->address + 4 && uint32_t(pc) <= max_instruction_address) {
+        cause = &hazards.structural;
+        return INT_MAX;
+    }
+    return now;
+}
+
+// True if the store or load in flight still has to read reg
+bool Core::read_by_memory(int reg) const {
+    int sources[3];
+    for (Stage stage : {STAGE_STORE, STAGE_LOAD}) {
+        const Instruction* instr = pipeline_registers[stage];
+        if (!instr) continue;
+        int count = source_registers(instr->decoded, sources);
+        for (int i = 0; i < count; i++) {
+            if (sources[i] == reg) return true;
+        }
+    }
+    return false;
+}
+
+// A load waits for the store ahead of it to any of its bytes, and with a dcache for any store,
+// which would otherwise have its access stepped by the load's polls
+bool Core::load_waits(const Instruction* loading) const {
+    const Instruction* storing = pipeline_registers[STAGE_STORE];
+    if (!storing) return false;
+    if (dcache) return true;
+    uint64_t stored = memory_address(storing);
+    uint64_t loaded = memory_address(loading);
+    return stored < loaded + memory_bytes(loading) && loaded < stored + memory_bytes(storing);
+}
+
+// Legacy Execute: a load waits while the Store stage holds the dcache port, or while a vector
+// store there still has elements to write over the load's bytes
+bool Core::store_port_busy(const Instruction* loading) const {
+    const Instruction* storing = pipeline_registers[STAGE_STORE];
+    if (!storing) return false;
+    return dcache || (is_vector_memory(storing->decoded.op) && load_waits(loading));
+}
+
+// Legacy Execute: the instruction would write a register the Store stage reads from the
+// register file until its access is done
+bool Core::overwrites_store_source(const Instruction* instr) const {
+    int dest = dest_register(instr->decoded);
+    return dest >= 0 && read_by_memory(dest);
+}
+
+// Data address of the load or store in flight. The out-of-order engine works it out from
+// renamed operands, so the register file may no longer hold them; a vector access keeps the
+// base it started from and is at its next element.
+uint32_t Core::memory_address(const Instruction* instr) const {
+    if (is_vector_memory(instr->decoded.op)) return instr->data_address + 4 * instr->element;
+    return pipeline.out_of_order ? instr->data_address : effective_address(instr->decoded);
+}
+
+// Bytes from memory_address the load or store in flight has still to access
+uint32_t Core::memory_bytes(const Instruction* instr) const {
+    if (is_vector_memory(instr->decoded.op)) return 4 * (instr->vector_length - instr->element);
+    return access_size(instr->decoded.op);
+}
+
+// Scoreboard version of Execute: issue waiting instructions in order, up to width per
+// cycle, until one is held by a hazard. Results are computed at issue and become visible
+// to later instructions when their delay runs out; loads move on to the load unit.
+void Core::issue() {
+    stalled_on = nullptr;
+    if (!issue_queue.count) {
+        LOG(log, LOG_STAGE, "Execute: No instruction to issue.");
+        return;
+    }
+
+    for (int issued = 0; issued < pipeline.width && issue_queue.count; issued++) {
+        Instruction* instr = issue_queue.front();
+        const DecodedOp& decoded = instr->decoded;
+        const char* name = OperationTable[decoded.op].name;
+
+        uint64_t* cause;
+        if (blocked_until(instr, cause) > active_cycles) {
+            (*cause)++;
+            stalled_on = cause;
+            LOG(log, LOG_STAGE, "Execute: " << name << " held by a "
+                << (cause == &hazards.raw ? "RAW" : cause == &hazards.waw ? "WAW" : cause == &hazards.war ? "WAR" : "structural")
+                << " hazard.");
+            break;
+        }
+
+        // Execute only ever holds the instruction being issued, so a branch that redirects
+        // Fetch flushes exactly the younger ones still queued
+        issue_queue.pop_front();
+        pipeline_registers[STAGE_EXECUTE] = instr;
+        instr->stage = STAGE_EXECUTE;
+        instr->cycle_entered[STAGE_EXECUTE] = active_cycles;
+        record_event(instr, STAGE_EXECUTE);
+        start_vector_access(instr);
+
+        occupy_unit(functional_unit(decoded.op), decoded.op);
+        int dest = dest_register(decoded);
+        if (functional_unit(decoded.op) == UNIT_LOAD) {
+            pipeline_registers[STAGE_LOAD] = instr;
+            pipeline_registers[STAGE_EXECUTE] = nullptr;
+            if (dest >= 0) {
+                complete_at[dest] = INT_MAX;
+                from_memory[dest] = true;
+            }
+            LOG(log, LOG_STAGE, "Execute: Instruction " << name << " sent to the load unit.");
+            continue;
+        }
+
+        execute_instruction(instr, decoded);
+        if (dest >= 0) {
+            complete_at[dest] = reserve_writeback(active_cycles + std::max(1, execute_latency(decoded)));
+            from_memory[dest] = false;
+            drain_until = std::max(drain_until, complete_at[dest]);
+        }
+        if (decoded.format == FORMAT_V && decoded.op != OP_VSETVLI) {
+            vector_done_at = active_cycles + std::max(1, execute_latency(decoded));
+            drain_until = std::max(drain_until, vector_done_at);
+        }
+    }
+}
+
+// Integer and FP units come as configured; loads and stores each have one
+int Core::unit_count(FunctionalUnit unit) const {
+    return unit == UNIT_INT ? pipeline.int_units : unit == UNIT_FP ? pipeline.fp_units : 1;
+}
+
+// First cycle one of the units of this kind can start an operation
+int Core::unit_ready(FunctionalUnit unit) const {
+    const int* free_at = unit_free_at[unit];
+    return *std::min_element(free_at, free_at + unit_count(unit));
+}
+
+// Start op on a free unit, which takes its next operation after the op's issue interval
+void Core::occupy_unit(FunctionalUnit unit, Operation op) {
+    int* free_at = unit_free_at[unit];
+    int* chosen = std::min_element(free_at, free_at + unit_count(unit));
+    *chosen = active_cycles + latencies[op].interval;
+}
+
+// First cycle from `cycle` on with a free register write port; takes it
+int Core::reserve_writeback(int cycle, bool force) {
+    while (true) {
+        WritebackSlot& slot = writebacks[cycle % WRITEBACK_WINDOW];
+        if (slot.cycle != cycle) slot = {cycle, 0};
+        if (slot.count < pipeline.width || force) {
+            slot.count++;
+            return cycle;
+        }
+        cycle++;
+    }
+}
+
+// Load unit of the scoreboard pipeline: poll memory until the data arrives
+void Core::load() {
+    Instruction* instr = pipeline_registers[STAGE_LOAD];
+    if (!instr) return;
+
+    const DecodedOp& decoded = instr->decoded;
+    const OperationInfo& info = OperationTable[decoded.op];
+    uint32_t address = memory_address(instr);
+    if (load_waits(instr)) {
+        LOG(log, LOG_STAGE, "Load: " << info.name << ": Waiting for the store ahead of it.");
+        return;
+    }
+
+    if (decoded.op == OP_VLE32_V) {
+        if (!load_vector_element(instr, "Load")) return;
+        instr->stage = STAGE_LOAD;
+        instr->cycle_entered[STAGE_LOAD] = active_cycles;
+        record_event(instr, STAGE_LOAD);
+        vector_done_at = active_cycles + (pipeline.forward_memory ? 0 : 1);
+        if (pipeline.out_of_order) {
+            rob[loading_entry].done_at = vector_done_at;
+            pipeline_registers[STAGE_LOAD] = nullptr;
+            return;
+        }
+        retire(STAGE_LOAD);
+        return;
+    }
+
+    MemResult result = mem_read(dcache.get(), address, access_size(decoded.op));
+    if (result.status == MEM_BLOCKED) {
+        LOG(log, LOG_STAGE, "Load: " << info.name << ": Waiting for other core to finish.");
+        return;
+    }
+    if (result.status != MEM_DONE) {
+        LOG(log, LOG_STAGE, "Load: Waiting to load from " << address << ". Delay remaining: " << result.loadDelay);
+        return;
+    }
+
+    instr->stage = STAGE_LOAD;
+    instr->cycle_entered[STAGE_LOAD] = active_cycles;
+    record_event(instr, STAGE_LOAD);
+    uint32_t value = load_result(decoded.op, result.data);
+    LOG(log, LOG_STAGE, "Load: " << info.name << ": Loaded " << value << " into " << getRegisterName(decoded.rd, info.fpRd) << " from memory address " << address << ".");
+
+    // Loaded data is written back as it arrives, even past the port limit
+    if (pipeline.out_of_order) {
+        // The ROB keeps the slot until the load commits
+        RobEntry& entry = rob[loading_entry];
+        entry.value = value;
+        entry.from_memory = true;
+        entry.done_at = reserve_writeback(active_cycles, true);
+        pipeline_registers[STAGE_LOAD] = nullptr;
+        return;
+    }
+    if (info.fpRd)
+        write_f_bits(decoded.rd, value);
+    else
+        write_x(decoded.rd, value);
+    int dest = dest_register(decoded);
+    if (dest >= 0) complete_at[dest] = reserve_writeback(active_cycles, true);
+    retire(STAGE_LOAD);
+}
+
+uint32_t Core::read_register(int reg) const {
+    return reg < 32 ? static_cast<uint32_t>(x_registers[reg]) : read_f_bits(reg - 32);
+}
+
+void Core::write_register(int reg, uint32_t bits) {
+    if (reg < 32) x_registers[reg] = bits;
+    else write_f_bits(reg - 32, bits);
+}
+
+// True for the branches and jumps that can send Fetch somewhere else
+static bool is_control(const DecodedOp& decoded) {
+    return decoded.format == FORMAT_B || decoded.op == OP_JAL || decoded.op == OP_JALR;
+}
+
+// Result of an RV32IM integer operation on its two operands (b is the immediate of the I and U
+// formats). Division by zero and overflow give the results the ISA defines instead of trapping.
+static uint32_t integer_result(Operation op, uint32_t a, uint32_t b) {
+    int32_t sa = static_cast<int32_t>(a);
+    int32_t sb = static_cast<int32_t>(b);
+    switch (op) {
+        case OP_ADD: case OP_ADDI: return a + b;
+        case OP_SUB: return a - b;
+        case OP_SLL: case OP_SLLI: return a << (b & 31);
+        case OP_SRL: case OP_SRLI: return a >> (b & 31);
+        case OP_SRA: case OP_SRAI: return static_cast<uint32_t>(sa >> (b & 31));
+        case OP_SLT: case OP_SLTI: return sa < sb;
+        case OP_SLTU: case OP_SLTIU: return a < b;
+        case OP_XOR: case OP_XORI: return a ^ b;
+        case OP_OR: case OP_ORI: return a | b;
+        case OP_AND: case OP_ANDI: return a & b;
+        case OP_LUI: return b;
+        case OP_MUL: return a * b;
+        case OP_MULH: return static_cast<uint32_t>((int64_t(sa) * int64_t(sb)) >> 32);
+        case OP_MULHSU: return static_cast<uint32_t>((int64_t(sa) * int64_t(b)) >> 32);
+        case OP_MULHU: return static_cast<uint32_t>((uint64_t(a) * uint64_t(b)) >> 32);
+        case OP_DIV:
+            if (b == 0) return UINT32_MAX;
+            if (sa == INT32_MIN && sb == -1) return a;
+            return static_cast<uint32_t>(sa / sb);
+        case OP_DIVU: return b ? a / b : UINT32_MAX;
+        case OP_REM:
+            if (b == 0) return a;
+            if (sa == INT32_MIN && sb == -1) return 0;
+            return static_cast<uint32_t>(sa % sb);
+        case OP_REMU: return b ? a % b : a;
+        default: return 0;
+    }
+}
+
+// Operations integer_result computes
+static bool is_integer(Operation op) {
+    OpClass kind = op_class(op);
+    return op != OP_UNKNOWN && (kind == CLASS_ALU || kind == CLASS_MUL || kind == CLASS_DIV);
+}
+
+// Operations execute_fp computes (flw and fsw go through memory, vector FP through execute_vector)
+static bool is_fp(Operation op) {
+    OpClass kind = op_class(op);
+    return !is_vector(op) && (kind == CLASS_FADD || kind == CLASS_FMUL || kind == CLASS_FDIV || kind == CLASS_FMISC);
+}
+
+static bool is_csr(Operation op) {
+    return op >= OP_CSRRW && op <= OP_CSRRCI;
+}
+
+static bool branch_taken(Operation op, uint32_t a, uint32_t b) {
+    switch (op) {
+        case OP_BEQ: return a == b;
+        case OP_BNE: return a != b;
+        case OP_BLT: return static_cast<int32_t>(a) < static_cast<int32_t>(b);
+        case OP_BGE: return static_cast<int32_t>(a) >= static_cast<int32_t>(b);
+        case OP_BLTU: return a < b;
+        case OP_BGEU: return a >= b;
+        default: return false;
+    }
+}
+
+// fflags bits, and the rounding modes of frm and an instruction's rm field
+const uint32_t FFLAG_NX = 0x01;     // Inexact
+const uint32_t FFLAG_UF = 0x02;     // Underflow
+const uint32_t FFLAG_OF = 0x04;     // Overflow
+const uint32_t FFLAG_DZ = 0x08;     // Divide by zero
+const uint32_t FFLAG_NV = 0x10;     // Invalid operation
+const uint32_t RM_RMM = 4;          // Round to nearest, ties away from zero
+const uint32_t RM_DYNAMIC = 7;      // Use frm
+const uint32_t CANONICAL_NAN = 0x7FC00000;
+
+const uint32_t CSR_FFLAGS = 0x001;
+const uint32_t CSR_FRM = 0x002;
+const uint32_t CSR_FCSR = 0x003;
+
+// Host rounding for each RISC-V mode; the host has no ties-away mode, so RMM arithmetic rounds
+// ties to even (conversions to integer do honour it)
+static const int HostRounding[5] = {FE_TONEAREST, FE_TOWARDZERO, FE_DOWNWARD, FE_UPWARD, FE_TONEAREST};
+
+// An instruction that takes its rounding mode from frm is illegal while frm holds a reserved
+// mode (5 to 7): why, or an empty string if it is not. Reserved modes in an instruction's own rm
+// field never decode, so those trap as unknown instructions.
+static std::string illegal_rounding(const Instruction* instr, uint32_t fcsr) {
+    const DecodedOp& decoded = instr->decoded;
+    OpClass kind = op_class(decoded.op);
+    bool dynamic = is_vector(decoded.op) ? (kind == CLASS_FADD || kind == CLASS_FMUL)
+                                         : is_fp(decoded.op) && decoded.rm == RM_DYNAMIC;
+    uint32_t frm = (fcsr >> 5) & 7;
+    if (!dynamic || frm <= RM_RMM) return std::string();
+
+    std::ostringstream message;
+    message << "Illegal instruction " << OperationTable[decoded.op].name << " with reserved rounding mode " << frm << " in frm";
+    return message.str();
+}
+
+static float as_float(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t as_bits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static bool is_nan(uint32_t bits) {
+    return (bits & 0x7F800000) == 0x7F800000 && (bits & 0x007FFFFF);
+}
+
+static bool is_signaling(uint32_t bits) {
+    return is_nan(bits) && !(bits & 0x00400000);
+}
+
+// Exceptions the host raised since they were last cleared, as fflags
+static uint32_t host_fflags() {
+    int raised = std::fetestexcept(FE_ALL_EXCEPT);
+    return (raised & FE_INEXACT ? FFLAG_NX : 0) | (raised & FE_UNDERFLOW ? FFLAG_UF : 0) |
+           (raised & FE_OVERFLOW ? FFLAG_OF : 0) | (raised & FE_DIVBYZERO ? FFLAG_DZ : 0) |
+           (raised & FE_INVALID ? FFLAG_NV : 0);
+}
+
+// fclass.s: one bit for -inf, -normal, -subnormal, -0, +0, +subnormal, +normal, +inf, sNaN, qNaN
+static uint32_t fp_class(uint32_t bits) {
+    bool negative = bits >> 31;
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t fraction = bits & 0x007FFFFF;
+    if (exponent == 0xFF) {
+        if (fraction) return is_signaling(bits) ? 1u << 8 : 1u << 9;
+        return negative ? 1u << 0 : 1u << 7;
+    }
+    if (exponent == 0) {
+        if (fraction) return negative ? 1u << 2 : 1u << 5;
+        return negative ? 1u << 3 : 1u << 4;
+    }
+    return negative ? 1u << 1 : 1u << 6;
+}
+
+// fcvt.w.s and fcvt.wu.s: round under rm and saturate, NaN converting to the largest value
+static uint32_t fp_to_int(uint32_t bits, bool is_signed, uint32_t rm, uint32_t& flags) {
+    float value = as_float(bits);
+    double lowest = is_signed ? -2147483648.0 : 0.0;
+    double highest = is_signed ? 2147483647.0 : 4294967295.0;
+    if (is_nan(bits)) {
+        flags |= FFLAG_NV;
+        return is_signed ? INT32_MAX : UINT32_MAX;
+    }
+    // The host rounding mode is already rm's
+    double rounded = rm == RM_RMM ? std::round(value) : std::nearbyint(value);
+    if (rounded < lowest || rounded > highest) {
+        flags |= FFLAG_NV;
+        if (rounded < lowest) return is_signed ? uint32_t(INT32_MIN) : 0;
+        return is_signed ? INT32_MAX : UINT32_MAX;
+    }
+    if (rounded != value) flags |= FFLAG_NX;
+    return is_signed ? static_cast<uint32_t>(static_cast<int32_t>(rounded)) : static_cast<uint32_t>(rounded);
+}
+
+// fmin.s and fmax.s: a NaN operand gives the other one, -0 counts as less than +0
+static uint32_t fp_min_max(uint32_t a, uint32_t b, bool max, uint32_t& flags) {
+    if (is_signaling(a) || is_signaling(b)) flags |= FFLAG_NV;
+    if (is_nan(a) && is_nan(b)) return CANONICAL_NAN;
+    if (is_nan(a)) return b;
+    if (is_nan(b)) return a;
+    float fa = as_float(a);
+    float fb = as_float(b);
+    bool a_lower = fa < fb || (fa == fb && (a >> 31));
+    return a_lower != max ? a : b;
+}
+
+// feq.s only signals on signaling NaNs, flt.s and fle.s on any NaN
+static uint32_t fp_compare(Operation op, uint32_t a, uint32_t b, uint32_t& flags) {
+    if (is_nan(a) || is_nan(b)) {
+        if (op != OP_FEQ_S || is_signaling(a) || is_signaling(b)) flags |= FFLAG_NV;
+        return 0;
+    }
+    float fa = as_float(a);
+    float fb = as_float(b);
+    return op == OP_FEQ_S ? fa == fb : op == OP_FLT_S ? fa < fb : fa <= fb;
+}
+
+// Loads and stores share one reservation station and one address unit
+static FunctionalUnit station_of(FunctionalUnit unit) {
+    return unit == UNIT_STORE ? UNIT_LOAD : unit;
+}
+
+// First cycle every operand of the entry can be read, INT_MAX while one has no known completion
+int Core::operands_ready(const RobEntry& entry) const {
+    int ready = 0;
+    for (int i = 0; i < entry.source_count; i++) {
+        int tag = entry.tags[i];
+        // A producer that has committed since dispatch left its value in the register file
+        if (tag < 0 || rob[tag].seq != entry.tag_seqs[i]) continue;
+        const RobEntry& producer = rob[tag];
+        if (producer.done_at == INT_MAX) return INT_MAX;
+        bool forwarded = producer.from_memory ? pipeline.forward_memory : pipeline.forward_execute;
+        ready = std::max(ready, producer.done_at + (forwarded ? 0 : 1));
+    }
+    return ready;
+}
+
+// Value of the entry's ith source. Any write to that register committed since dispatch can only
+// have come from the tagged producer, so the register file is right whenever the tag has gone.
+uint32_t Core::operand(const RobEntry& entry, int i) const {
+    int tag = entry.tags[i];
+    if (tag >= 0 && rob[tag].seq == entry.tag_seqs[i]) return rob[tag].value;
+    return read_register(entry.sources[i]);
+}
+
+// CSR accesses and vector instructions are renamed alone into an empty ROB and hold back
+// everything after them until they commit, so FP instructions never run on either side of a
+// change to frm or fflags, and the vector registers, vl and vtype need no renaming. ecall,
+// ebreak and words that do not decode do the same so that they only stop the core from the
+// right path.
+static bool serializes(Operation op) {
+    return is_csr(op) || is_vector(op) || op == OP_ECALL || op == OP_EBREAK || op == OP_UNKNOWN;
+}
+
+// Counter for whatever keeps the instruction from being renamed this cycle, or null
+uint64_t* Core::dispatch_blocked(const Instruction* instr) {
+    if (rob_count && (serializes(instr->decoded.op) || serializes(rob[rob_head].instr->decoded.op))) return &ooo_stats.serialized;
+    FunctionalUnit station = station_of(functional_unit(instr->decoded.op));
+    if (rob_count == pipeline.rob_entries) return &ooo_stats.rob_full;
+    if (stations_used[station] == pipeline.station_entries) return &ooo_stats.stations_full;
+    if (station == UNIT_LOAD && lsq_used == pipeline.lsq_entries) return &ooo_stats.lsq_full;
+    return nullptr;
+}
+
+// Rename up to width instructions from the issue queue into the ROB and their stations, in order
+void Core::dispatch() {
+    stalled_on = nullptr;
+    for (int n = 0; n < pipeline.width && issue_queue.count; n++) {
+        Instruction* instr = issue_queue.front();
+        const DecodedOp& decoded = instr->decoded;
+        uint64_t* full = dispatch_blocked(instr);
+        if (full) {
+            (*full)++;
+            stalled_on = full;
+            LOG(log, LOG_STAGE, "Dispatch: " << OperationTable[decoded.op].name << " waiting for "
+                << (full == &ooo_stats.rob_full ? "the ROB" : full == &ooo_stats.lsq_full ? "the LSQ" :
+                    full == &ooo_stats.serialized ? "a serializing instruction" : "a reservation station") << ".");
+            break;
+        }
+        issue_queue.pop_front();
+
+        int index = (rob_head + rob_count) % rob.size();
+        rob_count++;
+        RobEntry& entry = rob[index];
+        entry = RobEntry();
+        entry.instr = instr;
+        entry.seq = next_seq++;
+        entry.unit = functional_unit(decoded.op);
+        entry.source_count = source_registers(decoded, entry.sources);
+        for (int i = 0; i < entry.source_count; i++) {
+            int tag = rename_map[entry.sources[i]];
+            entry.tags[i] = tag;
+            entry.tag_seqs[i] = tag >= 0 ? rob[tag].seq : 0;
+        }
+        entry.dest = dest_register(decoded);
+        if (entry.dest >= 0) {
+            entry.previous = rename_map[entry.dest];
+            entry.previous_seq = entry.previous >= 0 ? rob[entry.previous].seq : 0;
+            rename_map[entry.dest] = index;
+        }
+        stations_used[station_of(entry.unit)]++;
+        if (station_of(entry.unit) == UNIT_LOAD) lsq_used++;
+        LOG(log, LOG_STAGE, "Dispatch: " << OperationTable[decoded.op].name << " renamed into ROB entry " << index << ".");
+    }
+}
+
+// Out-of-order Execute: issue up to width entries whose operands are ready, oldest first, within
+// each unit's limit. Branches and jumps still resolve in program order, so a redirect only ever
+// comes from the right path; loads and stores only work out their address here.
+void Core::issue_out_of_order() {
+    int now = active_cycles;
+    int issued = 0;
+    bool branch_waiting = false;
+    for (int i = 0; i < rob_count && issued < pipeline.width; i++) {
+        RobEntry& entry = rob_at(i);
+        if (entry.issued) continue;
+        Instruction* instr = entry.instr;
+        const DecodedOp& decoded = instr->decoded;
+        bool control = is_control(decoded);
+        FunctionalUnit station = station_of(entry.unit);
+        if ((control && branch_waiting) || operands_ready(entry) > now || unit_ready(station) > now || vector_ready(decoded) > now) {
+            branch_waiting |= control;
+            continue;
+        }
+
+        instr->stage = STAGE_EXECUTE;
+        instr->cycle_entered[STAGE_EXECUTE] = now;
+        if (station == UNIT_LOAD) {
+            instr->data_address = operand(entry, 0) + decoded.immediate;
+            start_vector_access(instr);
+            if (entry.unit == UNIT_STORE) {
+                entry.value = operand(entry, 1);
+                entry.done_at = now + 1;
+            }
+            LOG(log, LOG_STAGE, "Execute: " << OperationTable[decoded.op].name << " address " << instr->data_address << ".");
         } else {
-            ++it;
+            execute_renamed(entry);
+            int delay = std::max(1, execute_latency(decoded));
+            entry.done_at = entry.dest >= 0 ? reserve_writeback(now + delay) : now + delay;
         }
+        record_event(instr, STAGE_EXECUTE);
+        entry.issued = true;
+        stations_used[station]--;
+        occupy_unit(station, decoded.op);
+        issued++;
     }
 }
 
-void Core::execute_instruction(Instruction* instr, std::string name, std::vector<std::string> operands) {
+// Run an ALU, FP or control instruction on its renamed operands. execute_instruction works on
+// the architectural registers, so the operand values are swapped in around the call and the
+// committed values put back; the result goes to the entry, as do the FP exceptions it raised,
+// which only reach fflags at commit.
+void Core::execute_renamed(RobEntry& entry) {
+    int regs[4];
+    uint32_t values[4];
+    uint32_t saved[4];
+    int count = entry.source_count;
+    for (int i = 0; i < count; i++) {
+        regs[i] = entry.sources[i];
+        values[i] = operand(entry, i);
+    }
+    if (entry.dest >= 0) regs[count++] = entry.dest;
+    for (int i = 0; i < count; i++) saved[i] = read_register(regs[i]);
+    for (int i = 0; i < entry.source_count; i++) write_register(regs[i], values[i]);
+
+    uint32_t committed_fcsr = fcsr;
+    if (entry.unit == UNIT_FP) fcsr &= ~0x1Fu;
+    pipeline_registers[STAGE_EXECUTE] = entry.instr;
+    execute_instruction(entry.instr, entry.instr->decoded);
+    pipeline_registers[STAGE_EXECUTE] = nullptr;
+    if (entry.dest >= 0) entry.value = read_register(entry.dest);
+    if (entry.unit == UNIT_FP) {
+        entry.fflags = fcsr & 0x1F;
+        fcsr = committed_fcsr;
+    }
 
-    if (name == "addi") {
-        // Add Immediate
-        std::string dest_reg = operands[1];
-        std::string src_reg = operands[2];
-        int immediate = std::stoi(operands[3]);
+    for (int i = count - 1; i >= 0; i--) write_register(regs[i], saved[i]);
+}
 
-        registers[dest_reg] = registers[src_reg] + immediate;
-        std::cout << "Execute: " << "ADDI: Added " << immediate << " to " << src_reg << ", result in " << dest_reg << ": " << registers[dest_reg] << "." << std::endl;
-    } else if (name == "add") {
-        // Add Registers
-        std::string dest_reg = operands[1];
-        std::string op0_reg = operands[2];
-        std::string op1_reg = operands[3];
+// ROB entry of the youngest store older than the load at `position` that writes any of its bytes,
+// -1 if there is none, or -2 while an older store has no address yet or only writes some of them
+int Core::forwarding_store(int position) const {
+    const Instruction* load = rob_at(position).instr;
+    uint64_t address = load->data_address;
+    uint64_t end = address + access_size(load->decoded.op);
+    for (int i = position - 1; i >= 0; i--) {
+        const RobEntry& entry = rob_at(i);
+        if (entry.unit != UNIT_STORE) continue;
+        if (!entry.issued) return -2;
+        uint64_t stored = entry.instr->data_address;
+        uint64_t stored_end = stored + access_size(entry.instr->decoded.op);
+        if (stored >= end || address >= stored_end) continue;
+        // A partial overlap waits for the store to reach memory
+        if (address < stored || end > stored_end) return -2;
+        return (rob_head + i) % rob.size();
+    }
+    return -1;
+}
+
+// True if a branch or jump older than the entry at `position` has not resolved yet
+bool Core::branch_pending(int position) const {
+    for (int i = 0; i < position; i++) {
+        const RobEntry& entry = rob_at(i);
+        if (!entry.issued && is_control(entry.instr->decoded)) return true;
+    }
+    return false;
+}
 
-        uint32_t val0 = registers[op0_reg];
-        uint32_t val1 = registers[op1_reg];
+// Give waiting loads their data, oldest first: from the youngest older store to their bytes,
+// or from memory through the load unit. Memory is only read once every older branch has
+// resolved, so loads down a wrong path never reach the caches or the bus.
+void Core::start_loads() {
+    for (int i = 0; i < rob_count; i++) {
+        RobEntry& entry = rob_at(i);
+        if (entry.unit != UNIT_LOAD || !entry.issued || entry.in_memory || entry.done_at != INT_MAX) continue;
+
+        const char* name = OperationTable[entry.instr->decoded.op].name;
+        int store = forwarding_store(i);
+        if (store >= 0) {
+            const RobEntry& source = rob[store];
+            uint32_t offset = entry.instr->data_address - source.instr->data_address;
+            entry.value = load_result(entry.instr->decoded.op, source.value >> (8 * offset));
+            entry.done_at = reserve_writeback(active_cycles + 1);
+            ooo_stats.forwarded++;
+            LOG(log, LOG_STAGE, "Load: " << name << ": Forwarded " << entry.value << " from ROB entry " << store << ".");
+        } else if (store == -1 && !pipeline_registers[STAGE_LOAD] && !branch_pending(i)) {
+            entry.in_memory = true;
+            loading_entry = (rob_head + i) % rob.size();
+            pipeline_registers[STAGE_LOAD] = entry.instr;
+            LOG(log, LOG_STAGE, "Load: " << name << " sent to the load unit.");
+        }
+    }
+}
+
+// True if the entry at the head of the ROB cannot commit this cycle
+bool Core::commit_blocked(const RobEntry& entry) const {
+    // Results are written back the cycle they complete and committed from the next
+    if (!entry.issued || entry.done_at >= active_cycles) return true;
+    // A trap drops every younger entry, which must not leave one in the load unit
+    if (pipeline_registers[STAGE_LOAD] && !illegal_rounding(entry.instr, fcsr).empty()) return true;
+    const Instruction* storing = pipeline_registers[STAGE_STORE];
+    if (!storing) return false;
+    if (entry.unit == UNIT_STORE) return true;
+    // The Store stage reads its base and data from the register file until it is done
+    int sources[3];
+    int count = source_registers(storing->decoded, sources);
+    return entry.dest >= 0 && std::find(sources, sources + count, entry.dest) != sources + count;
+}
+
+// Retire up to width finished entries in program order into the register file. A store goes
+// on to the Store stage, which then sees exactly the registers it was renamed against.
+void Core::commit() {
+    for (int n = 0; n < pipeline.width && rob_count; n++) {
+        RobEntry& entry = rob[rob_head];
+        if (commit_blocked(entry)) break;
+
+        std::string illegal = illegal_rounding(entry.instr, fcsr);
+        if (!illegal.empty()) {
+            // Neither it nor anything younger commits
+            trap(entry.instr, illegal);
+            break;
+        }
+
+        LOG(log, LOG_STAGE, "Commit: " << OperationTable[entry.instr->decoded.op].name << " from ROB entry " << rob_head << ".");
+        if (entry.unit == UNIT_STORE) {
+            pipeline_registers[STAGE_STORE] = entry.instr;
+        } else {
+            if (entry.dest >= 0) {
+                write_register(entry.dest, entry.value);
+                if (rename_map[entry.dest] == rob_head) rename_map[entry.dest] = -1;
+            }
+            fcsr |= entry.fflags;
+            instruction_pool.release(entry.instr);
+        }
+        if (station_of(entry.unit) == UNIT_LOAD) lsq_used--;
+        entry.seq = 0;
+        rob_head = (rob_head + 1) % rob.size();
+        rob_count--;
+    }
+}
 
-        registers[dest_reg] = val0 + val1;
-        std::cout << "Execute: " << "ADD: " << op0_reg << ": " << val0 << " + " 
-        << op1_reg << ": " << val1 << " = " << dest_reg << ": " << registers[dest_reg] <<   std::endl;
-    } else if (name == "lw" || name == "flw") {
-        // Load Word
-        std::string dest_reg = operands[1];
-        std::string addr_reg_offset = operands[2];
-        size_t start = addr_reg_offset.find('(');
-        size_t end = addr_reg_offset.find(')');
+// Drop the ROB entries younger than instr (all of them if it has none), youngest first so the
+// rename map unwinds to what it was when instr was renamed. Loads only reach memory once the
+// branches before them have resolved, so none of these is in the load unit.
+int Core::squash_younger(const Instruction* instr) {
+    int squashed = 0;
+    while (rob_count) {
+        RobEntry& entry = rob_at(rob_count - 1);
+        if (entry.instr == instr) break;
+        if (entry.dest >= 0) {
+            bool live = entry.previous >= 0 && rob[entry.previous].seq == entry.previous_seq;
+            rename_map[entry.dest] = live ? entry.previous : -1;
+        }
+        if (!entry.issued) stations_used[station_of(entry.unit)]--;
+        if (station_of(entry.unit) == UNIT_LOAD) lsq_used--;
+        instruction_pool.release(entry.instr);
+        entry.seq = 0;
+        rob_count--;
+        squashed++;
+    }
+    return squashed;
+}
 
-        std::string addr_reg = addr_reg_offset.substr(start + 1, end - start - 1);
-        int offset = std::stoi(addr_reg_offset.substr(0, start));
+// One clock cycle: stages run back to front so each hands work on to a free register
+void Core::tick() {
+    store();
+    if (pipeline.out_of_order) {
+        commit();
+        load();
+        start_loads();
+        issue_out_of_order();
+        dispatch();
+        ooo_stats.occupancy += rob_count;
+    } else if (pipeline.scoreboard) {
+        load();
+        issue();
+    } else {
+        execute();
+    }
+    decode();
+    fetch();
+    active_cycles++;
+}
 
-        int base_addr = registers[addr_reg];
-        uint32_t effective_addr = registers[addr_reg] + offset;
+// Cycles from now in which every stage would only count a delay down or wait on another
+// stage that is counting down. Zero means the next cycle changes state and has to be ticked.
+int Core::idle_cycles() {
+    int idle = INT_MAX;
 
-        std::vector<uint32_t> returnValues = membus->read(core_id, effective_addr, false); // ram->read(effective_addr, false);
+    // A vector load or store with no elements to move finishes in its next cycle
+    Instruction* storing = pipeline_registers[STAGE_STORE];
+    if (storing) {
+        if (elements_done(storing)) return 0;
+        idle = std::min<int>(idle, mem_idle_cycles(dcache.get(), memory_address(storing), true));
+    }
 
-        if (hold_registers[dest_reg]){
-            std::cout <<  "Execute: Holding register " << dest_reg << "." << std::endl;
+    Instruction* executing = pipeline_registers[STAGE_EXECUTE];
+    if (pipeline.out_of_order) {
+        Instruction* loading = pipeline_registers[STAGE_LOAD];
+        if (loading && elements_done(loading)) return 0;
+        if (loading && !load_waits(loading)) {
+            idle = std::min<int>(idle, mem_idle_cycles(dcache.get(), memory_address(loading), false));
+        }
+        // Commit picks up once the head's result is in, unless the Store stage holds it
+        if (rob_count) {
+            const RobEntry& head = rob[rob_head];
+            if (!commit_blocked(head)) return 0;
+            if (head.issued && head.done_at != INT_MAX && head.done_at >= active_cycles) {
+                idle = std::min(idle, head.done_at + 1 - active_cycles);
+            }
+        }
+        // Same order of checks as issue_out_of_order
+        bool branch_waiting = false;
+        for (int i = 0; i < rob_count; i++) {
+            const RobEntry& entry = rob_at(i);
+            if (entry.issued) continue;
+            bool control = is_control(entry.instr->decoded);
+            if (!(control && branch_waiting)) {
+                int ready = std::max({operands_ready(entry), unit_ready(station_of(entry.unit)), vector_ready(entry.instr->decoded)});
+                if (ready <= active_cycles) return 0;
+                if (ready != INT_MAX) idle = std::min(idle, ready - active_cycles);
+            }
+            branch_waiting |= control;
+        }
+        for (int i = 0; i < rob_count; i++) {
+            const RobEntry& entry = rob_at(i);
+            if (entry.unit != UNIT_LOAD || !entry.issued || entry.in_memory || entry.done_at != INT_MAX) continue;
+            int store = forwarding_store(i);
+            if (store >= 0) return 0;
+            if (store == -1 && !loading && !branch_pending(i)) return 0;
+        }
+        if (issue_queue.count) {
+            stalled_on = dispatch_blocked(issue_queue.front());
+            if (!stalled_on) return 0;
+        }
+        if (decode_queue.count && issue_queue.count < pipeline.width) return 0;
+    } else if (pipeline.scoreboard) {
+        // The load unit and the Store stage wake the core when they finish, so waits on
+        // them need no cycle of their own
+        Instruction* loading = pipeline_registers[STAGE_LOAD];
+        if (loading && elements_done(loading)) return 0;
+        if (loading && !load_waits(loading)) {
+            idle = std::min<int>(idle, mem_idle_cycles(dcache.get(), memory_address(loading), false));
+        }
+        // Only the oldest waiting instruction matters: nothing issues past it
+        Instruction* waiting = issue_queue.front();
+        if (waiting) {
+            int until = blocked_until(waiting, stalled_on);
+            if (until <= active_cycles) return 0;
+            if (until != INT_MAX) idle = std::min(idle, until - active_cycles);
+        }
+        if (decode_queue.count && issue_queue.count < pipeline.width) return 0;
+        // Results still in flight keep the core running
+        if (drain_until > active_cycles) idle = std::min(idle, drain_until - active_cycles - 1);
+    } else if (executing) {
+        if (execute_starting(executing)) return 0;
+
+        const DecodedOp& decoded = executing->decoded;
+        if (executing->store_delay > 0) {
+            idle = std::min(idle, executing->store_delay);
+        } else if (executing->execute_delay > 1) {
+            idle = std::min(idle, executing->execute_delay - 1);
+        } else if (!execute_delay_complete) {
+            // The delay runs out next cycle; skip_cycles would leave it at 0 without
+            // marking it complete, and Execute would start the instruction over
+            return 0;
+        } else if (overwrites_store_source(executing)) {
+            // Only the Store stage's access counts down until it is done
+        } else if (functional_unit(decoded.op) == UNIT_LOAD) {
+            if (decoded.op == OP_VLE32_V ? elements_done(executing) : !OperationTable[decoded.op].fpRd && hold_registers[decoded.rd]) return 0;
+            // The load only waits for the Store stage to free the dcache port or finish a vector store
+            if (!store_port_busy(executing)) {
+                idle = std::min<int>(idle, mem_idle_cycles(dcache.get(), memory_address(executing), false));
+            }
+        } else if (functional_unit(decoded.op) == UNIT_STORE) {
+            // Waits for the Store stage, which is only freed by its own (non-idle) cycle
+            if (!storing) return 0;
+        } else {
+            return 0;
+        }
+    } else if (pipeline_registers[STAGE_DECODE]) {
+        return 0;
+    }
+
+    // Fetch only runs while Decode is free
+    if (!decode_full()) {
+        if (uint32_t(pc) < start_address) return 0;
+        if (uint32_t(pc) <= max_instruction_address) {
+            idle = std::min<int>(idle, mem_idle_cycles(icache.get(), pc, false));
+        } else if (fetching_active || pipeline_registers[STAGE_FETCH] || !halt) {
+            return 0;
+        }
+    }
+
+    // Nothing counting down at all: leave it to the cycle-by-cycle path
+    return idle == INT_MAX ? 0 : idle;
+}
+
+// True if Fetch has nowhere to put another word
+bool Core::decode_full() const {
+    return pipeline.scoreboard ? decode_queue.count >= pipeline.width : pipeline_registers[STAGE_DECODE] != nullptr;
+}
+
+// Same end state as `cycles` ticks, given cycles <= idle_cycles()
+void Core::skip_cycles(int cycles) {
+    if (cycles <= 0) return;
+
+    Instruction* storing = pipeline_registers[STAGE_STORE];
+    if (storing) {
+        mem_advance(dcache.get(), memory_address(storing), cycles, true);
+    }
+
+    Instruction* executing = pipeline_registers[STAGE_EXECUTE];
+    if (pipeline.out_of_order) {
+        Instruction* loading = pipeline_registers[STAGE_LOAD];
+        if (loading && !load_waits(loading)) {
+            mem_advance(dcache.get(), memory_address(loading), cycles, false);
+        }
+        if (stalled_on) *stalled_on += cycles;
+        ooo_stats.occupancy += uint64_t(rob_count) * cycles;
+    } else if (pipeline.scoreboard) {
+        Instruction* loading = pipeline_registers[STAGE_LOAD];
+        if (loading && !load_waits(loading)) {
+            mem_advance(dcache.get(), memory_address(loading), cycles, false);
+        }
+        if (stalled_on) *stalled_on += cycles;
+    } else if (executing) {
+        if (executing->store_delay > 0) {
+            executing->store_delay -= cycles;
+        } else {
+            // A load whose delay has run out polls memory every cycle
+            bool polling = executing->execute_delay <= 1 && !store_port_busy(executing) &&
+                           functional_unit(executing->decoded.op) == UNIT_LOAD && !overwrites_store_source(executing);
+            executing->execute_delay -= cycles;
+            if (polling) {
+                mem_advance(dcache.get(), memory_address(executing), cycles, false);
+            }
+        }
+    }
+
+    if (!decode_full() && uint32_t(pc) <= max_instruction_address) {
+        mem_advance(icache.get(), pc, cycles, false);
+    }
+
+    active_cycles += cycles;
+}
+
+// Append every range of guest memory the next tick may poll on the Membus: the program image
+// for Fetch (a jump never fetches outside it) and the bytes of the store and load in flight.
+// Accesses through an L1 add nothing when they are local hits; false means one may reach the
+// Membus from a cache, whose misses and upgrades snoop the other cores' caches.
+bool Core::tick_footprint(std::vector<AccessRange>& ranges) const {
+    if (icache) {
+        uint32_t line_size = icache->getConfig().lineSize;
+        for (uint64_t line = start_address & ~(line_size - 1); line <= max_instruction_address; line += line_size) {
+            if (!icache->hitsLocally(uint32_t(line), 4, false)) return false;
+        }
+    } else {
+        ranges.push_back({start_address, uint64_t(max_instruction_address) + 4, false, core_id});
+    }
+    // skip_cycles may advance whatever the data cache has in flight
+    if (dcache && !dcache->offBus()) return false;
+
+    auto access = [&](const Instruction* instr, bool write) {
+        uint32_t address = memory_address(instr);
+        uint32_t bytes = access_size(instr->decoded.op);
+        if (dcache) return dcache->hitsLocally(address, bytes, write);
+        ranges.push_back({address, uint64_t(address) + bytes, write, core_id});
+        return true;
+    };
+
+    const Instruction* storing = pipeline_registers[STAGE_STORE];
+    if (storing && functional_unit(storing->decoded.op) == UNIT_STORE && !access(storing, true)) return false;
+
+    // Registers only change in Execute, so the load address is the one it will poll. In the
+    // scoreboard pipeline the load unit's base register cannot change under it either.
+    for (Stage stage : {STAGE_EXECUTE, STAGE_LOAD}) {
+        const Instruction* loading = pipeline_registers[stage];
+        if (loading && functional_unit(loading->decoded.op) == UNIT_LOAD && !access(loading, false)) return false;
+    }
+    return true;
+}
+
+// Size the decode cache to cover the loaded program image
+void Core::init_decode_cache() {
+    decode_cache.assign((max_instruction_address - start_address) / 4 + 1, DecodeCacheEntry());
+}
+
+// Drop cached decodes of any instruction word overlapping [address, address + size)
+void Core::invalidate_decoded(uint32_t address, uint32_t size) {
+    if (address + size <= start_address || address > max_instruction_address) return;
+
+    uint32_t first = address > start_address ? (address - start_address) / 4 : 0;
+    uint32_t last = (address + size - 1 - start_address) / 4;
+    for (uint32_t i = first; i <= last && i < decode_cache.size(); i++) {
+        decode_cache[i].valid = false;
+    }
+}
+
+// Decode through the per-PC cache so hot loops skip the decoder entirely
+DecodedOp Core::decode_cached(uint32_t address, uint32_t binary) {
+    uint32_t index = (address - start_address) / 4;
+    if (address < start_address || index >= decode_cache.size()) {
+        return decoder.decodeInstruction(binary);
+    }
+
+    DecodeCacheEntry& entry = decode_cache[index];
+    // The binary check covers a store landing between this word's fetch and its decode
+    if (!entry.valid || entry.binary != binary) {
+        entry.binary = binary;
+        entry.decoded = decoder.decodeInstruction(binary);
+        entry.valid = true;
+    }
+    return entry.decoded;
+}
+
+// Keep the most recent pipeline events for print_event_list
+void Core::record_event(const Instruction* instr, Stage stage) {
+    Event event = {instr->binary, stage, active_cycles};
+    if (event_list.size() < EVENT_HISTORY) {
+        event_list.push_back(event);
+    } else {
+        event_list[event_count % EVENT_HISTORY] = event;
+    }
+    event_count++;
+}
+
+// The instruction in `stage` has finished: hand its slot back to the pool. Out of order, the
+// ROB holds on to instructions that have executed until they commit.
+void Core::retire(Stage stage) {
+    if (!(pipeline.out_of_order && stage == STAGE_EXECUTE)) instruction_pool.release(pipeline_registers[stage]);
+    pipeline_registers[stage] = nullptr;
+}
+
+uint32_t Core::read_f_bits(int index) const {
+    uint32_t bits;
+    std::memcpy(&bits, &f_registers[index], sizeof(bits));
+    return bits;
+}
+
+void Core::write_f_bits(int index, uint32_t bits) {
+    std::memcpy(&f_registers[index], &bits, sizeof(bits));
+}
+
+void Core::execute_instruction(Instruction* instr, const DecodedOp& decoded) {
+    const OperationInfo& info = OperationTable[decoded.op];
+    const char* name = info.name;
+    int rd = decoded.rd;
+    int rs1 = decoded.rs1;
+    int rs2 = decoded.rs2;
+    int immediate = decoded.immediate;
+
+    // Out of order, the instruction may be on a wrong path: commit checks instead
+    if (!pipeline.out_of_order) {
+        std::string illegal = illegal_rounding(instr, fcsr);
+        if (!illegal.empty()) {
+            trap(instr, illegal);
+            retire(STAGE_EXECUTE);
+            execute_delay_complete = 0;
+            return;
+        }
+    }
+
+    if (decoded.op == OP_ADDI) {
+        // Add Immediate
+        write_x(rd, x_registers[rs1] + immediate);
+        LOG(log, LOG_STAGE, "Execute: " << "ADDI: Added " << immediate << " to " << getRegisterName(rs1, false) << ", result in " << getRegisterName(rd, false) << ": " << x_registers[rd] << ".");
+    } else if (decoded.op == OP_ADD) {
+        // Add Registers
+        uint32_t val0 = x_registers[rs1];
+        uint32_t val1 = x_registers[rs2];
+
+        write_x(rd, val0 + val1);
+        LOG(log, LOG_STAGE, "Execute: " << "ADD: " << getRegisterName(rs1, false) << ": " << val0 << " + " 
+        << getRegisterName(rs2, false) << ": " << val1 << " = " << getRegisterName(rd, false) << ": " << x_registers[rd]);
+    } else if (decoded.op == OP_VLE32_V) {
+        if (store_port_busy(instr)) {
+            LOG(log, LOG_STAGE, "Execute: " << name << ": Waiting for the data cache.");
+            return;
+        }
+        if (!load_vector_element(instr, "Execute")) return;
+        vector_done_at = active_cycles;
+    } else if (functional_unit(decoded.op) == UNIT_LOAD) {
+        // Load a word, halfword or byte
+        int base_addr = x_registers[rs1];
+        uint32_t effective_addr = base_addr + immediate;
+
+        // With a dcache this load shares its one port with the Store stage; polling it now
+        // would step (and finish) the Store stage's access instead
+        if (store_port_busy(instr) || (dcache && !info.fpRd && hold_registers[rd])) {
+            LOG(log, LOG_STAGE, "Execute: " << name << ": Waiting for " << (dcache ? "the data cache." : "the vector store."));
             return;
         }
 
-        else if (returnValues[0] != UINT32_MAX && returnValues[0] != UINT32_MAX-1){
-            registers[dest_reg] = returnValues[0];
-            std::cout << "Execute: " << name << ": Loaded " << registers[dest_reg] << " into " << dest_reg << " from memory address " << (base_addr + offset) << "." << std::endl;
+        MemResult result = mem_read(dcache.get(), effective_addr, access_size(decoded.op)); // ram->read(effective_addr, false);
+
+        if (!info.fpRd && hold_registers[rd]){
+            LOG(log, LOG_STAGE, "Execute: Holding register " << getRegisterName(rd, false) << ".");
+            return;
+        }
+
+        else if (result.status == MEM_DONE){
+            uint32_t value = load_result(decoded.op, result.data);
+            if (info.fpRd)
+                write_f_bits(rd, value);
+            else
+                write_x(rd, value);
+            LOG(log, LOG_STAGE, "Execute: " << name << ": Loaded " << value << " into " << getRegisterName(rd, info.fpRd) << " from memory address " << (base_addr + immediate) << ".");
         }
-        else if (returnValues[0] == UINT32_MAX-1){
-            registers[dest_reg] = returnValues[0];
-            std::cout << "Execute: " << name << ": Waiting for other core to finish." << std::endl;
+        else if (result.status == MEM_BLOCKED){
+            LOG(log, LOG_STAGE, "Execute: " << name << ": Waiting for other core to finish.");
             return;
         }
-        else if (returnValues[1]) {
-            std::cout << "Execute: Store operation pending on address " << effective_addr << std::endl;
-            instr->store_delay = returnValues[1];
+        else if (result.storeDelay) {
+            LOG(log, LOG_STAGE, "Execute: Store operation pending on address " << effective_addr);
+            instr->store_delay = result.storeDelay;
             return;
         }
-        else if (returnValues[2]){
-            std::cout << "Execute: Waiting to load from " << effective_addr
-                  << ". Delay remaining: " << returnValues[2] << std::endl;
+        else {
+            LOG(log, LOG_STAGE, "Execute: Waiting to load from " << effective_addr
+                  << ". Delay remaining: " << result.loadDelay);
             return;
         }
 
 
-    } else if (name == "blt"){
-        std::string less_reg = operands[1];
-        std::string base_reg = operands[2];
-        int immediate = std::stoi(operands[3]);
-        if (registers[less_reg] < registers[base_reg]){
-            pc = pc + immediate;
-            std::cout << "Execute: " << "BLT: Jumped to " << immediate << registers[less_reg] << " < " << registers[base_reg] << std::endl;
+    } else if (decoded.op == OP_BLT){
+        int less_val = x_registers[rs1];
+        int base_val = x_registers[rs2];
+        if (isa == ISA_STANDARD) resolve_branch(instr, less_val < base_val, instr->address + immediate);
+        if (less_val < base_val){
+            if (isa != ISA_STANDARD) pc = pc + immediate;
+            LOG(log, LOG_STAGE, "Execute: " << "BLT: Jumped to " << immediate << less_val << " < " << base_val);
         } else{
-            std::cout << "Execute: " << "BLT: Didnt jump to " << immediate << " not " << registers[less_reg] << " < " << registers[base_reg] << std::endl;
+            LOG(log, LOG_STAGE, "Execute: " << "BLT: Didnt jump to " << immediate << " not " << less_val << " < " << base_val);
         }
 
-    } else if (name == "slli") {
+    } else if (decoded.op == OP_SLLI) {
         // Shift Left Logical Immediate
-        std::string dest_reg = operands[1];
-        std::string src_reg = operands[2];
-        int shift_amount = std::stoi(operands[3]);
-
-        registers[dest_reg] = registers[src_reg] << shift_amount;
-        std::cout << "Execute: SLLI: Shifted " << src_reg << " left by " << shift_amount << ", result in " << dest_reg << ": " << registers[dest_reg] << "." << std::endl;
-    } else if (name == "fadd.s") {
-    // Floating point addition
-    std::string dest_reg = operands[1]; // Destination register
-    std::string op0_reg = operands[2]; // First source register
-    std::string op1_reg = operands[3]; // Second source register
-
-    uint32_t val0 = registers[op0_reg];
-    uint32_t val1 = registers[op1_reg];
-
-    // Convert uint32_t to float
-    float fval0, fval1;
-    std::memcpy(&fval0, &val0, sizeof(fval0));
-    std::memcpy(&fval1, &val1, sizeof(fval1));
-
-    // Perform floating-point addition
-    float fresult = fval0 + fval1;
-
-    // Convert float result back to uint32_t
-    uint32_t result;
-    std::memcpy(&result, &fresult, sizeof(result));
-
-    registers[dest_reg] = result;
-
-    // Debug output
-    std::cout << "Execute: FADD.s: " << op0_reg << ": " << fval0 << " + " 
-              << op1_reg << ": " << fval1 << " = " << dest_reg << ": " << fresult << std::endl;
-    } else if (name == "fsub.s") {
-        // Floating point subtraction
-        std::string dest_reg = operands[1]; // Destination register
-        std::string op0_reg = operands[2]; // First source register
-        std::string op1_reg = operands[3]; // Second source register
-
-        uint32_t val0 = registers[op0_reg];
-        uint32_t val1 = registers[op1_reg];
-
-        // Convert uint32_t to float
-        float fval0, fval1;
-        std::memcpy(&fval0, &val0, sizeof(fval0));
-        std::memcpy(&fval1, &val1, sizeof(fval1));
-
-        // Perform floating-point subtraction
-        float fresult = fval0 - fval1;
-
-        // Convert float result back to uint32_t
-        uint32_t result;
-        std::memcpy(&result, &fresult, sizeof(result));
-
-        registers[dest_reg] = result;
-
-        // Debug output
-        std::cout << "Execute: FSUB.s: " << op0_reg << ": " << fval0 << " - " 
-                << op1_reg << ": " << fval1 << " = " << dest_reg << ": " << fresult << std::endl;
-    } else if (name == "jal") {
-        int offset = std::stoi(operands[2]);
-        registers["ra"] = pc + 4; // Save return address
-        pc = pc + offset;
-
-        if (abs(offset) > 0)
-            flush_pipeline(); // Clear the pipeline
-        
-        std::cout << "Execute: JAL: Jumped " << offset << " to instruction " << pc << "." << std::endl;
+        write_x(rd, x_registers[rs1] << immediate);
+        LOG(log, LOG_STAGE, "Execute: SLLI: Shifted " << getRegisterName(rs1, false) << " left by " << immediate << ", result in " << getRegisterName(rd, false) << ": " << x_registers[rd] << ".");
+    } else if (is_fp(decoded.op)) {
+        execute_fp(decoded);
+    } else if (decoded.op == OP_JAL) {
+        int offset = immediate;
+        if (isa == ISA_STANDARD) {
+            write_x(rd, instr->address + 4); // Save return address
+            resolve_branch(instr, true, instr->address + offset);
+        } else {
+            write_x(rd, pc + 4); // Save return address
+            pc = pc + offset;
+
+            if (abs(offset) > 0)
+                flush_pipeline(); // Clear the pipeline
+        }
+
+        LOG(log, LOG_STAGE, "Execute: JAL: Jumped " << offset << " to instruction " << pc << ".");
     }
 
-    else if (name == "auipc") {
-        // Add Upper Immediate to PC
-        std::string reg = operands[1];
-        int immediate = std::stoi(operands[2], nullptr, 16); // Convert hex string to integer
-        registers[reg] = pc + (immediate << 12); // Shift left by 12 bits
-        std::cout << "Execute: AUIPC: Loaded " << registers[reg] << " into " << reg << " with immediate " << immediate << "." << std::endl;
-    } else if (name == "jalr") {
+    else if (decoded.op == OP_AUIPC) {
+        // Add Upper Immediate to PC (the immediate is already shifted into the upper 20 bits)
+        write_x(rd, (isa == ISA_STANDARD ? instr->address : pc) + immediate);
+        LOG(log, LOG_STAGE, "Execute: AUIPC: Loaded " << x_registers[rd] << " into " << getRegisterName(rd, false) << " with immediate " << immediate << ".");
+    } else if (decoded.op == OP_JALR) {
         // Jump and Link Register
-        std::string dest_reg = operands[1];
-        int offset = std::stoi(operands[2]);
+        int offset = immediate;
 
-        pc += offset; // Jump to the address
-        registers[dest_reg] = pc; // Save return address
-        std::cout << "Execute: JALR: Jumped to address " << pc << ", return address in " << dest_reg << ": " << registers[dest_reg] << "." << std::endl;
-    } else if (name == "beq") {
+        if (isa == ISA_STANDARD) {
+            uint32_t target = (x_registers[rs1] + offset) & ~1u;
+            write_x(rd, instr->address + 4); // Save return address
+            resolve_branch(instr, true, target);
+        } else {
+            pc += offset; // Jump to the address
+            write_x(rd, pc); // Save return address
+        }
+        LOG(log, LOG_STAGE, "Execute: JALR: Jumped to address " << pc << ", return address in " << getRegisterName(rd, false) << ": " << x_registers[rd] << ".");
+    } else if (decoded.op == OP_BEQ) {
         // Branch if Equal
-        std::string reg1 = operands[1];
-        std::string reg2 = operands[2];
-        int offset = std::stoi(operands[3]);
-
-        if (registers[reg1] == registers[reg2]) {
-            pc += offset; // Branch taken
-            std::cout << "Execute: BEQ: Branch taken to " << pc << "." << std::endl;
+        if (isa == ISA_STANDARD) resolve_branch(instr, x_registers[rs1] == x_registers[rs2], instr->address + immediate);
+        if (x_registers[rs1] == x_registers[rs2]) {
+            if (isa != ISA_STANDARD) pc += immediate; // Branch taken
+            LOG(log, LOG_STAGE, "Execute: BEQ: Branch taken to " << pc << ".");
         } else {
-            std::cout << "Execute: BEQ: No branch taken." << std::endl;
+            LOG(log, LOG_STAGE, "Execute: BEQ: No branch taken.");
         }
-    } else if (name == "bne") {
+    } else if (decoded.op == OP_BNE) {
         // Branch if Not Equal
-        std::string reg1 = operands[1];
-        std::string reg2 = operands[2];
-        int offset = std::stoi(operands[3]);
-
-        if (registers[reg1] != registers[reg2]) {
-            pc += offset; // Branch taken
-            std::cout << "Execute: BNE: Branch taken to " << pc << "." << std::endl;
+        if (isa == ISA_STANDARD) resolve_branch(instr, x_registers[rs1] != x_registers[rs2], instr->address + immediate);
+        if (x_registers[rs1] != x_registers[rs2]) {
+            if (isa != ISA_STANDARD) pc += immediate; // Branch taken
+            LOG(log, LOG_STAGE, "Execute: BNE: Branch taken to " << pc << ".");
         } else {
-            std::cout << "Execute: BNE: No branch taken." << std::endl;
+            LOG(log, LOG_STAGE, "Execute: BNE: No branch taken.");
         }
-    } else if (name == "sw" || name == "fsw"){
-        if (!pipeline_registers["Store"]){
-            pipeline_registers["Store"] = instr;
-            pipeline_registers["Execute"] = nullptr;
-            std::cout << "Execute: Instruction " << name << " sent to Store stage." << std::endl;
+    } else if (functional_unit(decoded.op) == UNIT_STORE) {
+        if (!pipeline_registers[STAGE_STORE]){
+            pipeline_registers[STAGE_STORE] = instr;
+            pipeline_registers[STAGE_EXECUTE] = nullptr;
+            LOG(log, LOG_STAGE, "Execute: Instruction " << name << " sent to Store stage.");
             return;
         } else {
-            std::cout << "Execute: Store stage busy, cannot send instruction " << name << std::endl;
+            LOG(log, LOG_STAGE, "Execute: Store stage busy, cannot send instruction " << name);
             return;
         }
+    } else if (decoded.format == FORMAT_B) {
+        // BGE, BLTU and BGEU
+        bool taken = branch_taken(decoded.op, x_registers[rs1], x_registers[rs2]);
+        if (isa == ISA_STANDARD) resolve_branch(instr, taken, instr->address + immediate);
+        else if (taken) pc += immediate;
+        if (taken) {
+            LOG(log, LOG_STAGE, "Execute: " << name << ": Branch taken to " << (isa == ISA_STANDARD ? instr->address + immediate : pc) << ".");
+        } else {
+            LOG(log, LOG_STAGE, "Execute: " << name << ": No branch taken.");
+        }
+    } else if (is_csr(decoded.op)) {
+        // CSR read-modify-write; the immediate forms take rs1's field as the operand
+        bool immediate_form = decoded.op == OP_CSRRWI || decoded.op == OP_CSRRSI || decoded.op == OP_CSRRCI;
+        uint32_t csr = immediate & 0xFFF;
+        uint32_t operand = immediate_form ? rs1 : x_registers[rs1];
+        uint32_t old = read_csr(csr);
+        if (decoded.op == OP_CSRRW || decoded.op == OP_CSRRWI) write_csr(csr, operand);
+        else if (rs1 && (decoded.op == OP_CSRRS || decoded.op == OP_CSRRSI)) write_csr(csr, old | operand);
+        else if (rs1) write_csr(csr, old & ~operand);
+        write_x(rd, old);
+        LOG(log, LOG_STAGE, "Execute: " << name << ": CSR " << csr << " was " << old << ", now " << read_csr(csr) << ".");
+    } else if (decoded.format == FORMAT_V) {
+        execute_vector(decoded);
+    } else if (is_integer(decoded.op)) {
+        // The rest of RV32IM: register-register, register-immediate, lui, multiply and divide
+        uint32_t a = x_registers[rs1];
+        uint32_t b = decoded.format == FORMAT_R ? x_registers[rs2] : immediate;
+        write_x(rd, integer_result(decoded.op, a, b));
+        LOG(log, LOG_STAGE, "Execute: " << name << ": " << static_cast<int32_t>(a) << ", " << static_cast<int32_t>(b)
+            << " gives " << getRegisterName(rd, false) << ": " << x_registers[rd] << ".");
+    } else if (decoded.op == OP_FENCE) {
+        // The memory orderings a fence enforces are not modelled, so it only retires
+        LOG(log, LOG_STAGE, "Execute: fence.");
+    } else if (decoded.op == OP_ECALL || decoded.op == OP_EBREAK) {
+        // There is no environment to call or debugger to break into: the program stops here
+        trap(instr, name);
     } else {
-        std::cout << "Execute: " << "Unsupported instruction: " << name << std::endl;
-        return;
+        trap(instr, "Illegal instruction " + to_hex_string(instr->binary));
     }
-    pipeline_registers["Execute"] = nullptr;
+    retire(STAGE_EXECUTE);
     execute_delay_complete = 0;
 }
 
+// Run an F-extension instruction under its rounding mode (frm when rm is dynamic), accruing the
+// exceptions it raises into fflags. Arithmetic that produces a NaN gives the canonical one.
+void Core::execute_fp(const DecodedOp& decoded) {
+    const OperationInfo& info = OperationTable[decoded.op];
+    uint32_t rm = decoded.rm == RM_DYNAMIC ? (fcsr >> 5) & 7 : decoded.rm;
+    // A reserved frm only gets this far speculatively, and the result never commits
+    int rounding = HostRounding[rm <= RM_RMM ? rm : 0];
+    if (rounding != FE_TONEAREST) std::fesetround(rounding);
+    std::feclearexcept(FE_ALL_EXCEPT);
+
+    // Operands are read after the host environment is set up and the result is volatile, so
+    // the compiler keeps the arithmetic between the environment calls
+    uint32_t a = read_f_bits(decoded.rs1);
+    uint32_t b = read_f_bits(decoded.rs2);
+    float fa = as_float(a);
+    float fb = as_float(b);
+    float fc = f_registers[decoded.rs3];
+    uint32_t x = x_registers[decoded.rs1];
+    volatile uint32_t result = 0;
+    uint32_t flags = 0;
+    bool host = true;       // Host arithmetic raises the flags; false where they are worked out here
+    switch (decoded.op) {
+        case OP_FADD_S: result = as_bits(fa + fb); break;
+        case OP_FSUB_S: result = as_bits(fa - fb); break;
+        case OP_FMUL_S: result = as_bits(fa * fb); break;
+        case OP_FDIV_S: result = as_bits(fa / fb); break;
+        case OP_FSQRT_S: result = as_bits(std::sqrt(fa)); break;
+        case OP_FMADD_S: result = as_bits(std::fma(fa, fb, fc)); break;
+        case OP_FMSUB_S: result = as_bits(std::fma(fa, fb, -fc)); break;
+        case OP_FNMSUB_S: result = as_bits(std::fma(-fa, fb, fc)); break;
+        case OP_FNMADD_S: result = as_bits(std::fma(-fa, fb, -fc)); break;
+        case OP_FCVT_S_W: result = as_bits(static_cast<float>(static_cast<int32_t>(x))); break;
+        case OP_FCVT_S_WU: result = as_bits(static_cast<float>(x)); break;
+        default:
+            host = false;
+            break;
+    }
+    switch (decoded.op) {
+        case OP_FSGNJ_S: result = (a & 0x7FFFFFFF) | (b & 0x80000000); break;
+        case OP_FSGNJN_S: result = (a & 0x7FFFFFFF) | (~b & 0x80000000); break;
+        case OP_FSGNJX_S: result = a ^ (b & 0x80000000); break;
+        case OP_FMIN_S: case OP_FMAX_S: result = fp_min_max(a, b, decoded.op == OP_FMAX_S, flags); break;
+        case OP_FEQ_S: case OP_FLT_S: case OP_FLE_S: result = fp_compare(decoded.op, a, b, flags); break;
+        case OP_FCVT_W_S: case OP_FCVT_WU_S: result = fp_to_int(a, decoded.op == OP_FCVT_W_S, rm, flags); break;
+        case OP_FMV_X_W: result = a; break;
+        case OP_FMV_W_X: result = x; break;
+        case OP_FCLASS_S: result = fp_class(a); break;
+        default: break;
+    }
+    if (host) {
+        flags = host_fflags();
+        if (is_nan(result)) result = CANONICAL_NAN;
+    }
+    if (rounding != FE_TONEAREST) std::fesetround(FE_TONEAREST);
+    fcsr |= flags;
+
+    if (isa == ISA_LEGACY && (decoded.op == OP_FADD_S || decoded.op == OP_FSUB_S)) {
+        // Legacy programs keep the trace lines they have always produced
+        write_f_bits(decoded.rd, result);
+        LOG(log, LOG_STAGE, "Execute: " << (decoded.op == OP_FADD_S ? "FADD.s: " : "FSUB.s: ") << getRegisterName(decoded.rs1, true) << ": " << fa
+            << (decoded.op == OP_FADD_S ? " + " : " - ") << getRegisterName(decoded.rs2, true) << ": " << fb << " = "
+            << getRegisterName(decoded.rd, true) << ": " << f_registers[decoded.rd]);
+    } else if (info.fpRd) {
+        write_f_bits(decoded.rd, result);
+        LOG(log, LOG_STAGE, "Execute: " << info.name << ": Result in " << getRegisterName(decoded.rd, true) << ": " << f_registers[decoded.rd]
+            << (flags ? ", fflags " + std::to_string(flags) : "") << ".");
+    } else {
+        write_x(decoded.rd, result);
+        LOG(log, LOG_STAGE, "Execute: " << info.name << ": Result in " << getRegisterName(decoded.rd, false) << ": " << x_registers[decoded.rd]
+            << (flags ? ", fflags " + std::to_string(flags) : "") << ".");
+    }
+}
+
+// Cycles Execute spends on the instruction: its table latency, plus one for each register
+// after the first in an LMUL group
+int Core::execute_latency(const DecodedOp& decoded) const {
+    int latency = latencies[decoded.op].latency;
+    uint32_t lmul = vtype_lmul(vtype);
+    if (decoded.format == FORMAT_V && decoded.op != OP_VSETVLI && lmul) latency += lmul - 1;
+    return latency;
+}
+
+// True if the legacy Execute stage has yet to set up the instruction's delay. A store sent on
+// to the Store stage leaves execute_delay_complete set, so the instruction after it skips its
+// delay; a vector instruction still has to wait for the vector unit and start its access.
+bool Core::execute_starting(const Instruction* instr) const {
+    if (instr->execute_delay != 0 || instr->store_delay != 0) return false;
+    return !execute_delay_complete || (is_vector(instr->decoded.op) && instr->stage != STAGE_EXECUTE);
+}
+
+// vsetvli, or vector FP arithmetic on the first vl elements under frm. An illegal vtype or
+// register group makes the instruction do nothing; there are no vector traps.
+void Core::execute_vector(const DecodedOp& decoded) {
+    const char* name = OperationTable[decoded.op].name;
+    if (decoded.op == OP_VSETVLI) {
+        uint32_t lmul = vtype_lmul(decoded.immediate);
+        uint32_t vlmax = lmul * (vlen / 32);
+        if (!lmul) {
+            vtype = VTYPE_VILL;
+            vl = 0;
+        } else {
+            vtype = decoded.immediate;
+            if (decoded.rs1) vl = std::min<uint32_t>(x_registers[decoded.rs1], vlmax);
+            else if (decoded.rd) vl = vlmax;
+            else vl = std::min(vl, vlmax);
+        }
+        write_x(decoded.rd, vl);
+        LOG(log, LOG_STAGE, "Execute: " << name << ": vl " << vl << (lmul ? "" : ", vtype illegal") << ".");
+        return;
+    }
+
+    uint32_t count = vector_elements(decoded);
+    uint32_t rm = (fcsr >> 5) & 7;
+    int rounding = HostRounding[rm <= RM_RMM ? rm : 0];
+    if (rounding != FE_TONEAREST) std::fesetround(rounding);
+    std::feclearexcept(FE_ALL_EXCEPT);
+    const uint8_t* mask = decoded.masked ? reinterpret_cast<const uint8_t*>(v_registers.data()) : nullptr;
+    vector_fp(decoded.op, vector_register(decoded.rd), vector_register(decoded.rs1), vector_register(decoded.rs2), count, mask);
+    uint32_t flags = host_fflags();
+    if (rounding != FE_TONEAREST) std::fesetround(FE_TONEAREST);
+    fcsr |= flags;
+    LOG(log, LOG_STAGE, "Execute: " << name << ": " << count << " elements into v" << +decoded.rd
+        << (flags ? ", fflags " + std::to_string(flags) : "") << ".");
+}
+
+// Elements the instruction works on: vl, or none if vtype is illegal, a register is not
+// aligned to its group, or a masked result would overwrite the mask
+uint32_t Core::vector_elements(const DecodedOp& decoded) const {
+    uint32_t lmul = vtype_lmul(vtype);
+    if (!lmul || decoded.rd % lmul) return 0;
+    if (decoded.format == FORMAT_V && (decoded.rs1 % lmul || decoded.rs2 % lmul)) return 0;
+    if (decoded.masked && decoded.rd == 0 && decoded.op != OP_VSE32_V) return 0;
+    return vl;
+}
+
+// Element `element` of the group starting at vector register reg
+uint32_t Core::read_v_bits(int reg, uint32_t element) const {
+    uint32_t bits;
+    std::memcpy(&bits, &v_registers[reg * (vlen / 32) + element], sizeof(bits));
+    return bits;
+}
+
+void Core::write_v_bits(int reg, uint32_t element, uint32_t bits) {
+    std::memcpy(&v_registers[reg * (vlen / 32) + element], &bits, sizeof(bits));
+}
+
+// First cycle the instruction may use the vector registers: vector instructions run one at a
+// time, each after the previous one's results and memory accesses are done
+int Core::vector_ready(const DecodedOp& decoded) const {
+    return is_vector(decoded.op) && decoded.op != OP_VSETVLI ? vector_done_at : 0;
+}
+
+// A vector load or store is starting: fix its base address, length and first element, and hold
+// back the next vector instruction until it is done
+void Core::start_vector_access(Instruction* instr) {
+    const DecodedOp& decoded = instr->decoded;
+    if (!is_vector_memory(decoded.op)) return;
+    if (!pipeline.out_of_order) instr->data_address = effective_address(decoded);
+    instr->vector_length = vector_elements(decoded);
+    instr->element = next_element(instr, 0);
+    vector_done_at = INT_MAX;
+}
+
+// First element from `from` on that the access moves, skipping those v0 masks off
+uint32_t Core::next_element(const Instruction* instr, uint32_t from) const {
+    if (!instr->decoded.masked) return from;
+    while (from < instr->vector_length && !((read_v_bits(0, from / 32) >> (from % 32)) & 1)) from++;
+    return from;
+}
+
+// True once a vector load or store has moved all of its elements
+bool Core::elements_done(const Instruction* instr) const {
+    return is_vector_memory(instr->decoded.op) && instr->element >= instr->vector_length;
+}
+
+// Poll memory for the vle32.v's next element; true once every element is in its register
+bool Core::load_vector_element(Instruction* instr, const char* stage) {
+    const DecodedOp& decoded = instr->decoded;
+    const char* name = OperationTable[decoded.op].name;
+    if (!elements_done(instr)) {
+        uint32_t address = memory_address(instr);
+        MemResult result = mem_read(dcache.get(), address);
+        if (result.status == MEM_BLOCKED) {
+            LOG(log, LOG_STAGE, stage << ": " << name << ": Waiting for other core to finish.");
+            return false;
+        }
+        if (result.status != MEM_DONE) {
+            LOG(log, LOG_STAGE, stage << ": Waiting to load from " << address << ". Delay remaining: " << result.loadDelay);
+            return false;
+        }
+        write_v_bits(decoded.rd, instr->element, result.data);
+        LOG(log, LOG_STAGE, stage << ": " << name << ": Loaded element " << instr->element << " of v" << +decoded.rd << " from memory address " << address << ".");
+        instr->element = next_element(instr, instr->element + 1);
+        if (!elements_done(instr)) return false;
+    }
+    LOG(log, LOG_STAGE, stage << ": " << name << ": Loaded v" << +decoded.rd << " (" << instr->vector_length << " elements).");
+    return true;
+}
+
+// fflags, frm and fcsr; other CSRs read as zero and ignore writes
+uint32_t Core::read_csr(uint32_t csr) const {
+    switch (csr) {
+        case CSR_FFLAGS: return fcsr & 0x1F;
+        case CSR_FRM: return (fcsr >> 5) & 7;
+        case CSR_FCSR: return fcsr & 0xFF;
+        default: return 0;
+    }
+}
+
+void Core::write_csr(uint32_t csr, uint32_t value) {
+    switch (csr) {
+        case CSR_FFLAGS: fcsr = (fcsr & ~0x1Fu) | (value & 0x1F); break;
+        case CSR_FRM: fcsr = (fcsr & 0x1F) | ((value & 7) << 5); break;
+        case CSR_FCSR: fcsr = value & 0xFF; break;
+        default: break;
+    }
+}
+
 std::string Core::to_hex_string(uint32_t instruction) {
     std::ostringstream oss;
     oss << "0x" << std::uppercase << std::hex << std::setfill('0') << std::setw(8) << instruction;
     return oss.str();
 }
 
-std::vector<std::string> Core::split_instruction(const std::string& instruction) {
-    std::vector<std::string> operands;
-    std::istringstream iss(instruction);
-    std::string token;
-
-    if (std::getline(iss, token, ' ')) {
-        operands.push_back(token);
+// Drop every instruction younger than the one in Execute; returns how many there were
+int Core::flush_pipeline() {
+    int squashed = pipeline.out_of_order ? squash_younger(pipeline_registers[STAGE_EXECUTE]) : 0;
+    // Fetch aliases Decode or an instruction already past it, so only Decode owns a slot here
+    if (pipeline_registers[STAGE_DECODE]) {
+        retire(STAGE_DECODE);
+        squashed++;
     }
-
-    std::string remaining;
-    if (std::getline(iss, remaining)) {
-        std::istringstream operand_stream(remaining);
-        while (std::getline(operand_stream, token, ',')) {
-            token.erase(0, token.find_first_not_of(" \t"));
-            token.erase(token.find_last_not_of(" \t") + 1);
-            operands.push_back(token);
+    for (StageQueue* queue : {&issue_queue, &decode_queue}) {
+        while (queue->count) {
+            instruction_pool.release(queue->front());
+            queue->pop_front();
+            squashed++;
         }
     }
-
-    return operands;
+    pipeline_registers[STAGE_FETCH] = nullptr;
+    return squashed;
 }
 
-void Core::flush_pipeline() {
-    for (auto& stage : pipeline_stages) {
-        if (stage == "Fetch" || stage == "Decode") pipeline_registers[stage] = nullptr;
+// Check a standard branch or jump against the path Fetch took after it, and send Fetch the
+// right way if that was wrong. Without a predictor Fetch always ran straight on.
+void Core::resolve_branch(Instruction* instr, bool taken, uint32_t target) {
+    uint32_t next = taken ? target : instr->address + 4;
+    if (predictor) predictor->resolve(instr->address, instr->prediction, taken, target);
+    if (next == instr->prediction.next) return;
+
+    pc = next;
+    int squashed = flush_pipeline();
+    if (predictor) {
+        predictor->getStats().squashed += squashed;
+        redirect_cycle = active_cycles;
     }
 }
 
-void Core::print_event_list() {
-    std::cout << "\nEvent List at Cycle " << clock_cycle << ":" << std::endl;
-    for (auto& event : event_list) {
-        std::cout << "Instruction " << event.name << " in " << event.stage << " stage at cycle " << event.cycle << std::endl;
+// Stop the core at instr: everything younger is dropped and Fetch moves past the end of the
+// program, so the core completes once the instructions older than instr have. The simulator
+// reports the cause with the core's summary.
+void Core::trap(const Instruction* instr, const std::string& cause) {
+    trap_cause = cause + " at " + symbols.describe(instr->address);
+    LOG(log, LOG_STAGE, "Trap: " << trap_cause << ", stopping the core.");
+    pc = static_cast<int>(max_instruction_address + 4);
+    flush_pipeline();
+}
+
+// Redirect fetch to target, dropping anything fetched down the old path
+void Core::jump_to(uint32_t target) {
+    pc = target;
+    flush_pipeline();
+}
+
+// Switch how instructions are decoded and how branches are resolved
+void Core::set_isa(IsaDialect dialect) {
+    isa = dialect;
+    decoder.setDialect(dialect);
+    for (auto& entry : decode_cache) {
+        entry.valid = false;
     }
 }
 
-void Core::print_instructions() {
-    std::cout << "\nInstructions:" << std::endl;
-    for (auto& instr : instructions) {
-        std::cout << instr->name << " ";
-        for (auto& op : instr->operands) {
-            std::cout << op << " ";
-        }
-        std::cout << std::endl;
+// Vector register length in bits; the vector registers start out zero and vtype illegal
+void Core::set_vlen(uint32_t bits) {
+    vlen = bits;
+    v_registers.assign(32 * (vlen / 32), 0.0f);
+    vl = 0;
+    vtype = VTYPE_VILL;
+}
+
+void Core::set_pipeline(const PipelineConfig& config) {
+    pipeline = config;
+    rob.assign(config.out_of_order ? config.rob_entries : 0, RobEntry());
+}
+
+void Core::print_event_list() {
+    std::cout << "\nEvent List at Cycle " << active_cycles << ":" << std::endl;
+    size_t first = event_list.size() < EVENT_HISTORY ? 0 : event_count % EVENT_HISTORY;
+    for (size_t i = 0; i < event_list.size(); i++) {
+        const Event& event = event_list[(first + i) % event_list.size()];
+        std::cout << "Instruction " << to_hex_string(event.binary) << " in " << StageNames[event.stage] << " stage at cycle " << event.cycle << std::endl;
     }
 }
 
 void Core::print_pipeline_registers() {
     std::cout << "\nPipeline Registers:" << std::endl;
-    for (auto& reg : pipeline_registers) {
-        std::cout << reg.first << ": " << reg.second << std::endl;
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        std::cout << StageNames[stage] << ": " << pipeline_registers[stage] << std::endl;
     }
 }
 
 void Core::print_registers() {
     std::cout << "\nRegisters:" << std::endl;
-    for (auto& reg : registers) {
-        std::cout << reg.first << ": " << reg.second << std::endl;
+    for (int i = 0; i < 32; i++) {
+        std::cout << getRegisterName(i, false) << ": " << x_registers[i] << std::endl;
+    }
+}
+
+void Core::print_f_registers() {
+    std::cout << "\nFloating Point Registers:" << std::endl;
+    for (int i = 0; i < 32; i++) {
+        std::cout << getRegisterName(i, true) << ": " << f_registers[i] << std::endl;
     }
 }
 
@@ -530,9 +2054,39 @@ bool Core::is_halted() const {
 }
 
 bool Core::is_complete() const {
-    return !pipeline_registers.at("Fetch") &&
-           !pipeline_registers.at("Decode") &&
-           !pipeline_registers.at("Execute") &&
-           !pipeline_registers.at("Store") &&
-           !fetching_active;
+    return !pipeline_registers[STAGE_FETCH] &&
+           !pipeline_registers[STAGE_DECODE] &&
+           !pipeline_registers[STAGE_EXECUTE] &&
+           !pipeline_registers[STAGE_STORE] &&
+           !pipeline_registers[STAGE_LOAD] &&
+           !decode_queue.count &&
+           !issue_queue.count &&
+           !rob_count &&
+           !fetching_active &&
+           active_cycles >= drain_until;
+}
+
+InstructionPool::InstructionPool(size_t capacity) : slots(capacity) {
+    free_slots.reserve(capacity);
+    for (auto it = slots.rbegin(); it != slots.rend(); ++it) {
+        free_slots.push_back(&*it);
+    }
+}
+
+// Take a free slot and reset it for a newly fetched word
+Instruction* InstructionPool::acquire(uint32_t binary, uint32_t address) {
+    if (free_slots.empty()) {
+        throw std::runtime_error("Instruction pool exhausted: an instruction was never retired.");
+    }
+    Instruction* instr = free_slots.back();
+    free_slots.pop_back();
+
+    *instr = Instruction();
+    instr->binary = binary;
+    instr->address = address;
+    return instr;
+}
+
+void InstructionPool::release(Instruction* instr) {
+    free_slots.push_back(instr);
 }
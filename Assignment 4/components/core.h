@@ -16,40 +16,196 @@
 #include <sstream>
 #include <iomanip>
 #include <stdexcept>
+#include <algorithm>
 #include "decoder.h"
 #include "membus.h"
 #include "ram.h"
+#include "logger.h"
+#include "cache.h"
+#include "bpred.h"
+#include "latency.h"
+#include "vector.h"
+#include "elf.h"
+#include <memory>
 
-const int STALL_INT = 10;       // Stall for integer instructions = 1 CPU cycle = 10 sim ticks
-const int STALL_FLOAT = 50;     // Stall for floating point instructions = 5 CPU cycles = 50 sim ticks
+// Pipeline stages, used to index Core::pipeline_registers
+enum Stage : uint8_t {
+    STAGE_FETCH,
+    STAGE_DECODE,
+    STAGE_EXECUTE,
+    STAGE_STORE,
+    STAGE_LOAD,         // Load unit of the scoreboard pipeline
+    STAGE_COUNT
+};
+
+const char* const StageNames[STAGE_COUNT] = {"Fetch", "Decode", "Execute", "Store", "Load"};
+
+const int MAX_ISSUE_WIDTH = 4;
+const int MAX_ROB_ENTRIES = 256;
+const int MAX_UNITS = 8;        // Integer or FP units in one core
+
+// How Execute handles dependences. The default keeps every instruction in Execute until its
+// delay has run out. The scoreboard issues in order, up to width instructions per cycle, as
+// soon as their operands are ready and lets them finish in the background; loads wait for
+// memory in a load unit. Fetch, Decode and register write back also handle width per cycle.
+// The out-of-order back end keeps the scoreboard's front end (so it sets both flags) but
+// renames into a reorder buffer and issues from reservation stations oldest ready first.
+struct PipelineConfig {
+    bool scoreboard = false;
+    bool out_of_order = false;
+    bool forward_execute = true;    // EX->EX: a result can be used in the cycle it completes
+    bool forward_memory = true;     // MEM->EX: loaded data can be used in the cycle it arrives
+    int width = 1;                  // 1 to MAX_ISSUE_WIDTH
+    int int_units = 1;              // Integer units, 1 to MAX_UNITS
+    int fp_units = 1;               // FP units, 1 to MAX_UNITS
+    int rob_entries = 32;           // Out of order: 1 to MAX_ROB_ENTRIES
+    int station_entries = 8;        // Out of order: entries in each of the integer, FP and load/store stations
+    int lsq_entries = 16;           // Out of order: loads and stores between dispatch and commit
+};
+
+// Parse "legacy", "scoreboard[,forward=all|none|ex|mem][,width=N][,int=N][,fp=N]" or
+// "ooo[,forward=...][,width=N][,int=N][,fp=N][,rob=N][,rs=N][,lsq=N]".
+// The unit counts default to the width.
+PipelineConfig parse_pipeline_config(const std::string& spec);
+
+enum FunctionalUnit : uint8_t {
+    UNIT_INT,
+    UNIT_FP,
+    UNIT_LOAD,
+    UNIT_STORE,
+    UNIT_COUNT
+};
+
+FunctionalUnit functional_unit(Operation op);
+
+// Bytes a load or store moves: 1, 2 or 4
+uint32_t access_size(Operation op);
+
+// Register value of a load from the zero-extended bytes memory returned; lb and lh sign-extend
+uint32_t load_result(Operation op, uint32_t data);
+
+// Issue attempts the scoreboard turned down, by cause
+struct HazardStats {
+    uint64_t raw = 0;           // A source is still being computed or loaded
+    uint64_t waw = 0;           // The destination still has a write in flight
+    uint64_t war = 0;           // A pending store or load still reads the destination
+    uint64_t structural = 0;    // Its units, the load unit or Store stage are busy, or Fetch is behind a legacy branch
+};
+
+// Cycles the out-of-order back end could not dispatch, by what was full, and how it ran
+struct OutOfOrderStats {
+    uint64_t rob_full = 0;
+    uint64_t stations_full = 0;     // The reservation station for the instruction's unit
+    uint64_t lsq_full = 0;
+    uint64_t serialized = 0;        // A CSR access, vector instruction, ecall, ebreak or illegal instruction waiting to be alone in the ROB, or one holding it
+    uint64_t forwarded = 0;         // Loads that took their data from an older store
+    uint64_t occupancy = 0;         // ROB entries in use, summed over cycles
+};
 
 struct Event {
-    std::string name;
-    std::string stage;
-    int cycle;
+    uint32_t binary;
+    Stage stage;
+    int cycle;          // The core's active_cycles when the instruction entered the stage
 };
 
+const size_t EVENT_HISTORY = 64;    // Most recent pipeline events kept per core
+
+// One in-flight instruction. Slots are recycled by InstructionPool, so it holds no heap data.
 struct Instruction {
-    std::string name;
+    uint32_t binary = 0;
+    uint32_t address = 0;
+    DecodedOp decoded = {};
+    Stage stage = STAGE_FETCH;
+    int execute_delay = 0;
+    int store_delay = 0;
+    int cycle_entered[STAGE_COUNT] = {};
+    Prediction prediction = {};     // Where Fetch went after it
+    uint32_t data_address = 0;      // Load or store address, once the out-of-order engine has it (or a vector one starts)
+    uint32_t vector_length = 0;     // Elements a vector load or store moves, fixed when it starts
+    uint32_t element = 0;           // Next element it accesses, vector_length once it has done them all
+};
+
+// Fixed set of instruction slots sized to the most instructions a core can have in flight.
+// Fetch takes a slot; retiring (execute or store done) or a flush gives it back.
+class InstructionPool {
+public:
+    explicit InstructionPool(size_t capacity);
+
+    Instruction* acquire(uint32_t binary, uint32_t address);
+    void release(Instruction* instr);
+    size_t in_use() const { return slots.size() - free_slots.size(); }
+
+private:
+    std::vector<Instruction> slots;
+    std::vector<Instruction*> free_slots;
+};
+
+// Instructions waiting in one stage of the scoreboard pipeline, oldest first
+struct StageQueue {
+    Instruction* slots[MAX_ISSUE_WIDTH] = {};
+    int count = 0;
+
+    Instruction* front() const { return count ? slots[0] : nullptr; }
+    void push(Instruction* instr) { slots[count++] = instr; }
+    void push_front(Instruction* instr) {
+        std::copy_backward(slots, slots + count, slots + count + 1);
+        slots[0] = instr;
+        count++;
+    }
+    void pop_front() {
+        std::copy(slots + 1, slots + count, slots);
+        slots[--count] = nullptr;
+    }
+};
+
+// Register write ports taken in one cycle
+struct WritebackSlot {
+    int cycle;
+    int count;
+};
+
+const int WRITEBACK_WINDOW = 256;   // Cycles ahead a result can be scheduled to write back
+
+// One renamed instruction between dispatch and commit. Registers are numbered as in the
+// scoreboard (x 0-31, f 32-63); a source's tag is the entry producing it, or -1 when the
+// register file already held it at dispatch.
+struct RobEntry {
+    Instruction* instr = nullptr;
+    uint64_t seq = 0;               // Program order; 0 once the entry has committed or been squashed
+    FunctionalUnit unit = UNIT_INT;
+    int dest = -1;                  // Architectural register written, or -1
+    int previous = -1;              // Entry dest was renamed to before this one
+    uint64_t previous_seq = 0;
+    int source_count = 0;
+    int sources[3] = {};
+    int tags[3] = {};
+    uint64_t tag_seqs[3] = {};
+    bool issued = false;            // Has left its reservation station
+    bool in_memory = false;         // Load handed to the load unit
+    bool from_memory = false;       // Result loaded rather than computed or forwarded
+    int done_at = INT_MAX;          // Cycle the result is complete, INT_MAX until known
+    uint32_t value = 0;             // Result bits; the data of a store
+    uint8_t fflags = 0;             // FP exceptions raised, accrued into fcsr at commit
+};
+
+// Decoded copy of one instruction word in the program image
+struct DecodeCacheEntry {
     uint32_t binary;
-    std::vector<std::string> operands;
-    std::string type;
-    std::string stage;
-    int execute_delay;
-    int store_delay;
-    double data;
-    std::map<std::string, int> cycle_entered;
-    Instruction(std::string n, uint32_t b, std::vector<std::string> ops, std::string t)
-        : name(n), binary(b), operands(ops), type(t), stage("Fetch"), execute_delay(0), store_delay(0), data(0.0) {}
+    DecodedOp decoded;
+    bool valid = false;
 };
 
-const std::vector<std::string> pipeline_stages = {"Fetch", "Decode", "Execute", "Store"};
+// Guest bytes [start, end) a core may access in its next tick
+struct AccessRange {
+    uint64_t start;
+    uint64_t end;
+    bool write;
+    int core_id;
+};
 
 class Core {
 private:
-    int clock_cycle;
     int store_counter;
-    int excecute_counter;
     int decode_counter;
     int fetch_delay = 0;
     int decode_delay = 0;
@@ -57,21 +213,128 @@ private:
     int store_delay = 0;
     int fetching_active = 1;
     int complete = 0;
-    bool store_complete = false;
     bool execute_delay_complete = false;
     bool store_delay_complete = false;
-    int sim_ticks;
     
-    std::vector<Event> event_list;
-    std::map<std::string, Instruction*> pipeline_registers;
-    std::vector<Instruction*> instructions;
-    std::map<std::string, int> registers;
-    std::map<std::string, bool> hold_registers;
+    std::vector<Event> event_list;              // Ring of the last EVENT_HISTORY events
+    size_t event_count = 0;
+    // Fetch only marks that the fetch stage has produced an instruction; the slot
+    // itself belongs to whichever later register holds it
+    Instruction* pipeline_registers[STAGE_COUNT] = {};
+    InstructionPool instruction_pool;
+    int32_t x_registers[32] = {};       // Integer register file, x0 is hard-wired to zero
+    float f_registers[32] = {};         // Single-precision FP register file
+    uint32_t fcsr = 0;                  // frm in bits 7-5, accrued exception flags (fflags) in bits 4-0
+    uint32_t vlen = DEFAULT_VLEN;       // Bits in a vector register
+    std::vector<float> v_registers;     // 32 vector registers of vlen / 32 elements, one after another
+    uint32_t vl = 0;
+    uint32_t vtype = VTYPE_VILL;
+    int vector_done_at = 0;             // Cycle the last vector instruction finishes, INT_MAX while one is in memory
+    bool hold_registers[32] = {};       // Integer registers used as a base by a pending store
     bool halt;
+    std::string trap_cause;             // Why the core stopped before the end of its program, empty if it did not
     int stall_count;
     Decoder decoder;
+    IsaDialect isa = ISA_LEGACY;
+    std::vector<DecodeCacheEntry> decode_cache;   // Indexed by (pc - start_address) / 4
     RAM* ram; 
     Membus* membus;
+    std::unique_ptr<Cache> icache;      // Optional L1s; accesses go straight to the Membus without them
+    std::unique_ptr<Cache> dcache;
+    std::unique_ptr<BranchPredictor> predictor;    // Optional; Fetch runs straight on without it
+    int redirect_cycle = -1;            // Cycle of the last misprediction, until the right path is fetched
+    PipelineConfig pipeline;
+    LatencyTable latencies;
+    HazardStats hazards;
+    // Scoreboard: cycle each register's pending result completes (INT_MAX while a load is
+    // outstanding) and whether it comes from memory. x registers are 0-31, f registers 32-63.
+    int complete_at[64] = {};
+    bool from_memory[64] = {};
+    int drain_until = 0;                // Cycle the last result still in flight completes
+    uint64_t* stalled_on = nullptr;     // Hazard counter the instruction waiting to issue is held by
+    // The scoreboard's Decode and Execute registers, up to width instructions each
+    StageQueue decode_queue;
+    StageQueue issue_queue;
+    int unit_free_at[UNIT_COUNT][MAX_UNITS] = {};   // Cycle each unit can start its next operation
+    WritebackSlot writebacks[WRITEBACK_WINDOW] = {};
+    // Out-of-order back end: a ring of pipeline.rob_entries, and the entry renamed to each
+    // architectural register (-1 when the register file holds its latest value)
+    std::vector<RobEntry> rob;
+    int rob_head = 0;
+    int rob_count = 0;
+    uint64_t next_seq = 1;
+    int rename_map[64];
+    int stations_used[UNIT_COUNT] = {};     // Loads and stores share UNIT_LOAD's station
+    int lsq_used = 0;
+    int loading_entry = -1;                 // Entry of the load in the load unit
+    OutOfOrderStats ooo_stats;
+
+    // Poll memory through the given cache, or the Membus when it is null
+    MemResult mem_read(Cache* cache, uint32_t address, uint32_t size = 4);
+    MemResult mem_write(Cache* cache, uint32_t address, uint32_t value, uint32_t size = 4);
+    uint32_t mem_idle_cycles(Cache* cache, uint32_t address, bool write) const;
+    void mem_advance(Cache* cache, uint32_t address, int cycles, bool write);
+
+    uint32_t effective_address(const DecodedOp& decoded) const { return x_registers[decoded.rs1] + decoded.immediate; }
+    int execute_latency(const DecodedOp& decoded) const;
+    bool execute_starting(const Instruction* instr) const;
+
+    // F extension and the CSRs that control it
+    void execute_fp(const DecodedOp& decoded);
+    uint32_t read_csr(uint32_t csr) const;
+    void write_csr(uint32_t csr, uint32_t value);
+
+    // Vector unit: vsetvli and arithmetic run in Execute, loads and stores move one element per
+    // access through the load unit (Execute in the legacy pipeline) and the Store stage
+    void execute_vector(const DecodedOp& decoded);
+    uint32_t vector_elements(const DecodedOp& decoded) const;
+    float* vector_register(int reg) { return &v_registers[reg * (vlen / 32)]; }
+    uint32_t read_v_bits(int reg, uint32_t element) const;
+    void write_v_bits(int reg, uint32_t element, uint32_t bits);
+    int vector_ready(const DecodedOp& decoded) const;
+    void start_vector_access(Instruction* instr);
+    uint32_t next_element(const Instruction* instr, uint32_t from) const;
+    bool elements_done(const Instruction* instr) const;
+    bool load_vector_element(Instruction* instr, const char* stage);
+
+    // Scoreboard bookkeeping
+    int source_registers(const DecodedOp& decoded, int sources[3]) const;
+    int dest_register(const DecodedOp& decoded) const;
+    int ready_cycle(int reg) const;
+    int blocked_until(const Instruction* instr, uint64_t*& cause);
+    bool read_by_memory(int reg) const;
+    bool load_waits(const Instruction* loading) const;
+    bool store_port_busy(const Instruction* loading) const;
+    bool overwrites_store_source(const Instruction* instr) const;
+    Instruction* fetch_word();
+    void decode_group();
+    void issue();
+    void load();
+    int reserve_writeback(int cycle, bool force = false);
+    bool decode_full() const;
+
+    // Out-of-order bookkeeping
+    uint32_t memory_address(const Instruction* instr) const;
+    uint32_t memory_bytes(const Instruction* instr) const;
+    uint32_t read_register(int reg) const;
+    void write_register(int reg, uint32_t bits);
+    int unit_count(FunctionalUnit unit) const;
+    int unit_ready(FunctionalUnit unit) const;
+    void occupy_unit(FunctionalUnit unit, Operation op);
+    RobEntry& rob_at(int position) { return rob[(rob_head + position) % rob.size()]; }
+    const RobEntry& rob_at(int position) const { return rob[(rob_head + position) % rob.size()]; }
+    int operands_ready(const RobEntry& entry) const;
+    uint32_t operand(const RobEntry& entry, int i) const;
+    uint64_t* dispatch_blocked(const Instruction* instr);
+    bool commit_blocked(const RobEntry& entry) const;
+    int forwarding_store(int position) const;
+    bool branch_pending(int position) const;
+    void dispatch();
+    void issue_out_of_order();
+    void execute_renamed(RobEntry& entry);
+    void start_loads();
+    void commit();
+    int squash_younger(const Instruction* instr);
 
 public:
     Core(int start_pc, int core_id, uint32_t initial_sp);
@@ -79,23 +342,52 @@ public:
     int pc;
     uint32_t max_instruction_address;
     uint32_t start_address;
+    SymbolTable symbols;            // From an ELF program, to name PCs in logs; empty for raw images
     int instruction_count = 0;
-    int delay = 0;
+    int active_cycles = 0;      // Cycles this core has been clocked, skipped idle cycles included
+    LogSink log;                // Buffered per-core output, flushed by the simulator
     void set_ram(RAM* ram_ptr);
     void set_membus(Membus* membus_ptr);
+    void enable_caches(const CacheConfig* icache_config, const CacheConfig* dcache_config);
+    void flush_caches();
+    const Cache* get_icache() const { return icache.get(); }
+    const Cache* get_dcache() const { return dcache.get(); }
+    void enable_branch_prediction(const BranchPredictorConfig* config);
+    const BranchPredictor* get_branch_predictor() const { return predictor.get(); }
     void fetch();
     void decode();
     void execute();
     void store();
-    void clean_event_list(Instruction* instr);
-    void execute_instruction(Instruction*, std::string, std::vector<std::string>);
-    void store_instruction(std::string, std::vector<std::string>, int);
+    void tick();
+    int idle_cycles();
+    void skip_cycles(int cycles);
+    bool tick_footprint(std::vector<AccessRange>& ranges) const;
+    void record_event(const Instruction* instr, Stage stage);
+    void retire(Stage stage);
+    void init_decode_cache();
+    void invalidate_decoded(uint32_t address, uint32_t size);
+    DecodedOp decode_cached(uint32_t address, uint32_t binary);
+    void execute_instruction(Instruction*, const DecodedOp&);
+    void store_instruction(Instruction*, const DecodedOp&);
+    void resolve_branch(Instruction* instr, bool taken, uint32_t target);
+    void write_x(int index, int32_t value) { if (index) x_registers[index] = value; }
+    uint32_t read_f_bits(int index) const;
+    void write_f_bits(int index, uint32_t bits);
     int delay_cycles(int cycle_count);
     std::string to_hex_string(uint32_t instruction);
-    std::vector<std::string> split_instruction(const std::string& instruction);
-    void flush_pipeline();
+    int flush_pipeline();
+    void jump_to(uint32_t target);
+    void trap(const Instruction* instr, const std::string& cause);
+    const std::string& get_trap() const { return trap_cause; }
+    void set_isa(IsaDialect dialect);
+    IsaDialect get_isa() const { return isa; }
+    void set_pipeline(const PipelineConfig& config);
+    const PipelineConfig& get_pipeline() const { return pipeline; }
+    void set_latency_table(const LatencyTable& table) { latencies = table; }
+    void set_vlen(uint32_t bits);
+    const HazardStats& get_hazard_stats() const { return hazards; }
+    const OutOfOrderStats& get_ooo_stats() const { return ooo_stats; }
     void print_event_list();
-    void print_instructions();
     void print_pipeline_registers();
     void print_registers();
     void print_f_registers();
@@ -1,147 +1,339 @@
 #include "decoder.h"
 
-InstructionMap InstructionMapping = 
+// Mnemonics and register file selection, indexed by Operation
+constexpr OperationInfo OperationTable[OP_COUNT] =
 {
-    {
-        OPCODE_LOAD, 
-        {
-            {0b000, "lb"},
-            {0b001, "lh"},
-            {0b010, "lw"},
-            {0b100, "lbu"},
-            {0b101, "lhu"},
-            {0b110, "flw"}
-        }
-    },
-    {
-        OPCODE_LOAD_FP,
-        {
-            {0b010, "flw"},
-        }
-    },
-    {
-        OPCODE_I_TYPE, 
-        {
-            {0b000, "addi"},
-            {0b001, "slli"},
-            {0b010, "slti"},
-            {0b011, "sltiu"},
-            {0b100, "xori"},
-            {0b101, Funct7Map{{0b0000000, "srli"}, {0b0100000, "srai"}}},
-            {0b110, "ori"},
-            {0b111, "andi"}
-        }
-    },
-    {
-        OPCODE_AUIPC, 
-        {
-            {NO_FUNCT3, "auipc"}
-        }
-    },
-    {
-        OPCODE_S_TYPE, 
-        {
-            {0b000, "sb"},
-            {0b001, "sh"},
-            {0b010, "sw"}
-        }
-    },
-    {
-        OPCODE_S_TYPE_FP, 
-        {
-            {0b010, "fsw"}
-        }
-    },
-    {
-        OPCODE_R_TYPE, 
-        {
-            {0b000, Funct7Map{
-                {0b0000000, "add"}, 
-                {0b0100000, "sub"}, 
-                {0b0000001, "mul"},
+    {OP_UNKNOWN, "Unknown", false, false, false, 0},
+    {OP_LB, "lb", false, false, false, 0},
+    {OP_LH, "lh", false, false, false, 0},
+    {OP_LW, "lw", false, false, false, 0},
+    {OP_LBU, "lbu", false, false, false, 0},
+    {OP_LHU, "lhu", false, false, false, 0},
+    {OP_FLW, "flw", true, false, false, 0},
+    {OP_ADDI, "addi", false, false, false, 0},
+    {OP_SLLI, "slli", false, false, false, 0},
+    {OP_SLTI, "slti", false, false, false, 0},
+    {OP_SLTIU, "sltiu", false, false, false, 0},
+    {OP_XORI, "xori", false, false, false, 0},
+    {OP_SRLI, "srli", false, false, false, 0},
+    {OP_SRAI, "srai", false, false, false, 0},
+    {OP_ORI, "ori", false, false, false, 0},
+    {OP_ANDI, "andi", false, false, false, 0},
+    {OP_AUIPC, "auipc", false, false, false, 0},
+    {OP_LUI, "lui", false, false, false, 0},
+    {OP_SB, "sb", false, false, false, 0},
+    {OP_SH, "sh", false, false, false, 0},
+    {OP_SW, "sw", false, false, false, 0},
+    {OP_FSW, "fsw", false, false, true, 0},
+    {OP_ADD, "add", false, false, false, 0},
+    {OP_SUB, "sub", false, false, false, 0},
+    {OP_SLL, "sll", false, false, false, 0},
+    {OP_SLT, "slt", false, false, false, 0},
+    {OP_SLTU, "sltu", false, false, false, 0},
+    {OP_XOR, "xor", false, false, false, 0},
+    {OP_SRL, "srl", false, false, false, 0},
+    {OP_SRA, "sra", false, false, false, 0},
+    {OP_OR, "or", false, false, false, 0},
+    {OP_AND, "and", false, false, false, 0},
+    {OP_MUL, "mul", false, false, false, 0},
+    {OP_MULH, "mulh", false, false, false, 0},
+    {OP_MULHSU, "mulhsu", false, false, false, 0},
+    {OP_MULHU, "mulhu", false, false, false, 0},
+    {OP_DIV, "div", false, false, false, 0},
+    {OP_DIVU, "divu", false, false, false, 0},
+    {OP_REM, "rem", false, false, false, 0},
+    {OP_REMU, "remu", false, false, false, 0},
+    {OP_BEQ, "beq", false, false, false, 0},
+    {OP_BNE, "bne", false, false, false, 0},
+    {OP_BLT, "blt", false, false, false, 0},
+    {OP_BGE, "bge", false, false, false, 0},
+    {OP_BLTU, "bltu", false, false, false, 0},
+    {OP_BGEU, "bgeu", false, false, false, 0},
+    {OP_JALR, "jalr", false, false, false, 0},
+    {OP_JAL, "jal", false, false, false, 0},
+    {OP_FADD_S, "fadd.s", true, true, true, 0},
+    {OP_FSUB_S, "fsub.s", true, true, true, 0},
+    {OP_FMUL_S, "fmul.s", true, true, true, 0},
+    {OP_FDIV_S, "fdiv.s", true, true, true, 0},
+    {OP_FSQRT_S, "fsqrt.s", true, true, false, 1},
+    {OP_FSGNJ_S, "fsgnj.s", true, true, true, 0},
+    {OP_FSGNJN_S, "fsgnjn.s", true, true, true, 0},
+    {OP_FSGNJX_S, "fsgnjx.s", true, true, true, 0},
+    {OP_FMIN_S, "fmin.s", true, true, true, 0},
+    {OP_FMAX_S, "fmax.s", true, true, true, 0},
+    {OP_FMADD_S, "fmadd.s", true, true, true, 0},
+    {OP_FMSUB_S, "fmsub.s", true, true, true, 0},
+    {OP_FNMSUB_S, "fnmsub.s", true, true, true, 0},
+    {OP_FNMADD_S, "fnmadd.s", true, true, true, 0},
+    {OP_FCVT_W_S, "fcvt.w.s", false, true, false, 2},
+    {OP_FCVT_WU_S, "fcvt.wu.s", false, true, false, 0},
+    {OP_FCVT_S_W, "fcvt.s.w", true, false, false, 2},
+    {OP_FCVT_S_WU, "fcvt.s.wu", true, false, false, 0},
+    {OP_FMV_X_W, "fmv.x.w", false, true, false, 1},
+    {OP_FCLASS_S, "fclass.s", false, true, false, 1},
+    {OP_FMV_W_X, "fmv.w.x", true, false, false, 1},
+    {OP_FEQ_S, "feq.s", false, true, true, 0},
+    {OP_FLT_S, "flt.s", false, true, true, 0},
+    {OP_FLE_S, "fle.s", false, true, true, 0},
+    {OP_CSRRW, "csrrw", false, false, false, 0},
+    {OP_CSRRS, "csrrs", false, false, false, 0},
+    {OP_CSRRC, "csrrc", false, false, false, 0},
+    {OP_CSRRWI, "csrrwi", false, false, false, 0},
+    {OP_CSRRSI, "csrrsi", false, false, false, 0},
+    {OP_CSRRCI, "csrrci", false, false, false, 0},
+    {OP_ECALL, "ecall", false, false, false, 2},
+    {OP_EBREAK, "ebreak", false, false, false, 0},
+    {OP_FENCE, "fence", false, false, false, 0},
+    {OP_VSETVLI, "vsetvli", false, false, false, 0},
+    {OP_VLE32_V, "vle32.v", false, false, false, 1},
+    {OP_VSE32_V, "vse32.v", false, false, false, 1},
+    {OP_VFADD_VV, "vfadd.vv", false, false, false, 0},
+    {OP_VFSUB_VV, "vfsub.vv", false, false, false, 0},
+    {OP_VFMUL_VV, "vfmul.vv", false, false, false, 0},
+    {OP_VFMACC_VV, "vfmacc.vv", false, false, false, 0},
+};
+
+namespace {
+
+constexpr int ANY = -1;
+
+// One row of the RV32IMF (and vector) encoding space: opcode, funct3 and funct7 (ANY when the field holds operands)
+struct Encoding
+{
+    uint8_t opcode;
+    int funct3;
+    int funct7;
+    uint8_t funct7Mask;
+    Operation op;
+};
+
+constexpr Encoding Encodings[] =
+{
+    {OPCODE_LOAD, 0b000, ANY, 0, OP_LB},
+    {OPCODE_LOAD, 0b001, ANY, 0, OP_LH},
+    {OPCODE_LOAD, 0b010, ANY, 0, OP_LW},
+    {OPCODE_LOAD, 0b100, ANY, 0, OP_LBU},
+    {OPCODE_LOAD, 0b101, ANY, 0, OP_LHU},
+    {OPCODE_LOAD, 0b110, ANY, 0, OP_FLW},
+    {OPCODE_LOAD_FP, 0b010, ANY, 0, OP_FLW},
+
+    {OPCODE_I_TYPE, 0b000, ANY, 0, OP_ADDI},
+    {OPCODE_I_TYPE, 0b001, 0b0000000, 0x7F, OP_SLLI},
+    {OPCODE_I_TYPE, 0b010, ANY, 0, OP_SLTI},
+    {OPCODE_I_TYPE, 0b011, ANY, 0, OP_SLTIU},
+    {OPCODE_I_TYPE, 0b100, ANY, 0, OP_XORI},
+    {OPCODE_I_TYPE, 0b101, 0b0000000, 0x7F, OP_SRLI},
+    {OPCODE_I_TYPE, 0b101, 0b0100000, 0x7F, OP_SRAI},
+    {OPCODE_I_TYPE, 0b110, ANY, 0, OP_ORI},
+    {OPCODE_I_TYPE, 0b111, ANY, 0, OP_ANDI},
+
+    {OPCODE_AUIPC, ANY, ANY, 0, OP_AUIPC},
+    {OPCODE_LUI, ANY, ANY, 0, OP_LUI},
+
+    {OPCODE_S_TYPE, 0b000, ANY, 0, OP_SB},
+    {OPCODE_S_TYPE, 0b001, ANY, 0, OP_SH},
+    {OPCODE_S_TYPE, 0b010, ANY, 0, OP_SW},
+    {OPCODE_S_TYPE_FP, 0b010, ANY, 0, OP_FSW},
+
+    {OPCODE_R_TYPE, 0b000, 0b0000000, 0x7F, OP_ADD},
+    {OPCODE_R_TYPE, 0b000, 0b0100000, 0x7F, OP_SUB},
+    {OPCODE_R_TYPE, 0b001, 0b0000000, 0x7F, OP_SLL},
+    {OPCODE_R_TYPE, 0b010, 0b0000000, 0x7F, OP_SLT},
+    {OPCODE_R_TYPE, 0b011, 0b0000000, 0x7F, OP_SLTU},
+    {OPCODE_R_TYPE, 0b100, 0b0000000, 0x7F, OP_XOR},
+    {OPCODE_R_TYPE, 0b101, 0b0000000, 0x7F, OP_SRL},
+    {OPCODE_R_TYPE, 0b101, 0b0100000, 0x7F, OP_SRA},
+    {OPCODE_R_TYPE, 0b110, 0b0000000, 0x7F, OP_OR},
+    {OPCODE_R_TYPE, 0b111, 0b0000000, 0x7F, OP_AND},
+    {OPCODE_R_TYPE, 0b000, 0b0000001, 0x7F, OP_MUL},
+    {OPCODE_R_TYPE, 0b001, 0b0000001, 0x7F, OP_MULH},
+    {OPCODE_R_TYPE, 0b010, 0b0000001, 0x7F, OP_MULHSU},
+    {OPCODE_R_TYPE, 0b011, 0b0000001, 0x7F, OP_MULHU},
+    {OPCODE_R_TYPE, 0b100, 0b0000001, 0x7F, OP_DIV},
+    {OPCODE_R_TYPE, 0b101, 0b0000001, 0x7F, OP_DIVU},
+    {OPCODE_R_TYPE, 0b110, 0b0000001, 0x7F, OP_REM},
+    {OPCODE_R_TYPE, 0b111, 0b0000001, 0x7F, OP_REMU},
+
+    {OPCODE_SB_TYPE, 0b000, ANY, 0, OP_BEQ},
+    {OPCODE_SB_TYPE, 0b001, ANY, 0, OP_BNE},
+    {OPCODE_SB_TYPE, 0b100, ANY, 0, OP_BLT},
+    {OPCODE_SB_TYPE, 0b101, ANY, 0, OP_BGE},
+    {OPCODE_SB_TYPE, 0b110, ANY, 0, OP_BLTU},
+    {OPCODE_SB_TYPE, 0b111, ANY, 0, OP_BGEU},
+    {OPCODE_JALR, 0b000, ANY, 0, OP_JALR},
+    {OPCODE_JAL, ANY, ANY, 0, OP_JAL},
+
+    // funct3 holds the rounding mode for arithmetic and conversions
+    {OPTCODE_FP, ANY, 0b0000000, 0x7F, OP_FADD_S},
+    {OPTCODE_FP, ANY, 0b0000100, 0x7F, OP_FSUB_S},
+    {OPTCODE_FP, ANY, 0b0001000, 0x7F, OP_FMUL_S},
+    {OPTCODE_FP, ANY, 0b0001100, 0x7F, OP_FDIV_S},
+    {OPTCODE_FP, ANY, 0b0101100, 0x7F, OP_FSQRT_S},
+    {OPTCODE_FP, 0b000, 0b0010000, 0x7F, OP_FSGNJ_S},
+    {OPTCODE_FP, 0b001, 0b0010000, 0x7F, OP_FSGNJN_S},
+    {OPTCODE_FP, 0b010, 0b0010000, 0x7F, OP_FSGNJX_S},
+    {OPTCODE_FP, 0b000, 0b0010100, 0x7F, OP_FMIN_S},
+    {OPTCODE_FP, 0b001, 0b0010100, 0x7F, OP_FMAX_S},
+    {OPTCODE_FP, ANY, 0b1100000, 0x7F, OP_FCVT_W_S},
+    {OPTCODE_FP, ANY, 0b1101000, 0x7F, OP_FCVT_S_W},
+    {OPTCODE_FP, 0b000, 0b1110000, 0x7F, OP_FMV_X_W},
+    {OPTCODE_FP, 0b001, 0b1110000, 0x7F, OP_FCLASS_S},
+    {OPTCODE_FP, 0b000, 0b1111000, 0x7F, OP_FMV_W_X},
+    {OPTCODE_FP, 0b010, 0b1010000, 0x7F, OP_FEQ_S},
+    {OPTCODE_FP, 0b001, 0b1010000, 0x7F, OP_FLT_S},
+    {OPTCODE_FP, 0b000, 0b1010000, 0x7F, OP_FLE_S},
+
+    // funct7 of R4 instructions is rs3 followed by the 2-bit format (00 = single)
+    {OPCODE_FMADD, ANY, 0b00, 0x03, OP_FMADD_S},
+    {OPCODE_FMSUB, ANY, 0b00, 0x03, OP_FMSUB_S},
+    {OPCODE_FNMSUB, ANY, 0b00, 0x03, OP_FNMSUB_S},
+    {OPCODE_FNMADD, ANY, 0b00, 0x03, OP_FNMADD_S},
+
+    {OPCODE_SYSTEM, 0b000, 0b0000000, 0x7F, OP_ECALL},
+    {OPCODE_SYSTEM, 0b001, ANY, 0, OP_CSRRW},
+    {OPCODE_SYSTEM, 0b010, ANY, 0, OP_CSRRS},
+    {OPCODE_SYSTEM, 0b011, ANY, 0, OP_CSRRC},
+    {OPCODE_SYSTEM, 0b101, ANY, 0, OP_CSRRWI},
+    {OPCODE_SYSTEM, 0b110, ANY, 0, OP_CSRRSI},
+    {OPCODE_SYSTEM, 0b111, ANY, 0, OP_CSRRCI},
+    {OPCODE_MISC_MEM, 0b000, ANY, 0, OP_FENCE},
+
+    // Vector: funct3 is the element width of loads and stores (110 = 32 bits) and the operand
+    // kind of arithmetic (001 = vector-vector FP); funct7 is funct6 followed by the vm bit.
+    // Unit-stride loads and stores need nf, mew and mop zero, and lumop/sumop (rs2) zero.
+    {OPCODE_LOAD_FP, 0b110, 0b0000000, 0x7E, OP_VLE32_V},
+    {OPCODE_S_TYPE_FP, 0b110, 0b0000000, 0x7E, OP_VSE32_V},
+    {OPCODE_V, 0b111, 0b0000000, 0x40, OP_VSETVLI},
+    {OPCODE_V, 0b001, 0b0000000, 0x7E, OP_VFADD_VV},
+    {OPCODE_V, 0b001, 0b0000100, 0x7E, OP_VFSUB_VV},
+    {OPCODE_V, 0b001, 0b1001000, 0x7E, OP_VFMUL_VV},
+    {OPCODE_V, 0b001, 0b1011000, 0x7E, OP_VFMACC_VV},
+};
+
+// Dense table indexed by opcode[6:2], funct3 and funct7 (opcode[1:0] is always 11 for 32-bit instructions)
+constexpr size_t DECODE_TABLE_SIZE = 32 * 8 * 128;
+
+constexpr size_t decodeIndex(uint32_t opcode, uint32_t funct3, uint32_t funct7) {
+    return ((opcode >> 2) & 0x1F) << 10 | (funct3 & 0x7) << 7 | (funct7 & 0x7F);
+}
+
+constexpr bool encodingMatches(const Encoding& e, int funct3, int funct7) {
+    return (e.funct3 == ANY || e.funct3 == funct3) && (e.funct7 == ANY || (funct7 & e.funct7Mask) == e.funct7);
+}
+
+constexpr std::array<uint8_t, DECODE_TABLE_SIZE> buildDecodeTable() {
+    std::array<uint8_t, DECODE_TABLE_SIZE> table{};
+    for (const Encoding& e : Encodings) {
+        for (int funct3 = 0; funct3 < 8; funct3++) {
+            for (int funct7 = 0; funct7 < 128; funct7++) {
+                if (encodingMatches(e, funct3, funct7)) {
+                    table[decodeIndex(e.opcode, funct3, funct7)] = e.op;
                 }
-            },  // Adding fadd.s to the R-type mapping
-            {0b001, Funct7Map{{0b0000000, "sll"}, {0b0000001, "mulh"}}},
-            {0b010, Funct7Map{{0b0000000, "slt"}, {0b0000001, "mulhsu"}}},
-            {0b011, Funct7Map{{0b0000000, "sltu"}, {0b0000001, "mulhu"}}},
-            {0b100, Funct7Map{{0b0000000, "xor"}, {0b0000001, "div"}}},
-            {0b101, Funct7Map{{0b0000000, "srl"}, {0b0100000, "sra"}, {0b0000001, "divu"}}},
-            {0b110, Funct7Map{{0b0000000, "or"}, {0b0000001, "rem"}}},
-            {0b111, Funct7Map{{0b0000000, "and"}, {0b0000001, "remu"}}},
-        }
-    },
-    {
-        OPCODE_LUI, 
-        {
-            {NO_FUNCT3, "lui"}
-        }
-    },
-    {
-        OPCODE_SB_TYPE, 
-        {
-            {0b000, "beq"},
-            {0b001, "bne"},
-            {0b100, "blt"},
-            {0b101, "bge"},
-            {0b110, "bltu"},
-            {0b111, "bgeu"}
-        }
-    },
-    {
-        OPCODE_JALR, 
-        {
-            {0b000, "jalr"}
+            }
         }
-    },
-    {
-        OPCODE_JAL,
-        {
-            {NO_FUNCT3, "jal"}
-        }
-    },
-    {
-        OPTCODE_FP,
-        {
-            {0b111, Funct7Map{
-                {0b0000000, "fadd.s"},
-                {0b0000100, "fsub.s"},
-                {0b0001000, "fmul.s"},
-                {0b0001100, "fdiv.s"},
-                {0b0101100, "fsqrt.s"},
-                // Add other single-precision floating-point operations here
+    }
+    return table;
+}
+
+constexpr std::array<uint8_t, DECODE_TABLE_SIZE> DecodeTable = buildDecodeTable();
+
+constexpr Operation lookupOperation(uint32_t instruction) {
+    if ((instruction & 0x3) != 0x3) return OP_UNKNOWN;
+
+    Operation op = static_cast<Operation>(DecodeTable[decodeIndex(instruction & 0x7F, instruction >> 12, instruction >> 25)]);
+    // FP arithmetic takes any funct3 as its rounding mode, but modes 5 and 6 are reserved;
+    // every FP operation with a fixed funct3 uses 0 to 2
+    uint32_t opcode = instruction & 0x7F;
+    uint32_t funct3 = (instruction >> 12) & 7;
+    bool fpOpcode = opcode == 0x53 || opcode == 0x43 || opcode == 0x47 || opcode == 0x4B || opcode == 0x4F;
+    if (fpOpcode && (funct3 == 5 || funct3 == 6)) return OP_UNKNOWN;
+    uint8_t variants = OperationTable[op].rs2Variants;
+    if (variants) {
+        uint32_t rs2 = (instruction >> 20) & 0x1F;
+        op = rs2 < variants ? static_cast<Operation>(op + rs2) : OP_UNKNOWN;
+    }
+    return op;
+}
+
+// Compile-time checks: the operation table is ordered by Operation, no two encodings
+// overlap, and every encoding (including rs2-selected variants) decodes back to itself
+constexpr bool operationTableOrdered() {
+    for (int i = 0; i < OP_COUNT; i++) {
+        if (OperationTable[i].op != i) return false;
+    }
+    return true;
+}
+
+constexpr bool encodingsDisjoint() {
+    for (size_t i = 0; i < std::size(Encodings); i++) {
+        for (size_t j = i + 1; j < std::size(Encodings); j++) {
+            if (Encodings[i].opcode != Encodings[j].opcode) continue;
+            for (int funct3 = 0; funct3 < 8; funct3++) {
+                for (int funct7 = 0; funct7 < 128; funct7++) {
+                    if (encodingMatches(Encodings[i], funct3, funct7) && encodingMatches(Encodings[j], funct3, funct7))
+                        return false;
                 }
-            },
+            }
         }
     }
-        
-};
+    return true;
+}
+
+constexpr bool encodingsRoundTrip() {
+    for (const Encoding& e : Encodings) {
+        uint32_t funct3 = e.funct3 == ANY ? 0b111 : e.funct3;
+        uint32_t funct7 = e.funct7 == ANY ? 0x7F : e.funct7;
+        uint32_t word = e.opcode | funct3 << 12 | funct7 << 25;
+
+        uint8_t variants = OperationTable[e.op].rs2Variants;
+        for (uint32_t rs2 = 0; rs2 < (variants ? variants : 1u); rs2++) {
+            if (lookupOperation(word | rs2 << 20) != e.op + rs2) return false;
+        }
+        if (variants && lookupOperation(word | variants << 20) != OP_UNKNOWN) return false;
+    }
+    return true;
+}
+
+static_assert(operationTableOrdered(), "OperationTable must be listed in Operation order");
+static_assert(encodingsDisjoint(), "Two encodings claim the same opcode/funct3/funct7");
+static_assert(encodingsRoundTrip(), "An encoding does not decode back to its operation");
+static_assert(lookupOperation(0x00107053) == OP_FADD_S, "fadd.s ft0, ft0, ft1");
+static_assert(lookupOperation(0x0000006F) == OP_JAL, "jal zero, 0");
+static_assert(lookupOperation(0x00105053) == OP_UNKNOWN, "fadd.s with reserved rounding mode 5");
+static_assert(lookupOperation(0x00104053) == OP_FADD_S, "fadd.s ft0, ft0, ft1, rmm");
+static_assert(lookupOperation(0x00000000) == OP_UNKNOWN, "all-zero word is illegal");
+static_assert(lookupOperation(0x02056087) == OP_VLE32_V, "vle32.v v1, (a0)");
+static_assert(lookupOperation(0x0d0575d7) == OP_VSETVLI, "vsetvli a1, a0, e32, m1, ta, ma");
+
+constexpr std::array<ControlSignals, 128> buildControlSignals() {
+    std::array<ControlSignals, 128> signals{};
+    signals[OPCODE_LOAD] = {true, true, false, true, true, false, false, false, false};
+    signals[OPCODE_LOAD_FP] = {true, true, false, true, true, false, false, false, false};
+    signals[OPCODE_I_TYPE] = {true, false, false, false, true, false, false, false, false};
+    signals[OPCODE_AUIPC] = {true, false, false, false, true, false, false, false, false};
+    signals[OPCODE_S_TYPE] = {false, false, true, false, true, false, false, false, false};
+    signals[OPCODE_S_TYPE_FP] = {false, false, true, false, true, false, false, false, false};
+    signals[OPCODE_R_TYPE] = {true, false, false, false, false, false, false, false, false};
+    signals[OPCODE_LUI] = {true, false, false, false, true, false, false, false, false};
+    signals[OPCODE_SB_TYPE] = {false, false, false, false, false, true, false, false, false};
+    signals[OPCODE_JALR] = {true, false, false, false, true, false, true, true, false};
+    signals[OPCODE_JAL] = {true, false, false, false, true, false, true, false, false};
+    return signals;
+}
 
+} // namespace
 
 // Control signals mapping
-std::unordered_map<uint8_t, ControlSignals> ControlInstructions = 
-{
-    {OPCODE_LOAD, {true, true, false, true, true, false, false, false, false}},
-    {OPCODE_LOAD_FP, {true, true, false, true, true, false, false, false, false}},
-    {OPCODE_I_TYPE, {true, false, false, false, true, false, false, false, false}},
-    {OPCODE_AUIPC, {true, false, false, false, true, false, false, false, false}},
-    {OPCODE_S_TYPE, {false, false, true, false, true, false, false, false, false}},
-    {OPCODE_S_TYPE_FP, {false, false, true, false, true, false, false, false, false}},
-    {OPCODE_R_TYPE, {true, false, false, false, false, false, false, false, false}},
-    {OPCODE_LUI, {true, false, false, false, true, false, false, false, false}},
-    {OPCODE_SB_TYPE, {false, false, false, false, false, true, false, false, false}},
-    {OPCODE_JALR, {true, false, false, false, true, false, true, true, false}},
-    {OPCODE_JAL, {true, false, false, false, true, false, true, false, false}}
-};
+constexpr std::array<ControlSignals, 128> ControlInstructions = buildControlSignals();
 
 // Constructor for Simulator
 Decoder::Decoder() {}
 
 // Decode instruction based on opcode
-std::string Decoder::decodeInstruction(uint32_t instruction) {
+DecodedOp Decoder::decodeInstruction(uint32_t instruction) {
     uint8_t opcode = getOpcode(instruction);
-    ControlSignals signals = ControlInstructions[opcode];
     InstructionVariables vars;
-    std::vector<std::string> printStatement;
+    DecodedOp decoded;
 
     // Determine the format and fill in `vars` based on opcode
     InstructionFormat format;
@@ -151,6 +343,8 @@ std::string Decoder::decodeInstruction(uint32_t instruction) {
         case OPCODE_LOAD_FP:
         case OPCODE_I_TYPE:
         case OPCODE_JALR:
+        case OPCODE_MISC_MEM:
+        case OPCODE_SYSTEM:
             format = FORMAT_I;
             vars.rs1 = getRS1(instruction);
             vars.rd = getRD(instruction);
@@ -187,42 +381,132 @@ std::string Decoder::decodeInstruction(uint32_t instruction) {
             vars.funct3 = getFunct3(instruction);
             vars.funct7 = getFunct7(instruction);
 
+            break;
+        case OPCODE_FMADD:
+        case OPCODE_FMSUB:
+        case OPCODE_FNMSUB:
+        case OPCODE_FNMADD:
+            format = FORMAT_R4;
+            vars.rs1 = getRS1(instruction);
+            vars.rs2 = getRS2(instruction);
+            vars.rd = getRD(instruction);
+            vars.funct3 = getFunct3(instruction);
+            vars.funct7 = getFunct7(instruction);
             break;
         case OPCODE_JAL:
             format = FORMAT_J;
             vars.rd = getRD(instruction);
             vars.immediate = getImmediate(instruction);
             break;
+        case OPCODE_V:
+            format = FORMAT_V;
+            vars.rs1 = getRS1(instruction);
+            vars.rs2 = getRS2(instruction);
+            vars.rd = getRD(instruction);
+            vars.funct3 = getFunct3(instruction);
+            vars.funct7 = getFunct7(instruction);
+            vars.immediate = getImmediate(instruction);
+            break;
         default:
-            std::cout << "Unknown opcode: " << std::bitset<7>(opcode) << std::endl;
-            return "Unknown";
+            return decoded;     // Unknown opcode
     }
 
-    std::variant<std::string, Funct7Map> instructionType = InstructionMapping[opcode][vars.funct3];
-    std::string decodedInstructionName;
-
-    if (instructionType.index() == 0) {
-        decodedInstructionName = std::get<std::string>(instructionType);
-    } else {
-        Funct7Map funct7Map = std::get<Funct7Map>(instructionType);
-        decodedInstructionName = funct7Map[vars.funct7];
+    decoded.op = lookupOperation(instruction);
+    decoded.format = format;
+    decoded.opcode = opcode;
+    if (vars.rd != NO_REGISTER) decoded.rd = vars.rd;
+    if (vars.rs1 != NO_REGISTER) decoded.rs1 = vars.rs1;
+    if (vars.rs2 != NO_REGISTER) decoded.rs2 = vars.rs2;
+    if (vars.immediate != NO_IMMEDIATE) decoded.immediate = vars.immediate;
+    if (vars.funct3 != NO_FUNCT3) decoded.rm = vars.funct3;
+    if (format == FORMAT_R4) decoded.rs3 = vars.funct7 >> 2;
+
+    // Shift immediates only carry the shift amount
+    if (decoded.op == OP_SLLI || decoded.op == OP_SRLI || decoded.op == OP_SRAI)
+        decoded.immediate &= 0x1F;
+
+    // Vector loads and stores have no offset, and a store's data register sits where rd would
+    if (decoded.op == OP_VLE32_V || decoded.op == OP_VSE32_V) {
+        decoded.immediate = 0;
+        decoded.rd = getRD(instruction);
     }
+    if (decoded.op >= OP_VLE32_V && decoded.op <= OP_VFMACC_VV)
+        decoded.masked = !((instruction >> 25) & 1);
 
-    addRegisters(vars, printStatement, opcode, decodedInstructionName);
-    // printControlSignals(signals);
+    return decoded;
+}
 
-    // Build the full decoded instruction as a string
-    std::string fullDecodedInstruction;
-    for (size_t i = 0; i < printStatement.size(); ++i) {
-        fullDecodedInstruction += printStatement[i];
-        if (i != printStatement.size() - 1) {
-            fullDecodedInstruction += " ";  // Add space between each part of the instruction
-        }
+// Build the assembly text of a decoded instruction (only needed for tracing)
+std::string Decoder::disassemble(const DecodedOp& decoded) {
+    const OperationInfo& info = OperationTable[decoded.op];
+    std::string text = info.name;
+    if (decoded.op == OP_UNKNOWN) return text;
+
+    const std::string& rd = getRegisterName(decoded.rd, info.fpRd);
+    const std::string& rs1 = getRegisterName(decoded.rs1, info.fpRs1);
+    const std::string& rs2 = getRegisterName(decoded.rs2, info.fpRs2);
+    std::string imm = std::to_string(decoded.immediate);
+    std::string mask = decoded.masked ? ", v0.t" : "";
+
+    switch (decoded.op) {
+        case OP_VSETVLI:
+            return text + " " + rd + ", " + rs1 + ", " + vtypeName(decoded.immediate);
+        case OP_VLE32_V: case OP_VSE32_V:
+            return text + " v" + std::to_string(decoded.rd) + ", (" + rs1 + ")" + mask;
+        case OP_VFADD_VV: case OP_VFSUB_VV: case OP_VFMUL_VV: case OP_VFMACC_VV:
+            // Vector assembly lists vs2 before vs1
+            return text + " v" + std::to_string(decoded.rd) + ", v" + std::to_string(decoded.rs2) +
+                   ", v" + std::to_string(decoded.rs1) + mask;
+        default:
+            break;
     }
 
-    decodedInstructionName += " " + fullDecodedInstruction; // Append full decoded instruction to the name
-
-    return decodedInstructionName;
+    switch (decoded.opcode) {
+        case OPTCODE_FP:
+            if (info.rs2Variants || decoded.op == OP_FCVT_WU_S || decoded.op == OP_FCVT_S_WU)
+                text += " " + rd + ", " + rs1;
+            else
+                text += " " + rd + ", " + rs1 + ", " + rs2;
+            break;
+        case OPCODE_R_TYPE:
+            text += " " + rd + ", " + rs1 + ", " + rs2;
+            break;
+        case OPCODE_FMADD:
+        case OPCODE_FMSUB:
+        case OPCODE_FNMSUB:
+        case OPCODE_FNMADD:
+            text += " " + rd + ", " + rs1 + ", " + rs2 + ", " + getRegisterName(decoded.rs3, true);
+            break;
+        case OPCODE_SYSTEM:
+            if (decoded.op == OP_CSRRWI || decoded.op == OP_CSRRSI || decoded.op == OP_CSRRCI)
+                text += " " + rd + ", " + imm + ", " + std::to_string(decoded.rs1);
+            else if (decoded.op != OP_ECALL && decoded.op != OP_EBREAK)
+                text += " " + rd + ", " + imm + ", " + rs1;
+            break;
+        case OPCODE_I_TYPE:
+            text += " " + rd + ", " + rs1 + ", " + imm;
+            break;
+        case OPCODE_LOAD:
+        case OPCODE_LOAD_FP:
+        case OPCODE_JALR:
+            text += " " + rd + ", " + memoryOperand(decoded);
+            break;
+        case OPCODE_S_TYPE:
+        case OPCODE_S_TYPE_FP:
+            text += " " + rs2 + ", " + memoryOperand(decoded);
+            break;
+        case OPCODE_SB_TYPE:
+            text += " " + rs1 + ", " + rs2 + ", " + imm;
+            break;
+        case OPCODE_LUI:
+        case OPCODE_AUIPC:
+        case OPCODE_JAL:
+            text += " " + rd + ", " + imm;
+            break;
+        default:
+            break;
+    }
+    return text;
 }
 
 // Helper functions for extracting instruction fields
@@ -257,16 +541,18 @@ int32_t Decoder::getImmediate(uint32_t instruction) {
     switch(opcode) {
 
         case OPCODE_LOAD:
+        case OPCODE_LOAD_FP:
             imm = (instruction >> 20) & 0xFFF;
-            if (imm > 4079 && imm & 0x800) imm |= 0xFFFFF000;
+            if ((dialect == ISA_STANDARD || imm > 4079) && imm & 0x800) imm |= 0xFFFFF000;
             break;
         
         case OPCODE_I_TYPE:
         case OPCODE_JALR:
             imm = (instruction >> 20) & 0xFFF;
-            if (imm > 4079 && imm & 0x800) imm |= 0xFFFFF000;
+            if ((dialect == ISA_STANDARD || imm > 4079) && imm & 0x800) imm |= 0xFFFFF000;
             break;
         case OPCODE_S_TYPE:
+        case OPCODE_S_TYPE_FP:
             imm = ((instruction >> 25) & 0x7F) << 5 | (instruction >> 7) & 0x1F;
             if (imm & 0x800) imm |= 0xFFFFF000;
             break;
@@ -277,6 +563,12 @@ int32_t Decoder::getImmediate(uint32_t instruction) {
                   ((instruction >> 8) & 0xF) << 1;
             if (imm & 0x1000) imm |= 0xFFFFE000;
             break;
+        case OPCODE_SYSTEM:
+            imm = (instruction >> 20) & 0xFFF;    // CSR number, never sign-extended
+            break;
+        case OPCODE_V:
+            imm = (instruction >> 20) & 0x7FF;    // vtype of vsetvli
+            break;
         case OPCODE_AUIPC:
         case OPCODE_LUI:
             imm = instruction & 0xFFFFF000;
@@ -296,100 +588,33 @@ int32_t Decoder::getImmediate(uint32_t instruction) {
 }
 
 // Helper function to map register numbers to RISC-V register names
-std::string getRegisterName(int regNum, const std::string& instruction) {
-
-    static const std::unordered_set<std::string> floatInstructions = {
-        "flw", "fsw", "fadd.s", "fsub.s", "fmul.s", "fdiv.s", "fsqrt.s",
-        "fsgnj.s", "fsgnjn.s", "fsgnjx.s", "fmin.s", "fmax.s",
-        // Add other floating-point instructions as needed
+const std::string& getRegisterName(int regNum, bool isFloat) {
+    static const std::string intNames[32] = {
+        "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+        "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+        "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+        "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+    };
+    static const std::string floatNames[32] = {
+        "ft0", "ft1", "ft2", "ft3", "ft4", "ft5", "ft6", "ft7",
+        "fs0", "fs1", "fa0", "fa1", "fa2", "fa3", "fa4", "fa5",
+        "fa6", "fa7", "fs2", "fs3", "fs4", "fs5", "fs6", "fs7",
+        "fs8", "fs9", "fs10", "fs11", "ft8", "ft9", "ft10", "ft11"
     };
 
-    // Check if the instruction is a floating-point type
-    if (floatInstructions.find(instruction) != floatInstructions.end() && regNum < 2) {
-        // Return floating-point register name
-        return "ft" + std::to_string(regNum);
-    }
-
-    if (regNum == 0) return "zero";
-    if (regNum == 1) return "ra";
-    if (regNum == 2) return "sp";
-    if (regNum == 3) return "gp";
-    if (regNum == 4) return "tp";
-
-    // Temporaries: t0-t2 (x5 - x7)
-    if (regNum >= 5 && regNum <= 7) return "t" + std::to_string(regNum - 5);
-    // Saved registers: s0-s1 (x8 - x9)
-    if (regNum >= 8 && regNum <= 9) return "s" + std::to_string(regNum - 8);
-    // Argument registers: a0-a7 (x10 - x17)
-    if (regNum >= 10 && regNum <= 17) return "a" + std::to_string(regNum - 10);
-    // Saved registers: s2-s11 (x18 - x27)
-    if (regNum >= 18 && regNum <= 27) return "s" + std::to_string(regNum - 16);
-    // Temporaries: t3-t6 (x28 - x31)
-    if (regNum >= 28 && regNum <= 31) return "t" + std::to_string(regNum - 25);
-    // Fallback for non-standard registers
-    return "x" + std::to_string(regNum);
+    return isFloat ? floatNames[regNum & 0x1F] : intNames[regNum & 0x1F];
 }
 
-void Decoder::printOperands(int op1, int op2, int op3, std::string din, std::vector<std::string>& printStatement,
-                            std::vector<bool> isReg, bool isImmediateLast) {
-    std::vector<std::string> operands;
-
-    if (op1 != NO_REGISTER) 
-        operands.push_back(isReg[0] ? getRegisterName(op1, din) : std::to_string(op1));
-    if (op2 != NO_REGISTER && op2 != NO_IMMEDIATE) 
-        operands.push_back(isReg[1] ? getRegisterName(op2, din) : std::to_string(op2));
-    if (op3 != NO_REGISTER && op3 != NO_IMMEDIATE) {
-        std::string operand = isImmediateLast ? std::to_string(op3) : (isReg[2] ? getRegisterName(op3, din) : std::to_string(op3));
-        operands.push_back(operand);
-    }
-
-    for (size_t i = 0; i < operands.size(); ++i) {
-        printStatement.push_back(operands[i]);
-        if (i != operands.size() - 1) {
-            printStatement.back() += ",";
-        }
-    }
+// Format "imm(rs1)" for loads, stores and jalr
+std::string Decoder::memoryOperand(const DecodedOp& decoded) {
+    return std::to_string(decoded.immediate) + "(" + getRegisterName(decoded.rs1, false) + ")";
 }
 
-void Decoder::addRegisters(InstructionVariables& vars, std::vector<std::string>& printStatement, uint8_t opcode, std::string din) {
-    switch (opcode) {
-        case OPTCODE_FP:
-        case OPCODE_R_TYPE:
-            printOperands(vars.rd, vars.rs1, vars.rs2, din, printStatement, {true, true, true});
-            break;
-        case OPCODE_I_TYPE:
-            printOperands(vars.rd, vars.rs1, vars.immediate, din, printStatement, {true, true, false}, true);
-            break;
-        case OPCODE_LOAD:
-        case OPCODE_LOAD_FP:
-            if (vars.rd != NO_REGISTER) printStatement.push_back(getRegisterName(vars.rd, din) + ",");
-            if (vars.immediate != NO_IMMEDIATE && vars.rs1 != NO_REGISTER)
-                printStatement.push_back(std::to_string(vars.immediate) + "(" + getRegisterName(vars.rs1, din) + ")");
-            break;
-        case OPCODE_S_TYPE:
-        case OPCODE_S_TYPE_FP:
-            if (vars.rs2 != NO_REGISTER) printStatement.push_back(getRegisterName(vars.rs2, din) + ",");
-            if (vars.immediate != NO_IMMEDIATE && vars.rs1 != NO_REGISTER)
-                printStatement.push_back(std::to_string(vars.immediate) + "(" + getRegisterName(vars.rs1, din) + ")");
-            break;
-        case OPCODE_SB_TYPE:
-            printOperands(vars.rs1, vars.rs2, vars.immediate, din, printStatement, {true, true, false}, true);
-            break;
-        case OPCODE_LUI:
-        case OPCODE_AUIPC:
-            printOperands(vars.rd, vars.immediate, NO_IMMEDIATE, din, printStatement, {true, false, false}, true);
-            break;
-        case OPCODE_JAL:
-            printOperands(vars.rd, vars.immediate, NO_IMMEDIATE, din, printStatement, {true, false, false}, true);
-            break;
-        case OPCODE_JALR:
-            if (vars.rd != NO_REGISTER) printStatement.push_back(getRegisterName(vars.rd, din) + ",");
-            if (vars.immediate != NO_IMMEDIATE && vars.rs1 != NO_REGISTER)
-                printStatement.push_back(std::to_string(vars.immediate) + "(" + getRegisterName(vars.rs1, din) + ")");
-            break;
-        default:
-            break;
-    }
+// Format vsetvli's vtype as "e32, m1, ta, ma"
+std::string Decoder::vtypeName(uint32_t vtype) {
+    static const char* const lmul[8] = {"m1", "m2", "m4", "m8", "m?", "mf8", "mf4", "mf2"};
+    return "e" + std::to_string(8u << ((vtype >> 3) & 7)) + ", " + lmul[vtype & 7] +
+           ((vtype >> 6) & 1 ? ", ta" : ", tu") + ((vtype >> 7) & 1 ? ", ma" : ", mu");
 }
 
 void Decoder::printControlSignals(const ControlSignals& signals) {
@@ -4,17 +4,41 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <map>
-#include <unordered_map>
-#include <variant>
 #include <cstdint>
+#include <array>
 #include <bitset>
 #include <limits>
-#include <unordered_set>
 
-// Define Funct7Map and InstructionMap
-using Funct7Map = std::unordered_map<int, std::string>;
-using InstructionMap = std::unordered_map<uint32_t, std::unordered_map<int, std::variant<std::string, Funct7Map>>>;
+// Operations the decoder can produce
+enum Operation : uint8_t {
+    OP_UNKNOWN,
+    // Loads
+    OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU, OP_FLW,
+    // Immediate arithmetic
+    OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU, OP_XORI, OP_SRLI, OP_SRAI, OP_ORI, OP_ANDI,
+    // Upper immediates
+    OP_AUIPC, OP_LUI,
+    // Stores
+    OP_SB, OP_SH, OP_SW, OP_FSW,
+    // Register arithmetic (RV32I + M)
+    OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND,
+    OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU,
+    // Branches and jumps
+    OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU, OP_JALR, OP_JAL,
+    // Single-precision floating point
+    OP_FADD_S, OP_FSUB_S, OP_FMUL_S, OP_FDIV_S, OP_FSQRT_S,
+    OP_FSGNJ_S, OP_FSGNJN_S, OP_FSGNJX_S, OP_FMIN_S, OP_FMAX_S,
+    OP_FMADD_S, OP_FMSUB_S, OP_FNMSUB_S, OP_FNMADD_S,
+    OP_FCVT_W_S, OP_FCVT_WU_S, OP_FCVT_S_W, OP_FCVT_S_WU,
+    OP_FMV_X_W, OP_FCLASS_S, OP_FMV_W_X,
+    OP_FEQ_S, OP_FLT_S, OP_FLE_S,
+    // System (fcsr access, environment calls)
+    OP_CSRRW, OP_CSRRS, OP_CSRRC, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI,
+    OP_ECALL, OP_EBREAK, OP_FENCE,
+    // Vector (an RVV subset: 32-bit elements, unit-stride memory access, FP arithmetic)
+    OP_VSETVLI, OP_VLE32_V, OP_VSE32_V, OP_VFADD_VV, OP_VFSUB_VV, OP_VFMUL_VV, OP_VFMACC_VV,
+    OP_COUNT
+};
 
 // Define RISC-V opcodes
 #define OPCODE_LOAD         0b0000011
@@ -30,6 +54,13 @@ using InstructionMap = std::unordered_map<uint32_t, std::unordered_map<int, std:
 #define OPCODE_JALR         0b1100111
 #define OPCODE_JAL          0b1101111
 #define OPTCODE_FP          0b1010011
+#define OPCODE_FMADD        0b1000011
+#define OPCODE_FMSUB        0b1000111
+#define OPCODE_FNMSUB       0b1001011
+#define OPCODE_FNMADD       0b1001111
+#define OPCODE_MISC_MEM     0b0001111
+#define OPCODE_SYSTEM       0b1110011
+#define OPCODE_V            0b1010111
 
 const int NO_IMMEDIATE = std::numeric_limits<int32_t>::max();
 const int NO_REGISTER = std::numeric_limits<int32_t>::max();
@@ -43,11 +74,23 @@ enum InstructionFormat {
     FORMAT_S,
     FORMAT_B,
     FORMAT_U,
-    FORMAT_J
+    FORMAT_J,
+    FORMAT_R4,
+    FORMAT_V            // Vector arithmetic on vd, vs1, vs2; vsetvli with vtype as the immediate
+};
+
+// Static properties of each operation (mnemonic and which operands live in the FP register file)
+struct OperationInfo
+{
+    Operation op;
+    const char* name;
+    bool fpRd;
+    bool fpRs1;
+    bool fpRs2;
+    uint8_t rs2Variants;    // Non-zero when the rs2 field selects between op, op + 1, ...
 };
 
-// Instruction map
-extern InstructionMap InstructionMapping;
+extern const OperationInfo OperationTable[OP_COUNT];
 
 // Define control signals
 struct ControlSignals
@@ -74,16 +117,45 @@ struct InstructionVariables
     int immediate = NO_IMMEDIATE;
 };
 
-// Control signals mapping
-extern std::unordered_map<uint8_t, ControlSignals> ControlInstructions;
+// Fully decoded instruction consumed by the core
+struct DecodedOp
+{
+    Operation op = OP_UNKNOWN;
+    InstructionFormat format = FORMAT_R;
+    uint8_t opcode = 0;
+    uint8_t rd = 0;
+    uint8_t rs1 = 0;
+    uint8_t rs2 = 0;
+    uint8_t rs3 = 0;        // Third source of fused multiply-add
+    uint8_t rm = 0;         // Rounding mode field of FP instructions
+    bool masked = false;    // Vector instruction that only touches the elements enabled in v0
+    int32_t immediate = 0;
+};
 
-// Simulator class
+// Control signals mapping, indexed by opcode
+extern const std::array<ControlSignals, 128> ControlInstructions;
+
+// ABI name of an integer (x0-x31) or floating point (f0-f31) register
+const std::string& getRegisterName(int regNum, bool isFloat);
+
+// How encodings are interpreted. The original hand-patched test programs
+// (CPU0.bin, CPU1.bin) depend on the legacy quirks; compiled code needs standard.
+enum IsaDialect : uint8_t {
+    ISA_LEGACY,     // I-type immediates sign-extend only above 4079; branches are relative to the live PC
+    ISA_STANDARD    // RISC-V as specified
+};
+
+// Turns instruction words into DecodedOps under one IsaDialect
 class Decoder {
 public:
     Decoder();
-    std::string decodeInstruction(uint32_t instruction);  // Changed to return std::string\
+    void setDialect(IsaDialect isa) { dialect = isa; }
+    DecodedOp decodeInstruction(uint32_t instruction);
+    std::string disassemble(const DecodedOp& decoded);
 
 private:
+    IsaDialect dialect = ISA_LEGACY;
+
     // Getters for instruction fields
     uint32_t getOpcode(uint32_t instruction);
     uint32_t getRS1(uint32_t instruction);
@@ -93,10 +165,9 @@ private:
     uint32_t getFunct7(uint32_t instruction);
     int32_t getImmediate(uint32_t instruction);
 
-    // Operand and register management
-    void printOperands(int op1, int op2, int op3, std::string din, std::vector<std::string>& printStatement,
-                       std::vector<bool> isReg, bool isImmediateLast = false);
-    void addRegisters(InstructionVariables& vars, std::vector<std::string>& printStatement, uint8_t opcode, std::string din);
+    // Operand formatting for disassembly
+    std::string memoryOperand(const DecodedOp& decoded);
+    std::string vtypeName(uint32_t vtype);
     
     // Print control signals
     void printControlSignals(const ControlSignals& signals);
@@ -0,0 +1,215 @@
+#include "elf.h"
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+const uint8_t ELF_MAGIC[4] = {0x7F, 'E', 'L', 'F'};
+const uint8_t ELFCLASS32 = 1;
+const uint8_t ELFCLASS64 = 2;
+const uint8_t ELFDATA2LSB = 1;
+const uint16_t ET_EXEC = 2;
+const uint16_t EM_RISCV = 243;
+const uint32_t PT_LOAD = 1;
+const uint32_t PF_X = 1;
+const uint32_t SHT_SYMTAB = 2;
+const uint16_t SHN_UNDEF = 0;
+const uint16_t SHN_LORESERVE = 0xFF00;      // ABS, COMMON and the like: not addresses in the image
+const uint8_t STT_NOTYPE = 0;
+const uint8_t STT_OBJECT = 1;
+const uint8_t STT_FUNC = 2;
+
+// Field offsets and sizes that differ between ELF32 and ELF64
+struct ElfLayout {
+    size_t entry, phoff, shoff, phentsize, phnum, shentsize, shnum;
+    size_t addressBytes;
+    size_t pOffset, pVaddr, pFilesz, pMemsz, pFlags;
+    size_t shType, shOffset, shSize, shLink;
+    size_t symBytes, stValue, stSize, stInfo, stShndx;
+};
+
+const ElfLayout ELF32_LAYOUT = {24, 28, 32, 42, 44, 46, 48, 4,
+                                4, 8, 16, 20, 24,
+                                4, 16, 20, 24,
+                                16, 4, 8, 12, 14};
+const ElfLayout ELF64_LAYOUT = {24, 32, 40, 54, 56, 58, 60, 8,
+                                8, 16, 32, 40, 4,
+                                4, 24, 32, 40,
+                                24, 8, 16, 4, 6};
+
+// Little-endian field of `bytes` bytes at offset
+uint64_t field(const std::vector<uint8_t>& data, size_t offset, size_t bytes) {
+    if (offset + bytes > data.size()) throw std::invalid_argument("Truncated ELF file.");
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) value |= uint64_t(data[offset + i]) << (8 * i);
+    return value;
+}
+
+std::vector<uint8_t> read_bytes(std::ifstream& file, uint64_t offset, uint64_t size, const std::string& filename) {
+    std::vector<uint8_t> bytes(size);
+    file.seekg(offset);
+    if (!file.read(reinterpret_cast<char*>(bytes.data()), size)) {
+        throw std::runtime_error("Error reading from ELF file: " + filename);
+    }
+    return bytes;
+}
+
+uint32_t guest_address(uint64_t address, const std::string& filename) {
+    if (address > UINT32_MAX) throw std::invalid_argument("ELF address does not fit in 32 bits: " + filename);
+    return static_cast<uint32_t>(address);
+}
+
+} // namespace
+
+void SymbolTable::add(const ElfSymbol& symbol) {
+    symbols.push_back(symbol);
+}
+
+void SymbolTable::sort() {
+    std::stable_sort(symbols.begin(), symbols.end(), [](const ElfSymbol& a, const ElfSymbol& b) {
+        return a.address < b.address;
+    });
+}
+
+const ElfSymbol* SymbolTable::find(uint32_t address) const {
+    auto after = std::upper_bound(symbols.begin(), symbols.end(), address, [](uint32_t value, const ElfSymbol& symbol) {
+        return value < symbol.address;
+    });
+    if (after == symbols.begin()) return nullptr;
+    const ElfSymbol& symbol = *(after - 1);
+    if (symbol.size && address - symbol.address >= symbol.size) return nullptr;
+    return &symbol;
+}
+
+std::string SymbolTable::describe(uint32_t address) const {
+    const ElfSymbol* symbol = find(address);
+    std::ostringstream name;
+    if (!symbol) {
+        name << "0x" << std::hex << address;
+    } else {
+        name << symbol->name;
+        if (address != symbol->address) name << "+0x" << std::hex << (address - symbol->address);
+    }
+    return name.str();
+}
+
+uint32_t ElfImage::textStart() const {
+    uint32_t start = UINT32_MAX;
+    for (const ElfSegment& segment : segments) {
+        if (segment.executable) start = std::min(start, segment.address);
+    }
+    return start;
+}
+
+uint64_t ElfImage::textEnd() const {
+    uint64_t end = 0;
+    for (const ElfSegment& segment : segments) {
+        if (segment.executable) end = std::max<uint64_t>(end, uint64_t(segment.address) + segment.memoryBytes);
+    }
+    return end;
+}
+
+uint64_t ElfImage::end() const {
+    uint64_t end = 0;
+    for (const ElfSegment& segment : segments) {
+        end = std::max<uint64_t>(end, uint64_t(segment.address) + segment.memoryBytes);
+    }
+    return end;
+}
+
+bool is_elf_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    char magic[4] = {};
+    return file.read(magic, sizeof(magic)) && std::equal(magic, magic + 4, reinterpret_cast<const char*>(ELF_MAGIC));
+}
+
+ElfImage read_elf(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open ELF file: " + filename);
+    }
+    uint64_t fileBytes = static_cast<uint64_t>(file.tellg());
+
+    std::vector<uint8_t> header = read_bytes(file, 0, std::min<uint64_t>(fileBytes, 64), filename);
+    if (header.size() < 16 || !std::equal(ELF_MAGIC, ELF_MAGIC + 4, header.begin())) {
+        throw std::invalid_argument("Not an ELF file: " + filename);
+    }
+    if (header[4] != ELFCLASS32 && header[4] != ELFCLASS64) {
+        throw std::invalid_argument("Unknown ELF class: " + filename);
+    }
+    const ElfLayout& layout = header[4] == ELFCLASS32 ? ELF32_LAYOUT : ELF64_LAYOUT;
+    if (header[5] != ELFDATA2LSB || field(header, 16, 2) != ET_EXEC || field(header, 18, 2) != EM_RISCV) {
+        throw std::invalid_argument("Not a little-endian RISC-V executable: " + filename);
+    }
+    size_t addressBytes = layout.addressBytes;
+
+    ElfImage image;
+    image.entry = guest_address(field(header, layout.entry, addressBytes), filename);
+
+    // Program headers: every PT_LOAD segment is placed in guest memory
+    uint64_t phoff = field(header, layout.phoff, addressBytes);
+    size_t phentsize = field(header, layout.phentsize, 2);
+    size_t phnum = field(header, layout.phnum, 2);
+    if (phoff + uint64_t(phentsize) * phnum > fileBytes) throw std::invalid_argument("Truncated ELF file: " + filename);
+    std::vector<uint8_t> programHeaders = read_bytes(file, phoff, uint64_t(phentsize) * phnum, filename);
+    for (size_t i = 0; i < phnum; i++) {
+        size_t base = i * phentsize;
+        if (field(programHeaders, base, 4) != PT_LOAD) continue;
+        uint64_t offset = field(programHeaders, base + layout.pOffset, addressBytes);
+        uint64_t address = field(programHeaders, base + layout.pVaddr, addressBytes);
+        uint64_t inFile = field(programHeaders, base + layout.pFilesz, addressBytes);
+        uint64_t inMemory = field(programHeaders, base + layout.pMemsz, addressBytes);
+        if (inFile > inMemory || offset + inFile > fileBytes) {
+            throw std::invalid_argument("Malformed ELF segment: " + filename);
+        }
+        guest_address(address + inMemory, filename);
+        bool executable = field(programHeaders, base + layout.pFlags, 4) & PF_X;
+        image.segments.push_back({static_cast<uint32_t>(address), static_cast<uint32_t>(inMemory), offset,
+                                  static_cast<uint32_t>(inFile), executable});
+    }
+    uint64_t textEnd = image.textEnd();
+    if (textEnd == 0) throw std::invalid_argument("ELF file has no executable segment: " + filename);
+    if (image.entry < image.textStart() || image.entry >= textEnd || image.entry % 4 || image.textStart() % 4) {
+        throw std::invalid_argument("ELF entry point is not a word in the executable segments: " + filename);
+    }
+
+    // Section headers, only to find the symbol table and its strings; a stripped file has neither
+    uint64_t shoff = field(header, layout.shoff, addressBytes);
+    size_t shentsize = field(header, layout.shentsize, 2);
+    size_t shnum = field(header, layout.shnum, 2);
+    if (shoff == 0 || shoff + uint64_t(shentsize) * shnum > fileBytes) return image;
+    std::vector<uint8_t> sections = read_bytes(file, shoff, uint64_t(shentsize) * shnum, filename);
+    for (size_t i = 0; i < shnum; i++) {
+        size_t base = i * shentsize;
+        if (field(sections, base + layout.shType, 4) != SHT_SYMTAB) continue;
+        uint64_t symOffset = field(sections, base + layout.shOffset, addressBytes);
+        uint64_t symSize = field(sections, base + layout.shSize, addressBytes);
+        size_t link = field(sections, base + layout.shLink, 4);
+        if (link >= shnum) continue;
+        uint64_t strOffset = field(sections, link * shentsize + layout.shOffset, addressBytes);
+        uint64_t strSize = field(sections, link * shentsize + layout.shSize, addressBytes);
+        if (symOffset + symSize > fileBytes || strOffset + strSize > fileBytes) continue;
+
+        std::vector<uint8_t> symbols = read_bytes(file, symOffset, symSize, filename);
+        std::vector<uint8_t> strings = read_bytes(file, strOffset, strSize, filename);
+        for (size_t s = 0; s + layout.symBytes <= symbols.size(); s += layout.symBytes) {
+            uint8_t type = field(symbols, s + layout.stInfo, 1) & 0xF;
+            uint16_t section = field(symbols, s + layout.stShndx, 2);
+            uint32_t name = field(symbols, s, 4);
+            if ((type != STT_NOTYPE && type != STT_OBJECT && type != STT_FUNC) ||
+                section == SHN_UNDEF || section >= SHN_LORESERVE || name >= strings.size()) continue;
+            // Skip the assembler's $x/$d mapping symbols and anything unnamed
+            std::string text(reinterpret_cast<const char*>(&strings[name]),
+                             std::find(strings.begin() + name, strings.end(), 0) - (strings.begin() + name));
+            if (text.empty() || text[0] == '$') continue;
+            uint64_t value = field(symbols, s + layout.stValue, addressBytes);
+            uint64_t size = field(symbols, s + layout.stSize, addressBytes);
+            if (value > UINT32_MAX) continue;
+            image.symbols.add({static_cast<uint32_t>(value), static_cast<uint32_t>(std::min<uint64_t>(size, UINT32_MAX)), text});
+        }
+    }
+    image.symbols.sort();
+    return image;
+}
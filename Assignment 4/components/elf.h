@@ -0,0 +1,58 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A PT_LOAD segment: fileBytes from fileOffset go to address, then zeros up to memoryBytes (.bss)
+struct ElfSegment {
+    uint32_t address;
+    uint32_t memoryBytes;
+    uint64_t fileOffset;
+    uint32_t fileBytes;
+    bool executable;
+};
+
+struct ElfSymbol {
+    uint32_t address;
+    uint32_t size;          // 0 for assembler labels, which run up to the next symbol
+    std::string name;
+};
+
+// Function and data symbols of a program, sorted by address, for naming PCs in logs and profiles
+class SymbolTable {
+public:
+    void add(const ElfSymbol& symbol);
+    void sort();
+    bool empty() const { return symbols.empty(); }
+    size_t size() const { return symbols.size(); }
+
+    // Symbol at or before address that covers it, or null
+    const ElfSymbol* find(uint32_t address) const;
+    // "main+0x10", or the bare address in hex if no symbol covers it
+    std::string describe(uint32_t address) const;
+
+private:
+    std::vector<ElfSymbol> symbols;
+};
+
+struct ElfImage {
+    uint32_t entry = 0;
+    std::vector<ElfSegment> segments;
+    SymbolTable symbols;
+
+    // Executable segments' span, and one past the highest byte any segment occupies
+    uint32_t textStart() const;
+    uint64_t textEnd() const;
+    uint64_t end() const;
+};
+
+// True if the file starts with the ELF magic number
+bool is_elf_file(const std::string& filename);
+
+// Read the headers and symbol table of a little-endian RISC-V executable; segment contents stay
+// in the file. ELF64 files are accepted as long as every address fits in 32 bits.
+ElfImage read_elf(const std::string& filename);
+
+#endif // ELF_H
@@ -0,0 +1,116 @@
+#include "latency.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+OpClass op_class(Operation op) {
+    switch (op) {
+        case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: case OP_FLW: case OP_VLE32_V:
+            return CLASS_LOAD;
+        case OP_SB: case OP_SH: case OP_SW: case OP_FSW: case OP_VSE32_V:
+            return CLASS_STORE;
+        case OP_MUL: case OP_MULH: case OP_MULHSU: case OP_MULHU:
+            return CLASS_MUL;
+        case OP_DIV: case OP_DIVU: case OP_REM: case OP_REMU:
+            return CLASS_DIV;
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU:
+        case OP_JALR: case OP_JAL:
+            return CLASS_BRANCH;
+        case OP_FADD_S: case OP_FSUB_S: case OP_VFADD_VV: case OP_VFSUB_VV:
+            return CLASS_FADD;
+        case OP_FMUL_S: case OP_FMADD_S: case OP_FMSUB_S: case OP_FNMSUB_S: case OP_FNMADD_S:
+        case OP_VFMUL_VV: case OP_VFMACC_VV:
+            return CLASS_FMUL;
+        case OP_FDIV_S: case OP_FSQRT_S:
+            return CLASS_FDIV;
+        case OP_CSRRW: case OP_CSRRS: case OP_CSRRC: case OP_CSRRWI: case OP_CSRRSI: case OP_CSRRCI:
+        case OP_ECALL: case OP_EBREAK: case OP_FENCE:
+            return CLASS_SYSTEM;
+        default:
+            break;
+    }
+    const OperationInfo& info = OperationTable[op];
+    return (info.fpRd || info.fpRs1) ? CLASS_FMISC : CLASS_ALU;
+}
+
+LatencyTable::LatencyTable() {
+    for (int op = 0; op < OP_COUNT; op++) {
+        timing[op] = {0, 1};
+    }
+    for (Operation op : {OP_FADD_S, OP_FSUB_S, OP_FLW, OP_FSW}) {
+        timing[op].latency = 5;
+    }
+    for (Operation op : {OP_ADDI, OP_AND, OP_OR, OP_XORI, OP_SLLI, OP_BLT, OP_JAL, OP_JALR, OP_LW, OP_SW}) {
+        timing[op].latency = 1;
+    }
+    setClass(CLASS_MUL, 3, 1);
+    setClass(CLASS_DIV, 20, 0);
+    setClass(CLASS_FADD, 5, 1);
+    setClass(CLASS_FMUL, 5, 1);
+    setClass(CLASS_FMISC, 2, 1);
+    setOperation(OP_FDIV_S, 10, 0);
+    setOperation(OP_FSQRT_S, 14, 0);
+}
+
+void LatencyTable::setClass(OpClass opClass, int latency, int interval) {
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (op_class(static_cast<Operation>(op)) == opClass) setOperation(static_cast<Operation>(op), latency, interval);
+    }
+}
+
+void LatencyTable::setOperation(Operation op, int latency, int interval) {
+    timing[op] = {latency, interval ? interval : std::max(1, latency)};
+}
+
+LatencyTable read_latency_file(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open latency file: " + filename);
+    }
+
+    LatencyTable table;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::stringstream fields(line);
+        std::string name;
+        if (!(fields >> name)) continue;
+
+        int latency = -1;
+        int interval = 1;
+        std::string field;
+        while (fields >> field) {
+            size_t eq = field.find('=');
+            if (eq == std::string::npos) {
+                throw std::invalid_argument("Latency option needs key=value: " + field);
+            }
+            std::string key = field.substr(0, eq);
+            std::string value = field.substr(eq + 1);
+
+            if (key == "latency") latency = std::stoi(value, nullptr, 0);
+            else if (key == "interval") {
+                interval = std::stoi(value, nullptr, 0);
+                if (interval < 1 || interval > 1000) {
+                    throw std::invalid_argument("Issue interval for " + name + " must be between 1 and 1000.");
+                }
+            }
+            else if (key == "pipelined") interval = (value != "0" && value != "no") ? 1 : 0;
+            else throw std::invalid_argument("Unknown latency option: " + key);
+        }
+        if (latency < 0 || latency > 1000) {
+            throw std::invalid_argument("Latency for " + name + " must be given, between 0 and 1000.");
+        }
+
+        const char* const* found = std::find(OpClassNames, OpClassNames + CLASS_COUNT, name);
+        if (found != OpClassNames + CLASS_COUNT) {
+            table.setClass(static_cast<OpClass>(found - OpClassNames), latency, interval);
+            continue;
+        }
+        int op = 1;
+        while (op < OP_COUNT && name != OperationTable[op].name) op++;
+        if (op == OP_COUNT) throw std::invalid_argument("Unknown class or operation in latency file: " + name);
+        table.setOperation(static_cast<Operation>(op), latency, interval);
+    }
+    return table;
+}
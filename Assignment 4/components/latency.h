@@ -0,0 +1,68 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <cstdint>
+#include <string>
+#include "decoder.h"
+
+// Groups of operations that share a kind of execution unit, and so its timing
+enum OpClass : uint8_t {
+    CLASS_ALU,          // Integer arithmetic, logic, shifts, compares, lui, auipc and vsetvli
+    CLASS_MUL,          // Integer multiplies
+    CLASS_DIV,          // Integer divides and remainders
+    CLASS_BRANCH,       // Branches and jumps
+    CLASS_LOAD,
+    CLASS_STORE,
+    CLASS_FADD,         // FP add and subtract, scalar and vector
+    CLASS_FMUL,         // FP multiply and fused multiply-add, scalar and vector
+    CLASS_FDIV,         // FP divide and square root
+    CLASS_FMISC,        // FP compares, min/max, sign injection, conversions and moves
+    CLASS_SYSTEM,       // CSR access, ecall, ebreak, fence
+    CLASS_COUNT
+};
+
+const char* const OpClassNames[CLASS_COUNT] = {
+    "alu", "mul", "div", "branch", "load", "store", "fadd", "fmul", "fdiv", "fmisc", "system"
+};
+
+OpClass op_class(Operation op);
+
+struct OpTiming {
+    int latency;        // Cycles Execute spends on it after the one it enters in; the scoreboard
+                        // and out-of-order pipelines take at least 1
+    int interval;       // Cycles before its unit takes the next operation: 1 if pipelined
+};
+
+// Execution timing of every operation, looked up by Operation. Loads and stores count
+// their address calculation here; the memory access is timed by the caches and bus.
+class LatencyTable {
+public:
+    // The timing the simulator has always used: 5 cycles for fadd.s, fsub.s, flw and fsw,
+    // 1 for addi, and, or, xori, slli, blt, jal, jalr, lw and sw, nothing extra for the rest.
+    // So add, auipc and the like keep a latency of 0: done in their one legacy Execute cycle,
+    // as every baseline cycle count assumes, and given 1 by the other pipelines anyway.
+    // multiplies take 3 cycles and divides 20 on an unpipelined divider. FP multiplies and
+    // fused multiply-adds take 5 like fadd.s, the other FP operations 2, except fdiv.s (10)
+    // and fsqrt.s (14), which are unpipelined. Vector arithmetic times like its scalar class,
+    // plus a cycle per extra register in an LMUL group. Everything else is pipelined.
+    LatencyTable();
+
+    const OpTiming& operator[](Operation op) const { return timing[op]; }
+
+    // interval 0 makes the unit unpipelined: busy for the whole latency
+    void setClass(OpClass opClass, int latency, int interval);
+    void setOperation(Operation op, int latency, int interval);
+
+private:
+    OpTiming timing[OP_COUNT];
+};
+
+// Read a latency file on top of the built-in table. Each line names a class (alu, mul, div,
+// branch, load, store, fadd, fmul, fdiv, fmisc, system) or a mnemonic (fadd.s, addi, ...)
+// followed by latency=N and optionally pipelined=1|0 or interval=N; # starts a comment.
+// Lines apply in order, so a mnemonic after its class overrides it:
+//     fdiv    latency=18 pipelined=0
+//     fsqrt.s latency=24 pipelined=0
+LatencyTable read_latency_file(const std::string& filename);
+
+#endif // LATENCY_H
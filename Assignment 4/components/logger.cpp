@@ -0,0 +1,28 @@
+#include "logger.h"
+#include <stdexcept>
+
+LogSink::LogSink(std::ostream& out, LogLevel level) : out(&out), current_level(level) {}
+
+void LogSink::set_level(LogLevel level) {
+    current_level = level;
+}
+
+LogLevel LogSink::get_level() const {
+    return current_level;
+}
+
+void LogSink::flush() {
+    if (buffer.tellp() <= 0) return;
+
+    const std::string text = buffer.str();
+    out->write(text.data(), text.size());
+    buffer.str(std::string());
+}
+
+LogLevel parse_log_level(const std::string& name) {
+    if (name == "off") return LOG_OFF;
+    if (name == "summary") return LOG_SUMMARY;
+    if (name == "stage") return LOG_STAGE;
+    if (name == "trace") return LOG_TRACE;
+    throw std::invalid_argument("Unknown log level: " + name);
+}
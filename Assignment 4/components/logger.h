@@ -0,0 +1,56 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <iostream>
+#include <string>
+#include <sstream>
+
+// Verbosity levels, each one includes everything below it
+enum LogLevel {
+    LOG_OFF = 0,
+    LOG_SUMMARY = 1,    // End of run results (cycle counts, CPI)
+    LOG_STAGE = 2,      // One line per pipeline stage per cycle
+    LOG_TRACE = 3       // Disassembly of every decoded instruction
+};
+
+// Highest level compiled in. Release builds (NDEBUG) keep only the summary unless
+// LOG_MAX_LEVEL is given on the command line, so per-cycle logging costs nothing.
+#ifndef LOG_MAX_LEVEL
+#ifdef NDEBUG
+#define LOG_MAX_LEVEL LOG_SUMMARY
+#else
+#define LOG_MAX_LEVEL LOG_TRACE
+#endif
+#endif
+
+// Buffered log output owned by one core (or the simulator); the owner decides when to flush
+class LogSink {
+public:
+    LogSink(std::ostream& out = std::cout, LogLevel level = LOG_TRACE);
+
+    void set_level(LogLevel level);
+    LogLevel get_level() const;
+    bool enabled(LogLevel level) const { return level <= LOG_MAX_LEVEL && level <= current_level; }
+
+    std::ostream& stream() { return buffer; }
+
+    // Write buffered text to the output stream
+    void flush();
+
+private:
+    std::ostream* out;
+    std::ostringstream buffer;
+    LogLevel current_level;
+};
+
+// Log one line; the whole statement is removed when `level` is above LOG_MAX_LEVEL
+#define LOG(sink, level, message)                                       \
+    do {                                                                \
+        if ((level) <= LOG_MAX_LEVEL && (sink).enabled(level)) {        \
+            (sink).stream() << message << '\n';                         \
+        }                                                               \
+    } while (0)
+
+LogLevel parse_log_level(const std::string& name);
+
+#endif // LOGGER_H
@@ -1,59 +1,392 @@
 #include "membus.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+BusConfig parse_bus_config(const std::string& spec, const BusConfig& defaults) {
+    BusConfig config = defaults;
+    std::stringstream fields(spec);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        if (field.empty()) continue;
+        size_t eq = field.find('=');
+        if (eq == std::string::npos) {
+            throw std::invalid_argument("Bus option needs key=value: " + field);
+        }
+        std::string key = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+
+        if (key == "width") config.width = std::stoul(value, nullptr, 0);
+        else if (key == "occupancy") config.occupancy = std::stoul(value, nullptr, 0);
+        else if (key == "policy") {
+            if (value == "rr" || value == "round-robin") config.policy = ARBITRATE_ROUND_ROBIN;
+            else if (value == "fixed") config.policy = ARBITRATE_FIXED;
+            else if (value == "age") config.policy = ARBITRATE_AGE;
+            else throw std::invalid_argument("Unknown arbitration policy: " + value);
+        }
+        else throw std::invalid_argument("Unknown bus option: " + key);
+    }
+    if (config.width == 0 || config.occupancy == 0) {
+        throw std::invalid_argument("Bus width and occupancy must be at least 1.");
+    }
+    return config;
+}
 
 // Constructor to initialize Membus with a reference to RAM
 Membus::Membus(RAM& ramInstance) : ram(ramInstance) {}
 
 // Write method to interact with RAM
-std::vector<uint32_t> Membus::write(int core_id, uint32_t address, uint32_t value, uint32_t added_delay, bool bypass) {
+MemResult Membus::write(int core_id, uint32_t address, uint32_t value, uint32_t added_delay, bool bypass,
+                        const Cache* requester, uint32_t size) {
+    std::unique_lock<std::mutex> guard = lockAddress(address);
+    MemResult result = rawWrite(core_id, address, value, added_delay, bypass, size);
+
+    if (result.status == MEM_DONE && !bypass && (l2 || !caches.empty())) {
+        // Other copies write back and go; the word is then put over whatever they wrote
+        snoopWord(requester, address, BUS_READ_EXCLUSIVE);
+        writeBlock(address, &value, size);
+    }
+    return result;
+}
+
+// Read method to interact with RAM
+MemResult Membus::read(int core_id, uint32_t address, bool bypass, const Cache* requester, uint32_t size) {
+    std::unique_lock<std::mutex> guard = lockAddress(address);
+    MemResult result = rawRead(core_id, address, bypass, size);
+
+    if (result.status == MEM_DONE && !bypass && (l2 || !caches.empty())) {
+        // Modified copies in the caches are newer than RAM
+        snoopWord(requester, address, BUS_READ);
+        readBlock(address, &result.data, size);
+    }
+    return result;
+}
+
+MemResult Membus::rawWrite(int core_id, uint32_t address, uint32_t value, uint32_t added_delay, bool bypass,
+                           uint32_t bytes) {
     // Check if the address is already in use by another core
-    auto it = addressInUse.find(address);
-    if (it != addressInUse.end() && std::get<0>(it->second) != core_id) {
+    const BusOwner* owner = addressInUse.find(address);
+    if (owner && owner->core_id != core_id) {
         // Address is in use by another core, pass the delay and results
-        return {UINT32_MAX, std::get<1>(it->second), std::get<2>(it->second)};  // Return blocked access with delays
+        countBlocked(core_id);
+        return {MEM_BLOCKED, 0, owner->store, owner->load};  // Return blocked access with delays
+    }
+    if (!owner && !bypass && !acquireBus(core_id, address, bytes)) {
+        return {MEM_BLOCKED, 0, 0, 0};
     }
 
-    // Mark the address as in use by this core, initialize delays to 0
-    addressInUse[address] = {core_id, 0, 0}; // Added third element for store and load delay
-
-    // Perform the write operation
-    auto result = ram.write(address, value, added_delay, bypass);
+    // Perform the write operation; a line transfer is timed (and written) as its first word
+    MemResult result = ram.write(address, value, added_delay, bypass, std::min<uint32_t>(bytes, sizeof(value)));
 
     // If bypass or operation completes, release the address
-    if (bypass || result[0] == true) {
+    if (result.status == MEM_DONE) {
         addressInUse.erase(address);
     } else {
-        // Update delays for ongoing operations
-        addressInUse[address] = {core_id, result[1], result[2]};
+        // Mark the address as in use by this core with the delays still to run
+        addressInUse[address] = {core_id, result.storeDelay, result.loadDelay};
     }
 
     return result;
 }
 
-// Read method to interact with RAM
-std::vector<uint32_t> Membus::read(int core_id, uint32_t address, bool bypass) {
+MemResult Membus::rawRead(int core_id, uint32_t address, bool bypass, uint32_t bytes) {
     // Check if the address is already in use by another core
-    auto it = addressInUse.find(address);
-    if (it != addressInUse.end() && std::get<0>(it->second) != core_id) {
+    const BusOwner* owner = addressInUse.find(address);
+    if (owner && owner->core_id != core_id) {
         // Address is in use by another core, pass the delays
-        return {UINT32_MAX-1, std::get<1>(it->second), std::get<2>(it->second)+1};  // Return blocked access with delays
+        countBlocked(core_id);
+        return {MEM_BLOCKED, 0, owner->store, owner->load + 1};  // Return blocked access with delays
     }
-
-    // Mark the address as in use by this core, initialize delays to 0
-    addressInUse[address] = {core_id, 0, 0}; // Added third element for store and load delay
-
-    // Perform the read operation
-    auto result = ram.read(address, bypass);
-
-    // Update delays in `addressInUse` if the read has delays
-    if (result[0] == UINT32_MAX) {
-        addressInUse[address] = {core_id, result[1], result[2]};
+    if (!owner && !bypass && !acquireBus(core_id, address, bytes)) {
+        return {MEM_BLOCKED, 0, 0, 0};
     }
 
+    // Perform the read operation; a line transfer is timed as its first word
+    MemResult result = ram.read(address, bypass, std::min<uint32_t>(bytes, sizeof(uint32_t)));
+
     // If bypass or operation completes, release the address
-    if (bypass || result[0] != UINT32_MAX) {
+    if (result.status == MEM_DONE) {
         addressInUse.erase(address);
+    } else {
+        // Mark the address as in use by this core with the delays still to run
+        addressInUse[address] = {core_id, result.storeDelay, result.loadDelay};
     }
 
     return result;
 }
+
+// Polls of a pending access that only count down; a blocked access has to keep polling
+uint32_t Membus::idleCycles(int core_id, uint32_t address, bool write) const {
+    std::unique_lock<std::mutex> guard = lockAddress(address);
+    const BusOwner* owner = addressInUse.find(address);
+    if (!owner || owner->core_id != core_id) {
+        return 0;
+    }
+    return ram.idleCycles(address, write);
+}
+
+// Same end state as `cycles` calls to read/write that stayed pending
+void Membus::advance(int core_id, uint32_t address, uint32_t cycles, bool write) {
+    if (cycles == 0) return;
+    std::unique_lock<std::mutex> guard = lockAddress(address);
+    ram.advance(address, cycles, write);
+
+    AddressDelay delays = ram.delaysAt(address);
+    addressInUse[address] = {core_id, delays.store, delays.load};
+}
+
+MemResult Membus::lineRead(int core_id, uint32_t base, uint32_t size) {
+    return lineTransfer(core_id, base, false, size);
+}
+
+MemResult Membus::lineWrite(int core_id, uint32_t base, uint32_t size) {
+    return lineTransfer(core_id, base, true, size);
+}
+
+MemResult Membus::lineTransfer(int core_id, uint32_t base, bool write, uint32_t size) {
+    if (!l2) {
+        // One word transaction on the line address times the burst to RAM
+        if (!write) return rawRead(core_id, base, false, size);
+        uint32_t current;
+        ram.readBlock(base, &current, sizeof(current));
+        return rawWrite(core_id, base, current, 0, false, size);
+    }
+
+    const LineTransfer* pending = transfers.find(base);
+    if (pending && pending->core_id != core_id) {
+        countBlocked(core_id);
+        return {MEM_BLOCKED, 0, 0, pending->remaining};
+    }
+    if (!pending && !acquireBus(core_id, base, size)) {
+        return {MEM_BLOCKED, 0, 0, 0};
+    }
+    if (!pending) {
+        // The L2 lookup (and any fill from RAM) happens up front; the L1 waits out its latency
+        uint32_t latency = l2->allocate(base, ram.getDelay());
+        transfers[base] = {core_id, latency};
+    }
+
+    LineTransfer& transfer = *transfers.find(base);
+    if (--transfer.remaining > 0) {
+        return {MEM_PENDING, 0, 0, transfer.remaining};
+    }
+    transfers.erase(base);
+
+    // Keep inclusion if another core's miss evicted the line meanwhile
+    if (!l2->residentData(base)) l2->allocate(base, 0);
+    return {MEM_DONE, 0, 0, 0};
+}
+
+uint32_t Membus::lineIdleCycles(int core_id, uint32_t base, bool write) const {
+    if (!l2) return idleCycles(core_id, base, write);
+
+    const LineTransfer* pending = transfers.find(base);
+    if (!pending || pending->core_id != core_id) return 0;
+    return pending->remaining > 1 ? pending->remaining - 1 : 0;
+}
+
+void Membus::lineAdvance(int core_id, uint32_t base, uint32_t cycles, bool write) {
+    if (cycles == 0) return;
+    if (!l2) {
+        advance(core_id, base, cycles, write);
+        return;
+    }
+    transfers.find(base)->remaining -= cycles;
+}
+
+void Membus::readBlock(uint32_t address, void* out, uint32_t size) const {
+    if (!l2) {
+        ram.readBlock(address, out, size);
+        return;
+    }
+
+    // Split at L2 lines, taking each from the L2 if it is resident there
+    uint8_t* dest = static_cast<uint8_t*>(out);
+    uint32_t lineSize = l2->getConfig().lineSize;
+    while (size > 0) {
+        uint32_t offset = address & (lineSize - 1);
+        uint32_t chunk = std::min(size, lineSize - offset);
+        const uint8_t* line = l2->residentData(address);
+        if (line) {
+            std::memcpy(dest, line + offset, chunk);
+        } else {
+            ram.readBlock(address, dest, chunk);
+        }
+        address += chunk;
+        dest += chunk;
+        size -= chunk;
+    }
+}
+
+void Membus::writeBlock(uint32_t address, const void* in, uint32_t size) {
+    if (!l2) {
+        ram.writeBlock(address, in, size);
+        return;
+    }
+
+    const uint8_t* src = static_cast<const uint8_t*>(in);
+    uint32_t lineSize = l2->getConfig().lineSize;
+    while (size > 0) {
+        uint32_t offset = address & (lineSize - 1);
+        uint32_t chunk = std::min(size, lineSize - offset);
+        uint8_t* line = l2->modifyData(address);
+        if (line) {
+            std::memcpy(line + offset, src, chunk);
+        } else {
+            ram.writeBlock(address, src, chunk);
+        }
+        address += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+}
+
+void Membus::attach(Cache* cache) {
+    if (l2 && cache->getConfig().lineSize != l2->getConfig().lineSize) {
+        throw std::invalid_argument("L1 and L2 line sizes must match.");
+    }
+    caches.push_back(cache);
+}
+
+void Membus::detach(Cache* cache) {
+    caches.erase(std::remove(caches.begin(), caches.end(), cache), caches.end());
+}
+
+bool Membus::snoop(const Cache* requester, uint32_t address, BusRequest request) {
+    bool shared = false;
+    for (Cache* cache : caches) {
+        if (cache != requester && cache->snoop(address, request)) shared = true;
+    }
+    return shared;
+}
+
+// A word access may straddle two lines; both have to be snooped
+void Membus::snoopWord(const Cache* requester, uint32_t address, BusRequest request) {
+    snoop(requester, address, request);
+    snoop(requester, address + 3, request);
+}
+
+void Membus::enableL2(const CacheConfig& config) {
+    CacheConfig shared = config;
+    shared.writeBack = true;
+    shared.writeAllocate = true;
+    for (const Cache* cache : caches) {
+        if (cache->getConfig().lineSize != shared.lineSize) {
+            throw std::invalid_argument("L1 and L2 line sizes must match.");
+        }
+    }
+    l2.reset(new Cache(shared, this, -1, &ram));
+}
+
+void Membus::flushL2() {
+    if (l2) l2->flush();
+}
+
+void Membus::countBlocked(int core_id) {
+    if (core_id < 0) return;
+    if (static_cast<size_t>(core_id) >= blocked.size()) blocked.resize(core_id + 1, 0);
+    blocked[core_id]++;
+}
+
+uint64_t Membus::blockedPolls(int core_id) const {
+    if (core_id < 0 || static_cast<size_t>(core_id) >= blocked.size()) return 0;
+    return blocked[core_id];
+}
+
+void Membus::setConcurrent(bool enabled, size_t cores) {
+    if (enabled && (l2 || !caches.empty() || arbitrated)) {
+        throw std::invalid_argument("Cores with caches or an arbitrated bus cannot use the Membus concurrently.");
+    }
+    concurrent = enabled;
+    // Counters are only ever resized from one thread
+    if (blocked.size() < cores) blocked.resize(cores, 0);
+}
+
+std::unique_lock<std::mutex> Membus::lockAddress(uint32_t address) const {
+    if (!concurrent) return std::unique_lock<std::mutex>();
+    return std::unique_lock<std::mutex>(shardLocks[addressShard(address)]);
+}
+
+void Membus::enableArbiter(const BusConfig& config) {
+    arbitrated = true;
+    busConfig = config;
+}
+
+const BusStats& Membus::busStats(int core_id) const {
+    static const BusStats none;
+    if (core_id < 0 || static_cast<size_t>(core_id) >= stats.size()) return none;
+    return stats[core_id];
+}
+
+bool Membus::acquireBus(int core_id, uint32_t address, uint32_t bytes) {
+    if (!arbitrated) return true;
+    arbitrate();
+
+    size_t i = 0;
+    while (i < waiters.size() && (waiters[i].core_id != core_id || waiters[i].address != address)) i++;
+    if (i == waiters.size()) waiters.push_back({core_id, address, now, now});
+    waiters[i].polled = now;
+    if (i != grant) return false;
+
+    uint64_t wait = now - waiters[i].since;
+    if (static_cast<size_t>(core_id) >= stats.size()) stats.resize(core_id + 1);
+    BusStats& core_stats = stats[core_id];
+    core_stats.grants++;
+    core_stats.waitCycles += wait;
+    core_stats.maxWait = std::max(core_stats.maxWait, wait);
+
+    uint64_t beats = (bytes + busConfig.width - 1) / busConfig.width;
+    busyUntil = now + beats * busConfig.occupancy;
+    busy += beats * busConfig.occupancy;
+    lastGranted = core_id;
+    waiters.erase(waiters.begin() + i);
+    grant = SIZE_MAX;
+    return true;
+}
+
+// Runs on the first bus poll of each cycle and only looks at requests made before it, so
+// the winner does not depend on the order cores poll in. The winner starts its transfer
+// when it polls again this cycle.
+void Membus::arbitrate() {
+    if (decided == now) return;
+    decided = now;
+
+    // A grant not taken up in its cycle belonged to an access that went away
+    if (grant != SIZE_MAX) {
+        waiters.erase(waiters.begin() + grant);
+        grant = SIZE_MAX;
+    }
+    // So did a request that was not polled last cycle
+    waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                 [this](const BusWaiter& w) { return w.polled + 1 < now; }),
+                  waiters.end());
+    if (busyUntil > now) return;
+
+    for (size_t i = 0; i < waiters.size(); i++) {
+        const BusWaiter& w = waiters[i];
+        if (w.since >= now) continue;
+        if (grant == SIZE_MAX) {
+            grant = i;
+            continue;
+        }
+
+        const BusWaiter& best = waiters[grant];
+        bool better = false;
+        switch (busConfig.policy) {
+            case ARBITRATE_FIXED:
+                better = w.core_id < best.core_id;
+                break;
+            case ARBITRATE_AGE:
+                better = w.since < best.since || (w.since == best.since && w.core_id < best.core_id);
+                break;
+            case ARBITRATE_ROUND_ROBIN:
+                // Cores after the last one granted come first, then the rest from core 0
+                better = std::make_pair(w.core_id <= lastGranted, w.core_id) <
+                         std::make_pair(best.core_id <= lastGranted, best.core_id);
+                break;
+        }
+        if (better) grant = i;
+    }
+}
@@ -2,25 +2,160 @@
 #define MEMBUS_H
 
 #include "ram.h"
-#include <unordered_map>
+#include "cache.h"
+#include "addresstable.h"
 #include <vector>
 #include <cstdint>
 #include <set>
+#include <memory>
+#include <mutex>
+#include <array>
+#include <string>
+
+// Core holding an address on the bus, with the delays its transaction last reported
+struct BusOwner {
+    int core_id;
+    uint32_t store;
+    uint32_t load;
+};
+
+// Line transfer between an L1 and the shared L2, counting down its latency
+struct LineTransfer {
+    int core_id;
+    uint32_t remaining;
+};
+
+enum ArbitrationPolicy : uint8_t {
+    ARBITRATE_ROUND_ROBIN,      // The next waiting core after the last one granted
+    ARBITRATE_FIXED,            // Lowest core id first
+    ARBITRATE_AGE               // Longest waiting request first
+};
+
+// Shared bus between the cores and memory. Each new transaction has to win arbitration
+// and then holds the bus for occupancy cycles per width bytes it moves; the memory
+// latency after that overlaps with other transfers (split transactions).
+struct BusConfig {
+    ArbitrationPolicy policy = ARBITRATE_ROUND_ROBIN;
+    uint32_t width = 4;         // Bytes per beat
+    uint32_t occupancy = 1;     // Cycles the bus is held per beat
+};
+
+// Parse "policy=rr|fixed|age,width=4,occupancy=1". Keys may be left out to keep the defaults.
+BusConfig parse_bus_config(const std::string& spec, const BusConfig& defaults = BusConfig());
+
+// Transaction waiting for a bus grant
+struct BusWaiter {
+    int core_id;
+    uint32_t address;
+    uint64_t since;     // Cycle of the first poll
+    uint64_t polled;    // Cycle of the latest poll
+};
+
+struct BusStats {
+    uint64_t grants = 0;
+    uint64_t waitCycles = 0;    // Cycles from first poll to grant, summed over grants
+    uint64_t maxWait = 0;
+};
 
 class Membus {
 public:
     // Constructor: Takes a reference to a RAM instance
     Membus(RAM& ramInstance);
 
-    // Write to memory and return a vector of results
-    std::vector<uint32_t> write(int core_id, uint32_t address, uint32_t value, uint32_t added_delay, bool bypass);
+    // Write the low `size` bytes of value to memory; MEM_BLOCKED if another core holds the address.
+    // Copies in the caches (other than requester's) are invalidated when it completes.
+    MemResult write(int core_id, uint32_t address, uint32_t value, uint32_t added_delay, bool bypass,
+                    const Cache* requester = nullptr, uint32_t size = 4);
+
+    // Read `size` bytes, zero-extended; MEM_BLOCKED if another core holds the address.
+    // Sees modified data still held in the caches.
+    MemResult read(int core_id, uint32_t address, bool bypass, const Cache* requester = nullptr,
+                   uint32_t size = 4);
+
+    // Cycles core_id's pending access to address can count down without being polled
+    uint32_t idleCycles(int core_id, uint32_t address, bool write) const;
 
-    // Read from memory and return a vector of results
-    std::vector<uint32_t> read(int core_id, uint32_t address, bool bypass);
+    // Count core_id's pending access down by `cycles` polls at once
+    void advance(int core_id, uint32_t address, uint32_t cycles, bool write);
+
+    // Timing of a whole-line transfer between an L1 and the next level (the L2, or RAM without one).
+    // Data moves with readBlock/writeBlock once it completes. size is the bytes the bus carries.
+    MemResult lineRead(int core_id, uint32_t base, uint32_t size);
+    MemResult lineWrite(int core_id, uint32_t base, uint32_t size);
+    uint32_t lineIdleCycles(int core_id, uint32_t base, bool write) const;
+    void lineAdvance(int core_id, uint32_t base, uint32_t cycles, bool write);
+
+    // Untimed block moves, through the L2 for lines it holds
+    void readBlock(uint32_t address, void* out, uint32_t size) const;
+    void writeBlock(uint32_t address, const void* in, uint32_t size);
+
+    // L1s snooping the bus
+    void attach(Cache* cache);
+    void detach(Cache* cache);
+
+    // Send a request for the line holding address to every attached cache but requester.
+    // Returns true if any of them keeps a copy.
+    bool snoop(const Cache* requester, uint32_t address, BusRequest request);
+
+    // Shared inclusive L2 between the L1s and RAM; always write-back, write-allocate
+    void enableL2(const CacheConfig& config);
+    const Cache* getL2() const { return l2.get(); }
+
+    // Write the L2's modified lines to RAM (end of run)
+    void flushL2();
+
+    // Polls by core_id that found their address held by another core
+    uint64_t blockedPolls(int core_id) const;
+
+    // Arbitrate new transactions for a bus of limited bandwidth. Without this every core
+    // starts a transaction whenever it polls one, however many others are in flight.
+    void enableArbiter(const BusConfig& config);
+    bool hasArbiter() const { return arbitrated; }
+
+    // Cycle the polls that follow happen in; the arbiter's clock
+    void setCycle(uint64_t cycle) { now = cycle; }
+
+    const BusStats& busStats(int core_id) const;
+    uint64_t busyCycles() const { return busy; }
+
+    // Let up to `cores` cores use read, write, idleCycles and advance from different host
+    // threads at once (only without caches). Each call locks the shard of its address; the
+    // caller keeps two cores off the same bytes in one cycle, so the order they run in doesn't matter.
+    void setConcurrent(bool enabled, size_t cores);
 
 private:
     RAM& ram;  // Reference to RAM object for memory operations
-    std::unordered_map<uint32_t, std::tuple<int, uint32_t, uint32_t>> addressInUse;   // Map to track which core is using which address
+    ShardedAddressTable<BusOwner> addressInUse;   // Addresses with a transaction in flight and the core that owns it
+    std::vector<Cache*> caches;
+    std::unique_ptr<Cache> l2;
+    AddressTable<LineTransfer> transfers;  // L1 line transfers in flight to the L2, keyed by line address
+    std::vector<uint64_t> blocked;         // Blocked polls per core id
+    bool concurrent = false;
+    mutable std::array<std::mutex, ADDRESS_SHARDS> shardLocks;
+
+    std::unique_lock<std::mutex> lockAddress(uint32_t address) const;
+
+    bool arbitrated = false;
+    BusConfig busConfig;
+    uint64_t now = 0;
+    uint64_t decided = UINT64_MAX;          // Last cycle arbitrated
+    uint64_t busyUntil = 0;                 // First cycle the bus is free again
+    uint64_t busy = 0;                      // Cycles the bus has been held
+    int lastGranted = -1;
+    std::vector<BusWaiter> waiters;         // In order of first poll
+    size_t grant = SIZE_MAX;                // Waiter granted the bus for this cycle, if any
+    std::vector<BusStats> stats;            // Per core id
+
+    // True once core_id's new transaction at address holds the bus; polled every cycle until then
+    bool acquireBus(int core_id, uint32_t address, uint32_t bytes);
+    void arbitrate();
+
+    void countBlocked(int core_id);
+    MemResult rawWrite(int core_id, uint32_t address, uint32_t value, uint32_t added_delay, bool bypass,
+                       uint32_t bytes = 4);
+    MemResult rawRead(int core_id, uint32_t address, bool bypass, uint32_t bytes = 4);
+    MemResult lineTransfer(int core_id, uint32_t base, bool write, uint32_t size);
+    void snoopWord(const Cache* requester, uint32_t address, BusRequest request);
 };
 
 #endif // MEMBUS_H
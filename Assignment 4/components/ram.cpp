@@ -1,74 +1,136 @@
 // ram.cpp
 #include "ram.h"
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RAM_MMAP
+#endif
 
 // Constructor: Initializes RAM and sets up specific memory regions
-RAM::RAM() {
-    std::memset(memory, 0, RAM_SIZE);   // Initialize RAM with zeroes
-    initializeMemoryRegions();          // Initialize arrays with random FP32 values
-    initializeAddressDelays();
+RAM::RAM(const MemoryLayout& layout) : layout(layout) {
+    if (layout.size == 0 || layout.size > (uint64_t(1) << 32)) {
+        throw std::invalid_argument("RAM size must be between 1 byte and 4 GiB.");
+    }
+    if (uint64_t(layout.array(0)) + 4 * uint64_t(layout.arrayBytes) > layout.size) {
+        throw std::invalid_argument("Arrays do not fit in RAM.");
+    }
+    initializeMemoryRegions();          // Initialize arrays from their files or with random FP32 values
     read_write_delay = 2;
 }
 
-// Read a 32-bit word from RAM with simulated latency
-std::vector<uint32_t> RAM::read(uint32_t address, bool bypass) {
-    if (address + 4 > RAM_SIZE) {
-        throw std::out_of_range("RAM read out of bounds.");
+RAM::~RAM() {
+#if defined(RAM_MMAP)
+    for (const Mapping& mapping : mappings) {
+        munmap(mapping.base, mapping.bytes);
     }
+#endif
+}
 
-    std::vector<uint32_t> output;
+void RAM::checkBounds(uint32_t address, const char* message, uint32_t size) const {
+    if (uint64_t(address) + size > layout.size) {
+        throw std::out_of_range(message);
+    }
+}
+
+const uint8_t* RAM::findPage(uint32_t address) const {
+    const std::unique_ptr<PageTable>& table = directory[address >> (PAGE_BITS + TABLE_BITS)];
+    if (!table) return nullptr;
+    return (*table)[(address >> PAGE_BITS) & ((1u << TABLE_BITS) - 1)];
+}
+
+uint8_t*& RAM::pageEntry(uint32_t address) {
+    std::unique_ptr<PageTable>& table = directory[address >> (PAGE_BITS + TABLE_BITS)];
+    if (!table) table.reset(new PageTable());
+    return (*table)[(address >> PAGE_BITS) & ((1u << TABLE_BITS) - 1)];
+}
+
+uint8_t* RAM::touchPage(uint32_t address) {
+    uint8_t*& page = pageEntry(address);
+    if (!page) {
+        heapPages.emplace_back(new Page());
+        heapPages.back()->fill(0);
+        page = heapPages.back()->data();
+        pageCount++;
+    }
+    return page;
+}
+
+// Untouched pages read as zero
+void RAM::load(uint32_t address, void* out, uint32_t size) const {
+    uint8_t* dst = static_cast<uint8_t*>(out);
+    while (size > 0) {
+        uint32_t offset = address & (PAGE_SIZE - 1);
+        uint32_t chunk = std::min(size, PAGE_SIZE - offset);
+        const uint8_t* page = findPage(address);
+        if (page) {
+            std::memcpy(dst, page + offset, chunk);
+        } else {
+            std::memset(dst, 0, chunk);
+        }
+        address += chunk;
+        dst += chunk;
+        size -= chunk;
+    }
+}
+
+void RAM::store(uint32_t address, const void* in, uint32_t size) {
+    const uint8_t* src = static_cast<const uint8_t*>(in);
+    while (size > 0) {
+        uint32_t offset = address & (PAGE_SIZE - 1);
+        uint32_t chunk = std::min(size, PAGE_SIZE - offset);
+        std::memcpy(touchPage(address) + offset, src, chunk);
+        address += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+}
+
+// Read a 32-bit word from RAM with simulated latency
+MemResult RAM::read(uint32_t address, bool bypass, uint32_t size) {
+    checkBounds(address, "RAM read out of bounds.", size);
 
     if (bypass){
-        uint32_t value;
-        std::memcpy(&value, &memory[address], sizeof(value));
-        output = {value};
-        return output; // Operation completed
+        uint32_t value = 0;
+        load(address, &value, size);
+        return {MEM_DONE, value, 0, 0}; // Operation completed
     }
 
     AddressDelay& delays = addressDelays[address]; // Get or create delays for the address
 
-    // First, handle the store delay
+    // First, wait for a pending store to the same address
     if (delays.store > 0) {
-        // Decrement store delay
-        output = {UINT32_MAX, delays.store, delays.load};
-        return output; // Operation pending
+        return {MEM_PENDING, 0, delays.store, delays.load}; // Operation pending
     }
 
     // Then, handle the load delay
     if (delays.load == 0) {
         // Set initial load delay
-        delays.load = read_write_delay; // Subtract 1 because we'll decrement it now
-        output = {UINT32_MAX, delays.store, delays.load};
-        return output; // Operation pending
+        delays.load = read_write_delay;
+        return {MEM_PENDING, 0, delays.store, delays.load}; // Operation pending
     } else if (delays.load > 1) {
         // Decrement load delay
         delays.load--;
-        output = {UINT32_MAX, delays.store, delays.load};
-        return output; // Operation pending
-    } else if (delays.load == 1) {
-        // Decrement load delay to zero and perform read
-        delays.load = 0;
-        uint32_t value;
-        std::memcpy(&value, &memory[address], sizeof(value));
-        output = {value, delays.store, delays.load};
-        return output; // Operation completed
+        return {MEM_PENDING, 0, delays.store, delays.load}; // Operation pending
     }
 
-    // Should not reach here
-    return output;
+    // Decrement load delay to zero and perform read
+    uint32_t value = 0;
+    load(address, &value, size);
+    addressDelays.erase(address); // No store is pending either, so nothing is left in flight
+    return {MEM_DONE, value, 0, 0}; // Operation completed
 }
 
 // Write a 32-bit word to RAM with simulated latency
-std::vector<uint32_t> RAM::write(uint32_t address, uint32_t value, uint32_t added_delay, bool bypass) {
-    if (address + 4 > RAM_SIZE) {
-        throw std::out_of_range("RAM write out of bounds.");
-    }
-
-    std::vector<uint32_t> output;
+MemResult RAM::write(uint32_t address, uint32_t value, uint32_t added_delay, bool bypass, uint32_t size) {
+    checkBounds(address, "RAM write out of bounds.", size);
 
     if (bypass){
-        std::memcpy(&memory[address], &value, sizeof(value));
-        output = {true};
-        return output; // Operation completed
+        store(address, &value, size);
+        notifyWrite(address, size);
+        return {MEM_DONE, 0, 0, 0}; // Operation completed
     }
 
     AddressDelay& delays = addressDelays[address]; // Get or create delays for the address
@@ -77,31 +139,155 @@ std::vector<uint32_t> RAM::write(uint32_t address, uint32_t value, uint32_t adde
     if (delays.store == 0) {
         // Set initial store delay
         delays.store = read_write_delay + added_delay; 
-        output = {false, delays.store};
-        return output; // Operation pending
+        return {MEM_PENDING, 0, delays.store, delays.load}; // Operation pending
     } else if (delays.store > 1) {
         // Decrement store delay
         delays.store--;
-        output = {false, delays.store};
-        return output; // Operation pending
-    } else if (delays.store == 1) {
-        // Decrement store delay to zero and perform write
-        delays.store = 0;
-        std::memcpy(&memory[address], &value, sizeof(value));
-        output = {true, delays.store};
-        return output; // Operation completed
+        return {MEM_PENDING, 0, delays.store, delays.load}; // Operation pending
     }
 
-    // Should not reach here
-    return output;
+    // Decrement store delay to zero and perform write
+    delays.store = 0;
+    uint32_t load_delay = delays.load;
+    if (load_delay == 0) addressDelays.erase(address);
+    store(address, &value, size);
+    notifyWrite(address, size);
+    return {MEM_DONE, 0, 0, load_delay}; // Operation completed
+}
+
+// Polls that would only decrement the delay of a pending transaction at address
+uint32_t RAM::idleCycles(uint32_t address, bool write) const {
+    const AddressDelay* pending = addressDelays.find(address);
+    if (!pending) return 0;
+
+    const AddressDelay& delays = *pending;
+    if (write) {
+        return delays.store > 1 ? delays.store - 1 : 0;
+    }
+    // A read behind a pending store waits on the store, not on its own delay
+    if (delays.store > 0) return 0;
+    return delays.load > 1 ? delays.load - 1 : 0;
+}
+
+// Skip ahead `cycles` polls, never further than idleCycles allows
+void RAM::advance(uint32_t address, uint32_t cycles, bool write) {
+    AddressDelay& delays = addressDelays[address];
+    if (write) {
+        delays.store -= cycles;
+    } else {
+        delays.load -= cycles;
+    }
+}
+
+// Current delays of address; zero when nothing is in flight there
+AddressDelay RAM::delaysAt(uint32_t address) const {
+    const AddressDelay* pending = addressDelays.find(address);
+    return pending ? *pending : AddressDelay();
+}
+
+void RAM::reserve(uint32_t address, uint32_t size) {
+    uint64_t end = std::min<uint64_t>(static_cast<uint64_t>(address) + size, layout.size);
+    for (uint64_t page = address & ~(PAGE_SIZE - 1); page < end; page += PAGE_SIZE) {
+        touchPage(static_cast<uint32_t>(page));
+    }
+}
+
+void RAM::readBlock(uint32_t address, void* out, uint32_t size) const {
+    checkBounds(address, "RAM block read out of bounds.", size);
+    load(address, out, size);
+}
+
+void RAM::writeBlock(uint32_t address, const void* in, uint32_t size) {
+    checkBounds(address, "RAM block write out of bounds.", size);
+    store(address, in, size);
+    notifyWrite(address, size);
+}
+
+void RAM::mapFile(uint32_t address, const std::string& filename, uint64_t offset, uint32_t size) {
+    checkBounds(address, "File image does not fit in RAM.", size);
+    if (size == 0) return;
+
+#if defined(RAM_MMAP)
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || uint64_t(info.st_size) < offset + size) {
+        close(fd);
+        throw std::runtime_error("Error reading from file: " + filename);
+    }
+
+    // Map from the host page holding offset; guest pages only alias it when PAGE_SIZE is the
+    // host page size, or a guest page could straddle two host pages
+    uint64_t hostPage = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t start = offset / hostPage * hostPage;
+    size_t bytes = static_cast<size_t>(offset + size - start);
+    void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(start));
+    close(fd);
+    if (base == MAP_FAILED) {
+        throw std::runtime_error("Could not map file: " + filename);
+    }
+    bool aliasable = hostPage == PAGE_SIZE && (address & (PAGE_SIZE - 1)) == (offset & (PAGE_SIZE - 1));
+
+    uint8_t* src = static_cast<uint8_t*>(base) + (offset - start);
+    uint32_t at = address;
+    uint32_t left = size;
+    bool aliased = false;
+    while (left > 0) {
+        uint32_t within = at & (PAGE_SIZE - 1);
+        uint32_t chunk = std::min(left, PAGE_SIZE - within);
+        uint8_t*& page = pageEntry(at);
+        if (aliasable && chunk == PAGE_SIZE && !page) {
+            page = src;
+            pageCount++;
+            aliased = true;
+        } else {
+            std::memcpy(touchPage(at) + within, src, chunk);
+        }
+        at += chunk;
+        src += chunk;
+        left -= chunk;
+    }
+    // Keep the mapping only while guest pages point into it
+    if (aliased) {
+        mappings.push_back({base, bytes});
+    } else {
+        munmap(base, bytes);
+    }
+#else
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    std::vector<char> bytes(size);
+    file.seekg(offset);
+    if (!file.read(bytes.data(), size)) {
+        throw std::runtime_error("Error reading from file: " + filename);
+    }
+    store(address, bytes.data(), size);
+#endif
+    notifyWrite(address, size);
+}
+
+// Register a callback for completed writes inside [start, end]
+void RAM::watchWrites(uint32_t start, uint32_t end, std::function<void(uint32_t, uint32_t)> onWrite) {
+    writeWatches.push_back({start, end, onWrite});
+}
+
+void RAM::notifyWrite(uint32_t address, uint32_t size) {
+    for (auto& watch : writeWatches) {
+        if (address <= watch.end && address + size > watch.start) {
+            watch.onWrite(address, size);
+        }
+    }
 }
 
-// Print memory contents for debugging
 // Print memory contents for debugging
 void RAM::print(uint32_t start, uint32_t end) const {
     for (uint32_t i = start; i < end; i += 4) {
         uint32_t intValue;
-        std::memcpy(&intValue, &memory[i], sizeof(intValue));
+        load(i, &intValue, sizeof(intValue));
 
         float floatValue;
         std::memcpy(&floatValue, &intValue, sizeof(floatValue));
@@ -112,31 +298,31 @@ void RAM::print(uint32_t start, uint32_t end) const {
 }
 
 void RAM::printMath() {
-    constexpr uint32_t arrayASize = 0x400; // Size of each array in bytes
+    const uint32_t arrayASize = layout.arrayBytes; // Size of each array in bytes
     constexpr uint32_t elementSize = 4;   // Size of each element (FP32)
 
     // Iterate over the arrays and print calculations
     for (uint32_t i = 0; i < arrayASize / elementSize; ++i) {
-        uint32_t addressA = 0x400 + i * elementSize;
-        uint32_t addressB = 0x800 + i * elementSize;
-        uint32_t addressC = 0xC00 + i * elementSize;
-        uint32_t addressD = 0x1000 + i * elementSize;
+        uint32_t addressA = layout.array(0) + i * elementSize;
+        uint32_t addressB = layout.array(1) + i * elementSize;
+        uint32_t addressC = layout.array(2) + i * elementSize;
+        uint32_t addressD = layout.array(3) + i * elementSize;
 
         float valueA, valueB, valueC, valueD;
 
         // Read values from RAM
-        std::memcpy(&valueA, &memory[addressA], sizeof(valueA));
-        std::memcpy(&valueB, &memory[addressB], sizeof(valueB));
-        std::memcpy(&valueC, &memory[addressC], sizeof(valueC));
-        std::memcpy(&valueD, &memory[addressD], sizeof(valueD));
+        load(addressA, &valueA, sizeof(valueA));
+        load(addressB, &valueB, sizeof(valueB));
+        load(addressC, &valueC, sizeof(valueC));
+        load(addressD, &valueD, sizeof(valueD));
 
         // Print addition
         std::cout << "Array_A[" << i << "] + Array_B[" << i << "] = Array_C[" << i << "] | "
-                  << valueA << " + " << valueB << " = " << valueC << std::endl;
+                  << valueA << " + " << valueB << " = " << valueC << '\n';
 
         // Print subtraction
         std::cout << "Array_A[" << i << "] - Array_B[" << i << "] = Array_D[" << i << "] | "
-                  << valueA << " - " << valueB << " = " << valueD << std::endl;
+                  << valueA << " - " << valueB << " = " << valueD << '\n';
     }
 }
 
@@ -145,42 +331,30 @@ void RAM::initializeMemoryRegions() {
     // Seed the random number generator for reproducibility
     std::srand(static_cast<unsigned>(std::time(nullptr)));
 
-    // Helper lambda to generate constrained random FP32 values
+    // Helper lambda to generate random FP32 values
     auto generateRandomFP32 = []() -> float {
-        float randomValue;
-        uint32_t intValue;
-
-        do {
-            randomValue = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX); // Scale to [0.0, 1.0]
-            std::memcpy(&intValue, &randomValue, sizeof(intValue)); // Convert FP32 to uint32_t
-        } while (intValue == UINT32_MAX || intValue == UINT32_MAX - 1); // Regenerate if prohibited values
-
-        return randomValue;
+        return static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX); // Scale to [0.0, 1.0]
     };
 
-    // Initialize ARRAY_A (0x400 - 0x7FF) with random FP32 values in [0.0, 1.0]
-    for (uint32_t address = 0x400; address < 0x800; address += 4) {
-        float randomValue = generateRandomFP32();
-        uint32_t value;
-        std::memcpy(&value, &randomValue, sizeof(value)); // Convert FP32 to uint32_t
-        write(address, value, 0, true);
-    }
-
-    // Initialize ARRAY_B (0x800 - 0xBFF) with random FP32 values in [0.0, 1.0]
-    for (uint32_t address = 0x800; address < 0xC00; address += 4) {
-        float randomValue = generateRandomFP32();
-        uint32_t value;
-        std::memcpy(&value, &randomValue, sizeof(value)); // Convert FP32 to uint32_t
-        write(address, value, 0, true);
-    }
-}
+    // ARRAY_A (0x400 - 0x7FF by default) and ARRAY_B (0x800 - 0xBFF) come from their files if
+    // given, else hold random FP32 values in [0.0, 1.0], built up and stored in one block
+    std::vector<float> values(layout.arrayBytes / 4);
+    for (int i = 0; i < 2; i++) {
+        const std::string& filename = layout.arrayFiles[i];
+        if (filename.empty()) {
+            for (float& value : values) value = generateRandomFP32();
+            store(layout.array(i), values.data(), values.size() * 4);
+            continue;
+        }
 
-// Initialize addressDelays for all addresses to zero
-void RAM::initializeAddressDelays() {
-    for (uint32_t address = 0; address < RAM_SIZE; address += 4) {
-        AddressDelay& delays = addressDelays[address];
-        delays.store = 0;
-        delays.load = 0;
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open array file: " + filename);
+        }
+        uint64_t fileBytes = static_cast<uint64_t>(file.tellg());
+        if (fileBytes > layout.arrayBytes) {
+            throw std::invalid_argument("Array file is larger than the array: " + filename);
+        }
+        mapFile(layout.array(i), filename, 0, static_cast<uint32_t>(fileBytes));
     }
-    std::cout << "AddressDelays initialized for all addresses." << std::endl;
 }
@@ -9,7 +9,46 @@
 #include <cstring>    // for std::memcpy
 #include <climits>
 #include <ctime>
-#include <map>
+#include "addresstable.h"
+#include <functional>
+#include <memory>
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+// Callback for completed writes that land inside a watched address range
+struct WriteWatch {
+    uint32_t start;
+    uint32_t end;
+    std::function<void(uint32_t address, uint32_t size)> onWrite;
+};
+
+// Outcome of one poll of a memory transaction
+enum MemStatus : uint8_t {
+    MEM_DONE,       // Completed this call; data holds the word for reads
+    MEM_PENDING,    // Still counting down, poll again next cycle
+    MEM_BLOCKED     // Address held by another core on the bus
+};
+
+struct MemResult {
+    MemStatus status;
+    uint32_t data;
+    uint32_t storeDelay;    // Store delay still to run at the address
+    uint32_t loadDelay;     // Load delay still to run at the address
+};
+
+// Guest memory size and where the benchmark arrays live
+struct MemoryLayout {
+    uint64_t size = 0x1400;         // Bytes of guest address space, up to the full 4 GiB
+    uint32_t arrayBase = 0x400;     // ARRAY_A; B, C and D follow back to back
+    uint32_t arrayBytes = 0x400;    // Size of each array
+    // Raw little-endian FP32 files for ARRAY_A and ARRAY_B; random values in [0, 1] when empty.
+    // A shorter file leaves the rest of its array zero.
+    std::string arrayFiles[2];
+
+    uint32_t array(int index) const { return arrayBase + index * arrayBytes; }
+};
 
 struct AddressDelay {
     uint32_t load;
@@ -18,35 +57,103 @@ struct AddressDelay {
 
 class RAM {
 public:
-    static const uint32_t RAM_SIZE = 0x1400;  // Size of RAM
     static const int READ_LATENCY = 20;       // RAM read latency in simulation ticks
     static const int WRITE_LATENCY = 20;      // RAM write latency in simulation ticks
 
-    RAM();
+    // Storage is a two-level table of 4 KiB pages, allocated when first written
+    static const uint32_t PAGE_BITS = 12;
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    static const uint32_t TABLE_BITS = 10;    // Address bits indexed by each table level
+
+    RAM(const MemoryLayout& layout = MemoryLayout());
+    ~RAM();
+
+    RAM(const RAM&) = delete;
+    RAM& operator=(const RAM&) = delete;
+
+    const MemoryLayout& getLayout() const { return layout; }
+
+    // Number of pages backed by host memory
+    size_t allocatedPages() const { return pageCount; }
+
+    // Read a 32-bit word (or its low `size` bytes, zero-extended) from RAM with simulated latency
+    MemResult read(uint32_t address, bool bypass, uint32_t size = 4);
 
-    // Map to keep track of delays per address
-    std::map<uint32_t, AddressDelay> addressDelays;
+    // Write a 32-bit word (or its low `size` bytes) to RAM with simulated latency
+    MemResult write(uint32_t address, uint32_t value, uint32_t added_delay, bool bypass, uint32_t size = 4);
 
-    // Read a 32-bit word from RAM with simulated latency
-    std::vector<uint32_t> read(uint32_t address, bool bypass);
+    // Polls a pending transaction at address can take while only counting down (0 when the next poll starts, completes or is blocked)
+    uint32_t idleCycles(uint32_t address, bool write) const;
 
-    // Write a 32-bit word to RAM with simulated latency
-    std::vector<uint32_t> write(uint32_t address, uint32_t value, uint32_t added_delay, bool bypass);
+    // Apply `cycles` counting-down polls to a pending transaction in one step
+    void advance(uint32_t address, uint32_t cycles, bool write);
+
+    AddressDelay delaysAt(uint32_t address) const;
+
+    // Cycles a word transaction takes when nothing else is in flight at its address
+    uint32_t getDelay() const { return read_write_delay; }
+
+    // Untimed block copies for cache line fills and write-backs
+    void readBlock(uint32_t address, void* out, uint32_t size) const;
+    void writeBlock(uint32_t address, const void* in, uint32_t size);
+
+    // Put size bytes of a file, from offset, at address without a timed write. Whole pages that
+    // are still unallocated and sit at the same offset within a page in the file and in guest
+    // memory become private copy-on-write mappings of the file, so big images cost nothing
+    // until touched and share the host page cache; the rest is copied.
+    void mapFile(uint32_t address, const std::string& filename, uint64_t offset, uint32_t size);
+
+    // Back [address, address + size) with host pages now, so that a later write there doesn't
+    // allocate while other threads read memory. Bytes past the end of guest memory are ignored.
+    void reserve(uint32_t address, uint32_t size);
 
     // Print memory contents for debugging
     void print(uint32_t start, uint32_t end) const;
 
     void printMath();
 
+    // Notify onWrite whenever a completed write touches [start, end]
+    void watchWrites(uint32_t start, uint32_t end, std::function<void(uint32_t, uint32_t)> onWrite);
+
 private:
-    uint8_t memory[RAM_SIZE];  // RAM storage array
+    typedef std::array<uint8_t, PAGE_SIZE> Page;
+    typedef std::array<uint8_t*, 1u << TABLE_BITS> PageTable;
+
+    // A file region mapped into the host address space; its pages may back guest pages
+    struct Mapping {
+        void* base;
+        size_t bytes;
+    };
+
+    MemoryLayout layout;
+    // Page entries point either into heapPages or into a mapping
+    std::array<std::unique_ptr<PageTable>, 1u << TABLE_BITS> directory;
+    std::vector<std::unique_ptr<Page>> heapPages;
+    std::vector<Mapping> mappings;
+    size_t pageCount = 0;
 
     int read_write_delay;
 
+    // Delays of in-flight transactions, keyed by address
+    ShardedAddressTable<AddressDelay> addressDelays;
+
+    std::vector<WriteWatch> writeWatches;
+
+    void notifyWrite(uint32_t address, uint32_t size);
+
+    // Page holding address, or nullptr if it was never written
+    const uint8_t* findPage(uint32_t address) const;
+    uint8_t* touchPage(uint32_t address);
+    uint8_t*& pageEntry(uint32_t address);
+
+    // Copy guest bytes in or out, splitting at page boundaries
+    void load(uint32_t address, void* out, uint32_t size) const;
+    void store(uint32_t address, const void* in, uint32_t size);
+
+    void checkBounds(uint32_t address, const char* message, uint32_t size = 4) const;
+
     // Initialize specific memory regions as per specifications
     void initializeMemoryRegions();
-    
-    void initializeAddressDelays();
 };
 
 #endif // RAM_H
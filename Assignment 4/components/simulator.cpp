@@ -1,40 +1,96 @@
 #include "simulator.h"
 #include <iostream>
 #include <fstream>
+#include <queue>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
 
-Simulator::Simulator(int num_runs)
-    : clock_cycle_limit(num_runs), membus(ram) {
+Simulator::Simulator(int num_runs, const MemoryLayout& layout)
+    : ram(layout), membus(ram), clock_cycle_limit(num_runs), event_driven(true) {
 }
 
 void Simulator::add_core(Core* core) {
     core->set_membus(&membus);
+    core->log.set_level(log.get_level());
+    core->set_isa(isa);
+    core->set_pipeline(pipeline);
+    core->set_latency_table(latencies);
+    core->set_vlen(vlen);
+    core->enable_caches(use_icache ? &icache_config : nullptr, use_dcache ? &dcache_config : nullptr);
+    core->enable_branch_prediction(use_bpred ? &bpred_config : nullptr);
     cores.push_back(core);
 }
 
+Core* Simulator::create_core(const CoreConfig& config) {
+    if (config.load_address % 4 != 0) {
+        throw std::invalid_argument("Core load address must be word aligned: " + config.program);
+    }
+
+    Core* core = new Core(config.load_address, static_cast<int>(cores.size()), config.stack_pointer);
+    owned_cores.emplace_back(core);
+    add_core(core);
+    load_instructions_from_binary(core, config.program, config.load_address);
+    return core;
+}
+
+// An ELF executable goes where it was linked; anything else is a raw image of whole words
+// loaded at start_address and run from its first word. Either way the file is mapped into RAM
+// (see RAM::mapFile) rather than written a word at a time over the bus.
 void Simulator::load_instructions_from_binary(Core* core, const std::string& filename, uint32_t start_address) {
-    std::ifstream infile(filename, std::ios::binary);
+    if (is_elf_file(filename)) {
+        // Compiled code uses the standard branch and immediate encodings, whatever dialect
+        // the raw images on other cores are written in
+        core->set_isa(ISA_STANDARD);
+        load_elf(core, filename);
+        return;
+    }
+
+    std::ifstream infile(filename, std::ios::binary | std::ios::ate);
     if (!infile.is_open()) {
         throw std::runtime_error("Could not open binary file: " + filename);
     }
+    // A trailing partial word is dropped
+    uint64_t fileBytes = static_cast<uint64_t>(infile.tellg());
+    if (fileBytes > UINT32_MAX) {
+        throw std::invalid_argument("Binary file is larger than guest memory: " + filename);
+    }
+    uint32_t size = static_cast<uint32_t>(fileBytes) / 4 * 4;
 
-    uint32_t address = start_address;
+    ram.mapFile(start_address, filename, 0, size);
+    start_program(core, start_address, start_address + size, start_address);
+}
 
-    while (infile.peek() != std::ifstream::traits_type::eof()) {
-        uint32_t instruction;
-        infile.read(reinterpret_cast<char*>(&instruction), sizeof(instruction));
+void Simulator::load_elf(Core* core, const std::string& filename) {
+    ElfImage elf = read_elf(filename);
 
-        if (!infile) {
-            if (infile.eof()) break;
-            throw std::runtime_error("Error reading from binary file: " + filename);
+    for (const ElfSegment& segment : elf.segments) {
+        // File contents (.text, .data), then zeros for the rest (.bss)
+        ram.mapFile(segment.address, filename, segment.fileOffset, segment.fileBytes);
+        if (segment.memoryBytes > segment.fileBytes) {
+            std::vector<char> zeros(segment.memoryBytes - segment.fileBytes, 0);
+            ram.writeBlock(segment.address + segment.fileBytes, zeros.data(), zeros.size());
         }
-
-        membus.write(core->core_id, address, instruction, 0, true); // ram.write(address, instruction, 0, true);
-        address += 4;
     }
-    core->start_address = start_address;
-    core->max_instruction_address = address - 4;
 
-    infile.close();
+    core->symbols = elf.symbols;
+    start_program(core, elf.textStart(), static_cast<uint32_t>(elf.textEnd()), elf.entry);
+}
+
+// Point the core at the code in [start, end), starting at entry
+void Simulator::start_program(Core* core, uint32_t start, uint32_t end, uint32_t entry) {
+    core->pc = entry;
+    core->start_address = start;
+    core->max_instruction_address = end - 4;
+    core->init_decode_cache();
+
+    // A standard program returns from main: point ra just past the image so that halts
+    if (core->get_isa() == ISA_STANDARD) core->write_x(1, end);
+
+    // Self-modifying stores must not execute stale decodes
+    ram.watchWrites(start, end - 1, [core](uint32_t addr, uint32_t size) {
+        core->invalidate_decoded(addr, size);
+    });
 }
 
 RAM* Simulator::get_ram() {
@@ -45,56 +101,327 @@ Membus* Simulator::get_membus() {
     return &membus;
 }
 
+void Simulator::set_log_level(LogLevel level) {
+    log.set_level(level);
+    for (auto core : cores) {
+        core->log.set_level(level);
+    }
+}
+
+// Skipping idle cycles is only possible when nothing is printed per cycle
 void Simulator::run() {
-    int clock_cycle = 0;
-    std::map<Core*, int> core_instruction_counts; // To track instruction counts for each core
-    std::map<Core*, int> core_clock_cycles;      // To track clock cycles for each core
+    // Standard programs find their hart id in a0 and the hart count in a1, as after a boot loader
+    for (size_t i = 0; i < cores.size(); i++) {
+        if (cores[i]->get_isa() != ISA_STANDARD) continue;
+        cores[i]->write_x(10, static_cast<uint32_t>(i));
+        cores[i]->write_x(11, static_cast<uint32_t>(cores.size()));
+    }
+
+    int completed_cycle = (event_driven && !log.enabled(LOG_STAGE)) ? run_events() : run_cycles();
 
-    // Initialize instruction counts and clock cycles for each core
     for (auto core : cores) {
-        core_instruction_counts[core] = 0; // Assume you have a way to get initial instruction counts
-        core_clock_cycles[core] = 0;
+        core->flush_caches();
     }
+    membus.flushL2();
+    if (completed_cycle) print_summary(completed_cycle);
+}
+
+// Clock every active core once per cycle
+int Simulator::run_cycles() {
+    int clock_cycle = 0;
 
     while (true) {
         clock_cycle++;
+        membus.setCycle(clock_cycle);
 
-        std::cout << "Cycle " << clock_cycle << "\n";
+        LOG(log, LOG_STAGE, "Cycle " << clock_cycle);
         // std::cout << "--------------------------------------------------" << std::endl;
 
         bool all_cores_completed = true;
         for (auto core : cores) {
             if (!core->is_complete()) {
-                std::cout << "--------------------------------------------------" << std::endl;
-                std::cout << "CORE " << core->core_id << std::endl;
-                std::cout << "--------------------------------------------------" << std::endl;
-                core->store();
-                core->execute();
-                core->decode();
-                core->fetch();
+                LOG(log, LOG_STAGE, "--------------------------------------------------");
+                LOG(log, LOG_STAGE, "CORE " << core->core_id);
+                LOG(log, LOG_STAGE, "--------------------------------------------------");
+                log.flush();
+                core->tick();
+                core->log.flush();
                 all_cores_completed = false;
-                core_clock_cycles[core]++; // Increment clock cycle count for the core
             }
         }
 
-        std::cout << "--------------------------------------------------" << std::endl;
+        LOG(log, LOG_STAGE, "--------------------------------------------------");
+        log.flush();
 
-        if (clock_cycle_limit != 0 && clock_cycle >= clock_cycle_limit) break;
+        if (clock_cycle_limit != 0 && clock_cycle >= clock_cycle_limit) return 0;
 
-        if (all_cores_completed) {
-            std::cout << "Simulation completed at clock cycle: " << clock_cycle << std::endl;
+        if (all_cores_completed) return clock_cycle;
+    }
+}
+
+// Fewer cores than this due in a cycle tick on the calling thread: handing a
+// batch to the pool costs more than a few ticks
+const size_t PARALLEL_MIN_CORES = 8;
+
+// Discrete-event version of run_cycles. Each core is woken only at the next cycle in
+// which it has work (a delay running out, a memory access starting or finishing);
+// the idle cycles in between are applied in one step when it wakes. Cores due in the
+// same cycle wake in core order, so results and cycle counts match run_cycles exactly.
+//
+// With a thread pool the cores due in a cycle tick on different host threads whenever
+// independent() shows that the order they tick in cannot matter; the pool returning
+// is the barrier before the next cycle. Cores never run ahead of that barrier: a core
+// ticking past the others would have to be rolled back whenever it turned out to touch
+// what they touch, and the kernel keeps no checkpoints.
+int Simulator::run_events() {
+    typedef std::pair<int, size_t> Wakeup;     // (cycle, core index)
+    std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>> wakeups;
+    std::vector<int> last_tick(cores.size(), 0);
+    std::vector<int> idle(cores.size(), 0);
+    std::vector<size_t> due;
 
-            // Calculate and print CPI for each core
-            for (auto core : cores) {
-                int instructions = core->instruction_count;
-                int cycles = core_clock_cycles[core];
-                double cpi = instructions > 0 ? static_cast<double>(cycles) / instructions : 0.0;
+    for (size_t i = 0; i < cores.size(); i++) {
+        if (!cores[i]->is_complete()) wakeups.push({1, i});
+    }
 
-                std::cout << "Core " << core->core_id << " completed at clock cycle: " << cycles << std::endl;
-                std::cout << "Instruction count: " << instructions << std::endl;
-                std::cout << "Average CPI: " << cpi << std::endl;
+    // With caches, an L2 or the arbiter, every Membus access can reach state the cores share
+    // (snoops, the L2's lines, the arbiter's queue), so then only cycles in which each due
+    // core stays inside its own L1s go parallel
+    bool parallel = pool != nullptr;
+    bus_shared = membus.getL2() != nullptr || membus.hasArbiter();
+    for (auto core : cores) {
+        if (core->get_icache() || core->get_dcache()) bus_shared = true;
+    }
+    if (parallel) {
+        images.clear();
+        for (auto core : cores) {
+            images.push_back({core->start_address, uint64_t(core->max_instruction_address) + 4});
+        }
+        std::sort(images.begin(), images.end());
+        size_t merged = 0;
+        for (size_t i = 1; i < images.size(); i++) {
+            if (images[i].first <= images[merged].second) {
+                images[merged].second = std::max(images[merged].second, images[i].second);
+            } else {
+                images[++merged] = images[i];
             }
-            break;
         }
+        images.resize(std::min<size_t>(images.size(), merged + 1));
+    }
+    membus.setConcurrent(parallel && !bus_shared, cores.size());
+
+    int last_cycle = 0;
+    while (!wakeups.empty()) {
+        int cycle = wakeups.top().first;
+        if (clock_cycle_limit != 0 && cycle > clock_cycle_limit) break;
+
+        // Every core due this cycle, in core order
+        due.clear();
+        while (!wakeups.empty() && wakeups.top().first == cycle) {
+            due.push_back(wakeups.top().second);
+            wakeups.pop();
+        }
+        membus.setCycle(cycle);
+
+        auto wake = [&](size_t n) {
+            size_t i = due[n];
+            Core* core = cores[i];
+            core->skip_cycles(cycle - last_tick[i] - 1);
+            core->tick();
+            if (!core->is_complete()) idle[i] = core->idle_cycles();
+        };
+        if (parallel && due.size() >= PARALLEL_MIN_CORES && independent(due)) {
+            pool->run(due.size(), wake);
+        } else {
+            for (size_t n = 0; n < due.size(); n++) wake(n);
+        }
+
+        for (size_t i : due) {
+            cores[i]->log.flush();
+            last_tick[i] = cycle;
+            if (!cores[i]->is_complete()) wakeups.push({cycle + idle[i] + 1, i});
+        }
+        last_cycle = cycle;
+    }
+    membus.setConcurrent(false, cores.size());
+
+    if (!wakeups.empty()) {
+        // Stopped at the cycle limit: bring sleeping cores up to it
+        for (size_t i = 0; i < cores.size(); i++) {
+            if (!cores[i]->is_complete()) cores[i]->skip_cycles(clock_cycle_limit - last_tick[i]);
+        }
+        return 0;
+    }
+
+    // The first cycle in which no core ticks, as run_cycles counts it
+    int clock_cycle = last_cycle + 1;
+    if (clock_cycle_limit != 0 && clock_cycle >= clock_cycle_limit) return 0;
+    return clock_cycle;
+}
+
+// True if the due cores' next ticks can run in any order, and so at the same time: no two of
+// them may touch the same guest bytes, and no store may land in a program image (whose
+// watcher would reach into another core). Stores get their pages up front, so that
+// no page is allocated while other threads read memory. Hits in a core's own L1s are
+// always independent; anything else on a bus with caches, an L2 or the arbiter is not.
+bool Simulator::independent(const std::vector<size_t>& due) {
+    footprint.clear();
+    for (size_t i : due) {
+        if (!cores[i]->tick_footprint(footprint)) return false;
     }
+    if (bus_shared && !footprint.empty()) return false;
+
+    for (const AccessRange& range : footprint) {
+        if (!range.write) continue;
+        // Last image starting before the range ends
+        auto image = std::lower_bound(images.begin(), images.end(), std::make_pair(range.end, uint64_t(0)));
+        if (image != images.begin() && std::prev(image)->second > range.start) return false;
+    }
+
+    // Sweep by start, keeping the furthest end seen and the furthest end of any other core
+    std::sort(footprint.begin(), footprint.end(),
+              [](const AccessRange& a, const AccessRange& b) { return a.start < b.start; });
+    uint64_t furthest = 0, furthest_other = 0;
+    int furthest_core = -1;
+    for (const AccessRange& range : footprint) {
+        uint64_t reach = range.core_id == furthest_core ? furthest_other : furthest;
+        if (reach > range.start) return false;
+
+        if (range.core_id == furthest_core) {
+            furthest = std::max(furthest, range.end);
+        } else if (range.end > furthest) {
+            furthest_other = furthest;
+            furthest = range.end;
+            furthest_core = range.core_id;
+        } else {
+            furthest_other = std::max(furthest_other, range.end);
+        }
+    }
+
+    for (const AccessRange& range : footprint) {
+        if (range.write) ram.reserve(static_cast<uint32_t>(range.start), 4);
+    }
+    return true;
+}
+
+void Simulator::print_cache_stats(const char* name, const Cache* cache) {
+    if (!cache) return;
+
+    const CacheStats& stats = cache->getStats();
+    uint64_t accesses = stats.hits + stats.misses;
+    double hit_rate = accesses > 0 ? static_cast<double>(stats.hits) / accesses : 0.0;
+    LOG(log, LOG_SUMMARY, name << " hits: " << stats.hits << " misses: " << stats.misses
+        << " hit rate: " << hit_rate << " evictions: " << stats.evictions << " writebacks: " << stats.writebacks);
+    LOG(log, LOG_SUMMARY, name << " upgrades: " << stats.upgrades << " snoop writebacks: " << stats.snoopWritebacks
+        << " invalidations: " << stats.invalidations << " false sharing: " << stats.falseSharing
+        << " back-invalidations: " << stats.backInvalidations);
+
+    // MESI transitions that happened at least once
+    std::ostringstream transitions;
+    for (int from = 0; from < MESI_STATE_COUNT; from++) {
+        for (int to = 0; to < MESI_STATE_COUNT; to++) {
+            if (stats.transitions[from][to] == 0) continue;
+            transitions << ' ' << MesiNames[from] << "->" << MesiNames[to] << ": " << stats.transitions[from][to];
+        }
+    }
+    LOG(log, LOG_SUMMARY, name << " transitions:" << transitions.str());
+}
+
+void Simulator::print_branch_stats(const BranchPredictor* predictor) {
+    if (!predictor) return;
+
+    const BranchStats& stats = predictor->getStats();
+    double accuracy = stats.branches > 0 ? 1.0 - static_cast<double>(stats.branchMisses) / stats.branches : 0.0;
+    LOG(log, LOG_SUMMARY, "Branches: " << stats.branches << " mispredicted: " << stats.branchMisses
+        << " accuracy: " << accuracy << " BTB misses: " << stats.btbMisses);
+    LOG(log, LOG_SUMMARY, "Jumps: " << stats.jumps << " mispredicted: " << stats.jumpMisses
+        << " returns: " << stats.returns << " RAS misses: " << stats.rasMisses);
+    LOG(log, LOG_SUMMARY, "Squashed instructions: " << stats.squashed << " misprediction penalty cycles: " << stats.penaltyCycles);
+}
+
+void Simulator::print_summary(int clock_cycle) {
+    LOG(log, LOG_SUMMARY, "Simulation completed at clock cycle: " << clock_cycle);
+
+    // Calculate and print CPI for each core
+    for (auto core : cores) {
+        int instructions = core->instruction_count;
+        int cycles = core->active_cycles;
+        double cpi = instructions > 0 ? static_cast<double>(cycles) / instructions : 0.0;
+
+        LOG(log, LOG_SUMMARY, "Core " << core->core_id << " completed at clock cycle: " << cycles);
+        if (!core->get_trap().empty()) LOG(log, LOG_SUMMARY, "Core " << core->core_id << " stopped by " << core->get_trap());
+        LOG(log, LOG_SUMMARY, "Instruction count: " << instructions);
+        LOG(log, LOG_SUMMARY, "Average CPI: " << cpi);
+        LOG(log, LOG_SUMMARY, "Bus blocked polls: " << membus.blockedPolls(core->core_id));
+        if (membus.hasArbiter()) {
+            const BusStats& bus = membus.busStats(core->core_id);
+            double average = bus.grants > 0 ? static_cast<double>(bus.waitCycles) / bus.grants : 0.0;
+            LOG(log, LOG_SUMMARY, "Bus grants: " << bus.grants << " wait cycles: " << bus.waitCycles
+                << " average wait: " << average << " max wait: " << bus.maxWait);
+        }
+        if (core->get_pipeline().out_of_order) {
+            const OutOfOrderStats& ooo = core->get_ooo_stats();
+            double occupancy = cycles > 0 ? static_cast<double>(ooo.occupancy) / cycles : 0.0;
+            LOG(log, LOG_SUMMARY, "Dispatch stalls: ROB full: " << ooo.rob_full << " stations full: " << ooo.stations_full
+                << " LSQ full: " << ooo.lsq_full << " serialized: " << ooo.serialized);
+            LOG(log, LOG_SUMMARY, "Loads forwarded: " << ooo.forwarded << " average ROB occupancy: " << occupancy);
+        } else if (core->get_pipeline().scoreboard) {
+            const HazardStats& hazards = core->get_hazard_stats();
+            LOG(log, LOG_SUMMARY, "Hazard stalls: RAW: " << hazards.raw << " WAW: " << hazards.waw
+                << " WAR: " << hazards.war << " structural: " << hazards.structural);
+        }
+        print_branch_stats(core->get_branch_predictor());
+        print_cache_stats("L1I", core->get_icache());
+        print_cache_stats("L1D", core->get_dcache());
+    }
+    print_cache_stats("L2", membus.getL2());
+    if (membus.hasArbiter()) {
+        LOG(log, LOG_SUMMARY, "Bus busy cycles: " << membus.busyCycles() << " utilization: "
+            << static_cast<double>(membus.busyCycles()) / clock_cycle);
+    }
+    log.flush();
+}
+
+void Simulator::set_event_driven(bool enabled) {
+    event_driven = enabled;
+}
+
+void Simulator::set_caches(const CacheConfig* icache, const CacheConfig* dcache) {
+    use_icache = icache != nullptr;
+    use_dcache = dcache != nullptr;
+    if (icache) icache_config = *icache;
+    if (dcache) dcache_config = *dcache;
+}
+
+void Simulator::set_branch_predictor(const BranchPredictorConfig* config) {
+    use_bpred = config != nullptr;
+    if (config) bpred_config = *config;
+}
+
+void Simulator::set_l2(const CacheConfig& config) {
+    membus.enableL2(config);
+}
+
+void Simulator::set_bus(const BusConfig& config) {
+    membus.enableArbiter(config);
+}
+
+void Simulator::set_isa(IsaDialect dialect) {
+    isa = dialect;
+}
+
+void Simulator::set_pipeline(const PipelineConfig& config) {
+    pipeline = config;
+}
+
+void Simulator::set_latency_table(const LatencyTable& table) {
+    latencies = table;
+}
+
+void Simulator::set_vlen(uint32_t bits) {
+    vlen = bits;
+}
+
+void Simulator::set_threads(unsigned count) {
+    pool.reset(count > 1 ? new ThreadPool(count) : nullptr);
 }
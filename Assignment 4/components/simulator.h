@@ -6,21 +6,82 @@
 #include "core.h"
 #include "ram.h"
 #include "membus.h"
+#include "logger.h"
+#include "threadpool.h"
+#include "elf.h"
+#include <memory>
+
+// One core to create: the program it runs, where that is loaded (raw images only; an ELF
+// executable goes where it was linked) and its initial stack pointer
+struct CoreConfig {
+    std::string program;
+    uint32_t load_address;
+    uint32_t stack_pointer;
+};
 
 class Simulator {
 private:
     std::vector<Core*> cores;
+    std::vector<std::unique_ptr<Core>> owned_cores;    // Cores made by create_core
     RAM ram;
     Membus membus;
     int clock_cycle_limit;
+    LogSink log;
+    bool event_driven;
+    bool use_icache = false;
+    bool use_dcache = false;
+    CacheConfig icache_config;
+    CacheConfig dcache_config;
+    bool use_bpred = false;
+    BranchPredictorConfig bpred_config;
+    IsaDialect isa = ISA_LEGACY;
+    PipelineConfig pipeline;
+    LatencyTable latencies;
+    uint32_t vlen = DEFAULT_VLEN;
+    std::unique_ptr<ThreadPool> pool;           // Host threads for the event kernel, when more than one
+    std::vector<std::pair<uint64_t, uint64_t>> images;  // Program images, merged and sorted (parallel runs)
+    std::vector<AccessRange> footprint;         // Scratch for independent()
+    bool bus_shared = false;                    // Membus accesses reach caches, the L2 or the arbiter (parallel runs)
+
+    // Both return the cycle the run completed in, or 0 if it hit the cycle limit
+    int run_cycles();
+    int run_events();
+    bool independent(const std::vector<size_t>& due);
+    void print_summary(int clock_cycle);
+    void print_cache_stats(const char* name, const Cache* cache);
+    void print_branch_stats(const BranchPredictor* predictor);
+    void load_elf(Core* core, const std::string& filename);
+    void start_program(Core* core, uint32_t start, uint32_t end, uint32_t entry);
 
 public:
-    Simulator(int num_runs = 0);
+    Simulator(int num_runs = 0, const MemoryLayout& layout = MemoryLayout());
     void add_core(Core* core);
+    // Make the next core (ids count up from 0), load its program and add it
+    Core* create_core(const CoreConfig& config);
     void load_instructions_from_binary(Core* core, const std::string& filename, uint32_t start_address);
     void run();
     RAM* get_ram();
     Membus* get_membus();
+    void set_log_level(LogLevel level);
+    void set_event_driven(bool enabled);
+    // Give cores added from now on private L1 caches; null leaves that side uncached
+    void set_caches(const CacheConfig* icache, const CacheConfig* dcache);
+    // Give cores added from now on a branch predictor; null has them fetch straight on
+    void set_branch_predictor(const BranchPredictorConfig* config);
+    // Put a shared inclusive L2 between the cores' L1s and RAM
+    void set_l2(const CacheConfig& config);
+    // Arbitrate the Membus between the cores with limited bandwidth
+    void set_bus(const BusConfig& config);
+    // Instruction dialect of cores added from now on
+    void set_isa(IsaDialect dialect);
+    // Pipeline model of cores added from now on
+    void set_pipeline(const PipelineConfig& config);
+    // Execution timing of cores added from now on
+    void set_latency_table(const LatencyTable& table);
+    // Vector register length in bits of cores added from now on
+    void set_vlen(uint32_t bits);
+    // Host threads the event kernel ticks cores on; 1 keeps everything on the calling thread
+    void set_threads(unsigned count);
 };
 
 #endif // SIMULATOR_H
@@ -0,0 +1,74 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(size_t tasks, const std::function<void(size_t)>& function) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &function;
+        count = tasks;
+        next.store(0);
+        finished.store(0);
+        error = nullptr;
+        batch.fetch_add(1, std::memory_order_release);
+    }
+    wake.notify_all();
+
+    drain();
+
+    // Every worker has to finish this batch before the next one may overwrite it
+    while (finished.load(std::memory_order_acquire) < workers.size()) {
+        std::this_thread::yield();
+    }
+    task = nullptr;
+
+    if (error) std::rethrow_exception(error);
+}
+
+void ThreadPool::work() {
+    uint64_t seen = 0;
+    while (true) {
+        // Batches come once per simulated cycle, so look for the next one for a while before sleeping
+        for (int spin = 0; spin < SPIN_LIMIT && batch.load(std::memory_order_acquire) == seen; spin++) {
+            std::this_thread::yield();
+        }
+        if (batch.load(std::memory_order_acquire) == seen) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || batch.load() != seen; });
+            if (stopping) return;
+        }
+
+        seen = batch.load(std::memory_order_acquire);
+        drain();
+        finished.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void ThreadPool::drain() {
+    for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+        try {
+            (*task)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error || i < error_index) {
+                error = std::current_exception();
+                error_index = i;
+            }
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of host threads running one batch of independent tasks at a time. The calling
+// thread works on the batch too, and run() only returns once all of it is done, so every
+// batch ends in a barrier.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads);      // Threads in total, the caller included
+    ~ThreadPool();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // Call function(0) ... function(tasks - 1) spread over the threads. If any throw, the exception
+    // of the lowest index is rethrown here once the batch is over.
+    void run(size_t tasks, const std::function<void(size_t)>& function);
+
+private:
+    // Polls a worker spins for the next batch before it sleeps
+    static const int SPIN_LIMIT = 4096;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // The current batch; only written while every worker is waiting for the next one
+    const std::function<void(size_t)>* task = nullptr;
+    size_t count = 0;
+    std::atomic<uint64_t> batch{0};         // Number of batches started
+    std::atomic<size_t> next{0};            // Next task index to hand out
+    std::atomic<size_t> finished{0};        // Workers done with the current batch
+    std::exception_ptr error;
+    size_t error_index = 0;
+
+    void work();
+    void drain();
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,118 @@
+#include "vector.h"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+uint32_t parse_vlen(const std::string& value) {
+    uint32_t vlen = std::stoul(value, nullptr, 0);
+    if (vlen < 32 || vlen > MAX_VLEN || (vlen & (vlen - 1)) != 0) {
+        throw std::invalid_argument("VLEN must be a power of two between 32 and " + std::to_string(MAX_VLEN) + " bits.");
+    }
+    return vlen;
+}
+
+uint32_t vtype_lmul(uint32_t vtype) {
+    uint32_t vsew = (vtype >> 3) & 7;
+    uint32_t vlmul = vtype & 7;
+    if ((vtype & ~0xFFu) || vsew != 2 || vlmul > 3) return 0;
+    return 1u << vlmul;
+}
+
+namespace {
+
+const uint32_t CANONICAL_NAN = 0x7FC00000;
+
+float canonical(float value) {
+    if (!std::isnan(value)) return value;
+    float nan;
+    std::memcpy(&nan, &CANONICAL_NAN, sizeof(nan));
+    return nan;
+}
+
+// One element: a is vs2's, b is vs1's and d is vd's
+float element(Operation op, float a, float b, float d) {
+    switch (op) {
+        case OP_VFADD_VV: return a + b;
+        case OP_VFSUB_VV: return a - b;
+        case OP_VFMUL_VV: return a * b;
+        case OP_VFMACC_VV: return std::fma(b, a, d);
+        default: return d;
+    }
+}
+
+#if defined(__AVX__) || defined(__SSE2__)
+#if defined(__AVX__)
+typedef __m256 Lanes;
+const uint32_t LANES = 8;
+Lanes load(const float* p) { return _mm256_loadu_ps(p); }
+void store(float* p, Lanes v) { _mm256_storeu_ps(p, v); }
+Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+Lanes sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+Lanes canonical(Lanes v) {
+    Lanes nan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+    return _mm256_blendv_ps(v, _mm256_castsi256_ps(_mm256_set1_epi32(CANONICAL_NAN)), nan);
+}
+#if defined(__FMA__)
+#define SIMD_FMA
+Lanes fused(Lanes a, Lanes b, Lanes c) { return _mm256_fmadd_ps(a, b, c); }
+#endif
+#else
+typedef __m128 Lanes;
+const uint32_t LANES = 4;
+Lanes load(const float* p) { return _mm_loadu_ps(p); }
+void store(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+Lanes canonical(Lanes v) {
+    Lanes nan = _mm_cmpunord_ps(v, v);
+    return _mm_or_ps(_mm_and_ps(nan, _mm_castsi128_ps(_mm_set1_epi32(CANONICAL_NAN))), _mm_andnot_ps(nan, v));
+}
+#endif
+
+// Whole SIMD blocks from the start; returns how many elements were done. Lanes past count are
+// never computed, so they cannot raise exceptions.
+uint32_t simd_blocks(Operation op, float* vd, const float* vs1, const float* vs2, uint32_t count) {
+    uint32_t i = 0;
+    switch (op) {
+        case OP_VFADD_VV:
+            for (; i + LANES <= count; i += LANES) store(vd + i, canonical(add(load(vs2 + i), load(vs1 + i))));
+            break;
+        case OP_VFSUB_VV:
+            for (; i + LANES <= count; i += LANES) store(vd + i, canonical(sub(load(vs2 + i), load(vs1 + i))));
+            break;
+        case OP_VFMUL_VV:
+            for (; i + LANES <= count; i += LANES) store(vd + i, canonical(mul(load(vs2 + i), load(vs1 + i))));
+            break;
+#if defined(SIMD_FMA)
+        case OP_VFMACC_VV:
+            for (; i + LANES <= count; i += LANES) store(vd + i, canonical(fused(load(vs1 + i), load(vs2 + i), load(vd + i))));
+            break;
+#endif
+        default:
+            // A multiply and an add would round twice, so vfmacc without FMA stays scalar
+            break;
+    }
+    return i;
+}
+#else
+uint32_t simd_blocks(Operation, float*, const float*, const float*, uint32_t) {
+    return 0;
+}
+#endif
+
+} // namespace
+
+void vector_fp(Operation op, float* vd, const float* vs1, const float* vs2, uint32_t count, const uint8_t* mask) {
+    uint32_t i = mask ? 0 : simd_blocks(op, vd, vs1, vs2, count);
+    for (; i < count; i++) {
+        if (mask && !((mask[i / 8] >> (i % 8)) & 1)) continue;
+        vd[i] = canonical(element(op, vs2[i], vs1[i], vd[i]));
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <cstdint>
+#include <string>
+#include "decoder.h"
+
+const uint32_t DEFAULT_VLEN = 128;
+const uint32_t MAX_VLEN = 4096;
+const uint32_t VTYPE_VILL = 0x80000000;     // vtype after a vsetvli asked for something unsupported
+
+// Parse a vector register length in bits: a power of two from 32 (one element) to MAX_VLEN
+uint32_t parse_vlen(const std::string& value);
+
+// Registers in a group (LMUL) under vtype, or 0 if the vector unit cannot run it. Elements are
+// 32 bits wide and there are no fractional groups, so only e32 with m1, m2, m4 or m8 is legal.
+uint32_t vtype_lmul(uint32_t vtype);
+
+// vfadd.vv, vfsub.vv, vfmul.vv or vfmacc.vv over the first count elements:
+// vd = vs2 op vs1, or vd += vs1 * vs2 with a single rounding. Unmasked runs use host SIMD (AVX,
+// with FMA for vfmacc, or SSE2) where the build has it, and scalar code otherwise; mask is
+// v0's bytes, and masked runs only write the elements whose bit is set. Results follow the
+// host's rounding mode and raise its exception flags; NaNs come out canonical.
+void vector_fp(Operation op, float* vd, const float* vs1, const float* vs2, uint32_t count, const uint8_t* mask);
+
+#endif // VECTOR_H
@@ -1,56 +1,284 @@
 #include "components/core.h"
 #include "components/simulator.h"
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: ./core <program0.bin> [<program1.bin>]" << std::endl;
-        return 1;
+// A core as given on the command line; unset addresses are placed automatically
+struct CoreSpec {
+    std::string program;
+    bool has_load = false;
+    bool has_stack = false;
+    uint32_t load_address = 0;
+    uint32_t stack_pointer = 0;
+};
+
+// "PROGRAM[,load=ADDR][,stack=ADDR]"
+static CoreSpec parse_core_spec(const std::string& spec) {
+    std::stringstream fields(spec);
+    CoreSpec core;
+    std::getline(fields, core.program, ',');
+
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        if (field.rfind("load=", 0) == 0) {
+            core.load_address = std::stoul(field.substr(5), nullptr, 0);
+            core.has_load = true;
+        } else if (field.rfind("stack=", 0) == 0) {
+            core.stack_pointer = std::stoul(field.substr(6), nullptr, 0);
+            core.has_stack = true;
+        } else {
+            throw std::invalid_argument("Unknown core option: " + field);
+        }
+    }
+    return core;
+}
+
+// One core per line: "PROGRAM [LOAD [STACK]]"; '#' starts a comment
+static void read_cores_file(const std::string& filename, std::vector<CoreSpec>& specs) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open cores file: " + filename);
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::stringstream fields(line);
+        CoreSpec core;
+        if (!(fields >> core.program)) continue;
+
+        std::string address;
+        if (fields >> address) {
+            core.load_address = std::stoul(address, nullptr, 0);
+            core.has_load = true;
+        }
+        if (fields >> address) {
+            core.stack_pointer = std::stoul(address, nullptr, 0);
+            core.has_stack = true;
+        }
+        specs.push_back(core);
+    }
+}
+
+// Cores 0 and 1 keep the original slots below the arrays. Later cores get `slot` bytes
+// each above the arrays: program at the bottom, stack growing down from the top.
+static CoreConfig place_core(const CoreSpec& spec, size_t index, const MemoryLayout& layout, uint32_t slot) {
+    static const uint32_t legacy_load[] = {0x0000, 0x0200};
+    static const uint32_t legacy_stack[] = {0x2FF, 0x3FF};
+
+    CoreConfig config = {spec.program, spec.load_address, spec.stack_pointer};
+    if (!spec.has_load) {
+        if (index < 2) {
+            config.load_address = legacy_load[index];
+        } else {
+            uint32_t first = (layout.array(4) + slot - 1) / slot * slot;
+            config.load_address = first + static_cast<uint32_t>(index - 2) * slot;
+        }
     }
+    if (!spec.has_stack) {
+        config.stack_pointer = (!spec.has_load && index < 2) ? legacy_stack[index] : config.load_address + slot - 1;
+    }
+    return config;
+}
 
-    std::string instruction_file_0 = argv[1]; 
-    std::string instruction_file_1;
-    uint32_t instruction_address_0 = 0x0000;
-    uint32_t instruction_address_1 = 0x0200;
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
 
+    // Split --options from the positional program files
+    LogLevel log_level = LOG_TRACE;
+    bool event_driven = true;
+    MemoryLayout layout;
+    std::unique_ptr<CacheConfig> icache_config, dcache_config, l2_config;
+    std::unique_ptr<BusConfig> bus_config;
+    std::unique_ptr<BranchPredictorConfig> bpred_config;
+    IsaDialect isa = ISA_LEGACY;
+    bool isa_set = false;
+    PipelineConfig pipeline;
+    LatencyTable latencies;
+    uint32_t vlen = DEFAULT_VLEN;
+    bool mem_size_set = false;
+    bool array_bytes_set = false;
+    std::vector<CoreSpec> specs;
+    size_t core_count = 0;
+    uint32_t core_slot = 0x200;
     int limit = 25000;
+    unsigned threads = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--log=", 0) == 0) {
+            log_level = parse_log_level(arg.substr(6));
+        } else if (arg == "--kernel=cycle") {
+            event_driven = false;
+        } else if (arg == "--kernel=event") {
+            event_driven = true;
+        } else if (arg.rfind("--mem-size=", 0) == 0) {
+            layout.size = std::stoull(arg.substr(11), nullptr, 0);
+            mem_size_set = true;
+        } else if (arg.rfind("--array-base=", 0) == 0) {
+            layout.arrayBase = std::stoul(arg.substr(13), nullptr, 0);
+        } else if (arg.rfind("--array-bytes=", 0) == 0) {
+            layout.arrayBytes = std::stoul(arg.substr(14), nullptr, 0);
+            array_bytes_set = true;
+        } else if (arg.rfind("--array-a=", 0) == 0) {
+            layout.arrayFiles[0] = arg.substr(10);
+        } else if (arg.rfind("--array-b=", 0) == 0) {
+            layout.arrayFiles[1] = arg.substr(10);
+        } else if (arg.rfind("--l1i=", 0) == 0) {
+            icache_config.reset(new CacheConfig(parse_cache_config(arg.substr(6))));
+        } else if (arg.rfind("--l1d=", 0) == 0) {
+            dcache_config.reset(new CacheConfig(parse_cache_config(arg.substr(6))));
+        } else if (arg.rfind("--l2=", 0) == 0) {
+            // A larger, slower default than the L1s
+            CacheConfig l2_defaults;
+            l2_defaults.size = 32768;
+            l2_defaults.associativity = 8;
+            l2_defaults.hitLatency = 4;
+            l2_config.reset(new CacheConfig(parse_cache_config(arg.substr(5), l2_defaults)));
+        } else if (arg.rfind("--bus=", 0) == 0) {
+            bus_config.reset(new BusConfig(parse_bus_config(arg.substr(6))));
+        } else if (arg.rfind("--bpred=", 0) == 0) {
+            bpred_config.reset(new BranchPredictorConfig(parse_bpred_config(arg.substr(8))));
+        } else if (arg == "--isa=legacy") {
+            isa = ISA_LEGACY;
+            isa_set = true;
+        } else if (arg == "--isa=standard") {
+            isa = ISA_STANDARD;
+            isa_set = true;
+        } else if (arg.rfind("--pipeline=", 0) == 0) {
+            pipeline = parse_pipeline_config(arg.substr(11));
+        } else if (arg.rfind("--latency-file=", 0) == 0) {
+            latencies = read_latency_file(arg.substr(15));
+        } else if (arg.rfind("--vlen=", 0) == 0) {
+            vlen = parse_vlen(arg.substr(7));
+        } else if (arg.rfind("--core=", 0) == 0) {
+            specs.push_back(parse_core_spec(arg.substr(7)));
+        } else if (arg.rfind("--cores-file=", 0) == 0) {
+            read_cores_file(arg.substr(13), specs);
+        } else if (arg.rfind("--cores=", 0) == 0) {
+            core_count = std::stoul(arg.substr(8), nullptr, 0);
+        } else if (arg.rfind("--core-slot=", 0) == 0) {
+            core_slot = std::stoul(arg.substr(12), nullptr, 0);
+        } else if (arg.rfind("--limit=", 0) == 0) {
+            limit = std::stoi(arg.substr(8), nullptr, 0);
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            // 0 takes every host core
+            threads = std::stoul(arg.substr(10), nullptr, 0);
+            if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        } else {
+            CoreSpec core;
+            core.program = arg;
+            specs.push_back(core);
+        }
+    }
+
+    if (specs.empty()) {
+        std::cerr << "Usage: ./core [--log=off|summary|stage|trace] [--kernel=event|cycle]"
+                  << " [--isa=legacy|standard] [--pipeline=legacy|scoreboard|ooo[,forward=all|none|ex|mem][,width=N][,int=N][,fp=N][,rob=N][,rs=N][,lsq=N]] [--latency-file=FILE] [--vlen=BITS]"
+                  << " [--mem-size=N] [--array-base=ADDR] [--array-bytes=N] [--array-a=FILE] [--array-b=FILE]"
+                  << " [--l1i=size=N,line=N,ways=N,policy=lru|fifo|random,hit=N] [--l1d=...,write=back|through,allocate=1|0] [--l2=size=N,line=N,ways=N,policy=...,hit=N]"
+                  << " [--bus=policy=rr|fixed|age,width=BYTES,occupancy=CYCLES]"
+                  << " [--bpred=predictor=static|bimodal|gshare|tage,btb=N,ras=N,bits=N,history=N]"
+                  << " [--cores=N] [--core-slot=BYTES] [--cores-file=FILE] [--core=PROGRAM,load=ADDR,stack=ADDR] [--limit=CYCLES] [--threads=N]"
+                  << " <program0.bin|.elf> [<program1.bin|.elf> ...]" << std::endl;
+        return 1;
+    }
 
-    // Create the simulator with the specified limit
-    Simulator sim(limit);
+    // --cores=N repeats the listed programs round robin up to N cores
+    if (core_count > specs.size()) {
+        size_t listed = specs.size();
+        for (size_t i = listed; i < core_count; i++) {
+            CoreSpec core;
+            core.program = specs[i % listed].program;
+            specs.push_back(core);
+        }
+    }
+    // ELF cores always run the standard dialect (see Simulator::load_instructions_from_binary),
+    // so asking for the legacy one with an ELF program is a mistake
+    for (const CoreSpec& spec : specs) {
+        if (isa_set && isa == ISA_LEGACY && is_elf_file(spec.program)) {
+            throw std::invalid_argument("ELF programs need --isa=standard: " + spec.program);
+        }
+    }
+    // Legacy branches land relative to wherever Fetch has got to, so there is no path to
+    // predict, and fetching more than one word ahead moves their targets
+    if (bpred_config && isa != ISA_STANDARD) {
+        throw std::invalid_argument("Branch prediction needs --isa=standard.");
+    }
+    if (pipeline.width > 1 && isa != ISA_STANDARD) {
+        throw std::invalid_argument("Issue widths above 1 need --isa=standard.");
+    }
+    if (pipeline.out_of_order && isa != ISA_STANDARD) {
+        throw std::invalid_argument("The out-of-order pipeline needs --isa=standard.");
+    }
+    if (core_slot < 0x40 || core_slot % 4 != 0) {
+        throw std::invalid_argument("Core slot must be a multiple of 4 bytes and at least 0x40.");
+    }
 
-    // Create core0 and add it to the simulator
-    Core* core0 = new Core(instruction_address_0, 0, 0x2FF);
-    sim.add_core(core0);
+    // Grow the arrays to fit their files unless their size was given; whole pages keep every
+    // array page aligned when the base is, so the files can be mapped rather than copied
+    if (!array_bytes_set) {
+        for (const std::string& filename : layout.arrayFiles) {
+            if (filename.empty()) continue;
+            std::ifstream array(filename, std::ios::binary | std::ios::ate);
+            uint64_t bytes = static_cast<uint64_t>(std::max<std::streamoff>(array.tellg(), 0));
+            if (bytes > layout.arrayBytes) {
+                bytes = (bytes + RAM::PAGE_SIZE - 1) / RAM::PAGE_SIZE * RAM::PAGE_SIZE;
+                if (bytes > UINT32_MAX / 4) throw std::invalid_argument("Array file is too large: " + filename);
+                layout.arrayBytes = static_cast<uint32_t>(bytes);
+            }
+        }
+    }
 
-    // Load instructions for core0 into RAM using Membus
-    sim.load_instructions_from_binary(core0, instruction_file_0, instruction_address_0);
+    std::vector<CoreConfig> core_configs;
+    uint64_t memory_needed = layout.arrayBase + 4ull * layout.arrayBytes;
+    for (size_t i = 0; i < specs.size(); i++) {
+        core_configs.push_back(place_core(specs[i], i, layout, core_slot));
+        uint64_t program_end;
+        if (is_elf_file(core_configs[i].program)) {
+            program_end = read_elf(core_configs[i].program).end();
+        } else {
+            std::ifstream program(core_configs[i].program, std::ios::binary | std::ios::ate);
+            program_end = core_configs[i].load_address + static_cast<uint64_t>(std::max<std::streamoff>(program.tellg(), 0));
+        }
+        memory_needed = std::max<uint64_t>(memory_needed, std::max<uint64_t>(program_end, core_configs[i].stack_pointer + 1ull));
+    }
+    // Grow guest memory to fit the arrays and cores unless its size was given
+    if (!mem_size_set && memory_needed > layout.size) {
+        layout.size = (memory_needed + RAM::PAGE_SIZE - 1) / RAM::PAGE_SIZE * RAM::PAGE_SIZE;
+    }
 
-    // If a second program is provided, create core1 and load instructions
-    if (argc >= 3) {
-        instruction_file_1 = argv[2];
+    // Create the simulator with the specified limit and memory layout
+    Simulator sim(limit, layout);
+    sim.set_log_level(log_level);
+    sim.set_event_driven(event_driven);
+    sim.set_caches(icache_config.get(), dcache_config.get());
+    sim.set_isa(isa);
+    sim.set_pipeline(pipeline);
+    sim.set_latency_table(latencies);
+    sim.set_vlen(vlen);
+    sim.set_threads(threads);
+    sim.set_branch_predictor(bpred_config.get());
+    if (l2_config) sim.set_l2(*l2_config);
+    if (bus_config) sim.set_bus(*bus_config);
 
-        Core* core1 = new Core(instruction_address_1, 1, 0x3FF);
-        sim.add_core(core1);
-        sim.load_instructions_from_binary(core1, instruction_file_1, instruction_address_1);
+    // Create each core and load its program into RAM using Membus
+    for (const CoreConfig& config : core_configs) {
+        sim.create_core(config);
     }
 
     // Run the simulation
     sim.run();
 
+    if (log_level < LOG_SUMMARY) return 0;
+
     sim.get_ram()->printMath();
 
     // Print results
     // For debugging purposes, we can access RAM directly
-    std::cout << "ARRAY A: " << std::endl << "--------------------------------------------------" << std::endl;
-    sim.get_ram()->print(0x400, 0x7FF); // 0x7FF
-    std::cout << "--------------------------------------------------" << std::endl;
-    std::cout << "ARRAY B: " << std::endl << "--------------------------------------------------" << std::endl;
-    sim.get_ram()->print(0x800, 0xBFF); // 0xBFF
-    std::cout << "--------------------------------------------------" << std::endl;
-    std::cout << "ARRAY C: " << std::endl << "--------------------------------------------------" << std::endl;
-    sim.get_ram()->print(0xC00, 0xFFF); // 0xFFF
-    std::cout << "--------------------------------------------------" << std::endl;
-    std::cout << "ARRAY D: " << std::endl << "--------------------------------------------------" << std::endl;
-    sim.get_ram()->print(0x1000, 0x13FF); // 0x13FF
+    const char* array_names[] = {"ARRAY A: ", "ARRAY B: ", "ARRAY C: ", "ARRAY D: "};
+    for (int i = 0; i < 4; i++) {
+        if (i > 0) std::cout << "--------------------------------------------------" << std::endl;
+        std::cout << array_names[i] << std::endl << "--------------------------------------------------" << std::endl;
+        sim.get_ram()->print(layout.array(i), layout.array(i) + layout.arrayBytes - 1);
+    }
 
     return 0;
 }
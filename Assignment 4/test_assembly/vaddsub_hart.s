@@ -0,0 +1,27 @@
+# ARRAY_C[i] = ARRAY_A[i] + ARRAY_B[i] and ARRAY_D[i] = ARRAY_A[i] - ARRAY_B[i]
+# for i = hartid, hartid + harts, ... over 256 floats, so any number of cores
+# running this program split the work between them. Run with --isa=standard,
+# which starts each core with its hart id in a0 and the hart count in a1:
+#   llvm-mc -triple=riscv32 -mattr=+f -filetype=obj vaddsub_hart.s -o vaddsub_hart.o
+#   llvm-objcopy -O binary -j .text vaddsub_hart.o vaddsub_hart.bin
+main:
+	addi t0, zero, 1024     # End offset: 256 elements of 4 bytes
+	slli t1, a1, 2          # Byte stride between this hart's elements
+	slli a0, a0, 2          # Byte offset of its first element
+	addi a2, zero, 1024     # ARRAY_A = 0x400
+	add a2, a2, a0
+.LBB0_1:
+	blt a0, t0, .LBB0_2     # Leaves the loop at the end of the arrays
+	ret                     # Returns to the halt address the loader puts in ra
+.LBB0_2:
+	addi a3, a2, 1024       # ARRAY_B[i]
+	addi a4, a3, 1024       # ARRAY_C[i]
+	flw ft0, 0(a2)          # ARRAY_A[i]
+	flw ft1, 0(a3)
+	fadd.s ft2, ft0, ft1
+	fsub.s ft3, ft0, ft1
+	fsw ft2, 0(a4)
+	fsw ft3, 1024(a4)       # ARRAY_D[i]
+	add a0, a0, t1          # i += harts
+	add a2, a2, t1
+	j .LBB0_1
@@ -0,0 +1,41 @@
+# ARRAY_D[i] = ARRAY_A[i] - ARRAY_B[i] for 256 floats (c_code/vsub.c).
+# Same loop as CPU1.s but with standard RISC-V branch and jump offsets,
+# for running with --isa=standard:
+#   llvm-mc -triple=riscv32 -mattr=+f -filetype=obj vsub.s -o vsub.o
+#   llvm-objcopy -O binary -j .text vsub.o vsub.bin
+main:
+	addi sp, sp, -16        # Allocates space on the stack
+	sw ra, 12(sp)           # Saves return address
+	sw s0, 8(sp)            # Saves s0 register
+	addi s0, sp, 16         # Sets up a frame pointer
+	mv a0, zero
+	sw a0, -12(s0)          # Return value
+	sw a0, -16(s0)          # Loop counter i = 0
+.LBB0_1:
+	lw a0, -16(s0)          # Loads i
+	addi a1, zero, 255
+	blt a1, a0, .LBB0_4     # Leaves the loop once i > 255
+	addi a0, zero, 1024     # ARRAY_A = 0x400
+	lw a1, -16(s0)
+	slli a1, a1, 2          # Byte offset of element i
+	add a0, a0, a1
+	flw ft0, 0(a0)          # ARRAY_A[i]
+	addi a0, zero, 1024
+	addi a0, a0, 1024       # ARRAY_B = 0x800
+	add a0, a0, a1
+	flw ft1, 0(a0)          # ARRAY_B[i]
+	fsub.s ft0, ft0, ft1
+	addi a0, zero, 1
+	slli a0, a0, 12         # ARRAY_D = 0x1000
+	add a0, a0, a1
+	fsw ft0, 0(a0)          # ARRAY_D[i]
+	lw a0, -16(s0)
+	addi a0, a0, 1          # i++
+	sw a0, -16(s0)
+	j .LBB0_1
+.LBB0_4:
+	lw a0, -12(s0)
+	lw s0, 8(sp)            # Restores s0 register
+	lw ra, 12(sp)           # Restores return address
+	addi sp, sp, 16         # Deallocates stack space
+	ret                     # Returns to the halt address the loader puts in ra
@@ -0,0 +1,1269 @@
+// Behavioural checks of the simulator components. Build with the "build tests" task and run
+// tests.exe: it names every check that failed and exits non-zero if any did.
+#include "components/ram.h"
+#include "components/membus.h"
+#include "components/cache.h"
+#include "components/simulator.h"
+#include "components/elf.h"
+#include "components/vector.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cout << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            failures++;                                                                     \
+        }                                                                                   \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                          \
+    do {                                                                                    \
+        auto actual_value = (actual);                                                       \
+        auto expected_value = (expected);                                                   \
+        if (!(actual_value == expected_value)) {                                            \
+            std::cout << __FILE__ << ":" << __LINE__ << ": " #actual " is " << actual_value \
+                      << ", expected " << expected_value << std::endl;                      \
+            failures++;                                                                     \
+        }                                                                                   \
+    } while (0)
+
+// Guest memory for the tests; the benchmark arrays stay at their default place, below 0x8000
+static MemoryLayout test_layout() {
+    MemoryLayout layout;
+    layout.size = 0x10000;
+    return layout;
+}
+
+// Poll an access every cycle until it completes, as a core does. polls gets the count.
+template <typename Access>
+static MemResult complete(Access access, int* polls = nullptr) {
+    for (int n = 1; n <= 1000; n++) {
+        MemResult result = access();
+        if (result.status == MEM_DONE) {
+            if (polls) *polls = n;
+            return result;
+        }
+    }
+    throw std::runtime_error("Memory access never completed.");
+}
+
+static uint32_t ram_word(const RAM& ram, uint32_t address) {
+    uint32_t value;
+    ram.readBlock(address, &value, sizeof(value));
+    return value;
+}
+
+// Standard RV32 encodings for the programs the core tests run
+enum Register { ZERO = 0, RA = 1, SP = 2, T0 = 5, T1 = 6, T2 = 7, A0 = 10, A1 = 11, T3 = 28, T4 = 29 };
+
+static uint32_t encode_r(uint32_t funct7, int rs2, int rs1, uint32_t funct3, int rd, uint32_t opcode) {
+    return funct7 << 25 | uint32_t(rs2) << 20 | uint32_t(rs1) << 15 | funct3 << 12 | uint32_t(rd) << 7 | opcode;
+}
+
+static uint32_t encode_i(int32_t imm, int rs1, uint32_t funct3, int rd, uint32_t opcode) {
+    return uint32_t(imm) << 20 | uint32_t(rs1) << 15 | funct3 << 12 | uint32_t(rd) << 7 | opcode;
+}
+
+static uint32_t encode_s(int32_t imm, int rs2, int rs1, uint32_t funct3, uint32_t opcode) {
+    uint32_t bits = uint32_t(imm);
+    return (bits >> 5 & 0x7F) << 25 | uint32_t(rs2) << 20 | uint32_t(rs1) << 15 | funct3 << 12 | (bits & 0x1F) << 7 | opcode;
+}
+
+static uint32_t encode_b(int32_t offset, int rs2, int rs1, uint32_t funct3) {
+    uint32_t bits = uint32_t(offset);
+    return (bits >> 12 & 1) << 31 | (bits >> 5 & 0x3F) << 25 | uint32_t(rs2) << 20 | uint32_t(rs1) << 15 |
+           funct3 << 12 | (bits >> 1 & 0xF) << 8 | (bits >> 11 & 1) << 7 | 0x63;
+}
+
+static uint32_t addi(int rd, int rs1, int32_t imm) { return encode_i(imm, rs1, 0, rd, 0x13); }
+static uint32_t slli(int rd, int rs1, int shamt) { return encode_i(shamt, rs1, 1, rd, 0x13); }
+static uint32_t add(int rd, int rs1, int rs2) { return encode_r(0, rs2, rs1, 0, rd, 0x33); }
+static uint32_t sub(int rd, int rs1, int rs2) { return encode_r(0x20, rs2, rs1, 0, rd, 0x33); }
+static uint32_t lui(int rd, uint32_t upper) { return (upper & 0xFFFFF000) | uint32_t(rd) << 7 | 0x37; }
+static uint32_t mul(int rd, int rs1, int rs2) { return encode_r(1, rs2, rs1, 0, rd, 0x33); }
+static uint32_t div(int rd, int rs1, int rs2) { return encode_r(1, rs2, rs1, 4, rd, 0x33); }
+static uint32_t divu(int rd, int rs1, int rs2) { return encode_r(1, rs2, rs1, 5, rd, 0x33); }
+static uint32_t rem(int rd, int rs1, int rs2) { return encode_r(1, rs2, rs1, 6, rd, 0x33); }
+static uint32_t remu(int rd, int rs1, int rs2) { return encode_r(1, rs2, rs1, 7, rd, 0x33); }
+static uint32_t lb(int rd, int rs1, int32_t imm) { return encode_i(imm, rs1, 0, rd, 0x03); }
+static uint32_t lh(int rd, int rs1, int32_t imm) { return encode_i(imm, rs1, 1, rd, 0x03); }
+static uint32_t lw(int rd, int rs1, int32_t imm) { return encode_i(imm, rs1, 2, rd, 0x03); }
+static uint32_t lbu(int rd, int rs1, int32_t imm) { return encode_i(imm, rs1, 4, rd, 0x03); }
+static uint32_t lhu(int rd, int rs1, int32_t imm) { return encode_i(imm, rs1, 5, rd, 0x03); }
+static uint32_t sb(int rs2, int rs1, int32_t imm) { return encode_s(imm, rs2, rs1, 0, 0x23); }
+static uint32_t sh(int rs2, int rs1, int32_t imm) { return encode_s(imm, rs2, rs1, 1, 0x23); }
+static uint32_t sw(int rs2, int rs1, int32_t imm) { return encode_s(imm, rs2, rs1, 2, 0x23); }
+static uint32_t bne(int rs1, int rs2, int32_t offset) { return encode_b(offset, rs2, rs1, 1); }
+static uint32_t jalr(int rd, int rs1, int32_t imm) { return encode_i(imm, rs1, 0, rd, 0x67); }
+const uint32_t NOP = 0x00000013;       // addi x0, x0, 0
+const uint32_t FENCE = 0x0FF0000F;     // fence iorw, iorw
+const uint32_t ECALL = 0x00000073;
+const uint32_t EBREAK = 0x00100073;
+
+// OP-FP; FP registers are given by number. Conversions round toward zero.
+static uint32_t fmv_w_x(int fd, int rs1) { return encode_r(0x78, 0, rs1, 0, fd, 0x53); }
+static uint32_t fmv_x_w(int rd, int fs1) { return encode_r(0x70, 0, fs1, 0, rd, 0x53); }
+static uint32_t fcvt_w_s(int rd, int fs1) { return encode_r(0x60, 0, fs1, 1, rd, 0x53); }
+static uint32_t fcvt_wu_s(int rd, int fs1) { return encode_r(0x60, 1, fs1, 1, rd, 0x53); }
+static uint32_t fmin_s(int fd, int fs1, int fs2) { return encode_r(0x14, fs2, fs1, 0, fd, 0x53); }
+static uint32_t fmax_s(int fd, int fs1, int fs2) { return encode_r(0x14, fs2, fs1, 1, fd, 0x53); }
+static uint32_t fadd_s(int fd, int fs1, int fs2, uint32_t rm) { return encode_r(0, fs2, fs1, rm, fd, 0x53); }
+
+// RVV, unmasked; vector registers are given by number
+const int32_t VTYPE_E32_M1 = 0x010;
+static uint32_t vsetvli(int rd, int rs1, int32_t vtype) { return encode_i(vtype, rs1, 7, rd, 0x57); }
+static uint32_t vle32_v(int vd, int rs1) { return 1u << 25 | uint32_t(rs1) << 15 | 6u << 12 | uint32_t(vd) << 7 | 0x07; }
+static uint32_t vse32_v(int vs3, int rs1) { return 1u << 25 | uint32_t(rs1) << 15 | 6u << 12 | uint32_t(vs3) << 7 | 0x27; }
+static uint32_t vfadd_vv(int vd, int vs2, int vs1) { return encode_r(1, vs2, vs1, 1, vd, 0x57); }
+
+const int32_t CSR_FFLAGS = 0x001;
+const int32_t CSR_FRM = 0x002;
+static uint32_t csrrw(int rd, int32_t csr, int rs1) { return encode_i(csr, rs1, 1, rd, 0x73); }
+static uint32_t csrrs(int rd, int32_t csr, int rs1) { return encode_i(csr, rs1, 2, rd, 0x73); }
+
+static uint32_t jal(int rd, int32_t offset) {
+    uint32_t bits = uint32_t(offset);
+    return (bits >> 20 & 1) << 31 | (bits >> 1 & 0x3FF) << 21 | (bits >> 11 & 1) << 20 | (bits >> 12 & 0xFF) << 12 |
+           uint32_t(rd) << 7 | 0x6F;
+}
+
+static DecodedOp decode_standard(uint32_t word) {
+    Decoder decoder;
+    decoder.setDialect(ISA_STANDARD);
+    return decoder.decodeInstruction(word);
+}
+
+// A raw program image in a temporary file, removed again with the object
+class ProgramFile {
+public:
+    explicit ProgramFile(const std::vector<uint8_t>& bytes) {
+        static int count = 0;
+        path = (std::filesystem::temp_directory_path() / ("simulator_test_" + std::to_string(count++) + ".bin")).string();
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!out) throw std::runtime_error("Could not write test program: " + path);
+    }
+    explicit ProgramFile(const std::vector<uint32_t>& words)
+        : ProgramFile(std::vector<uint8_t>(reinterpret_cast<const uint8_t*>(words.data()),
+                                           reinterpret_cast<const uint8_t*>(words.data() + words.size()))) {}
+    ~ProgramFile() { std::remove(path.c_str()); }
+
+    ProgramFile(const ProgramFile&) = delete;
+    ProgramFile& operator=(const ProgramFile&) = delete;
+
+    const std::string& name() const { return path; }
+
+private:
+    std::string path;
+};
+
+// A quiet simulator running standard-dialect programs in the test memory layout, for at most
+// cycle_limit cycles if that is not 0
+static std::unique_ptr<Simulator> test_simulator(int cycle_limit = 0) {
+    std::unique_ptr<Simulator> simulator(new Simulator(cycle_limit, test_layout()));
+    simulator->set_log_level(LOG_OFF);
+    simulator->set_isa(ISA_STANDARD);
+    return simulator;
+}
+
+// Load the program on `cores` cores, 0x100 bytes apart from address 0, and run it
+static std::vector<Core*> run_program(Simulator& simulator, const std::vector<uint32_t>& program, int cores = 1) {
+    ProgramFile file(program);
+    std::vector<Core*> created;
+    for (int i = 0; i < cores; i++) {
+        created.push_back(simulator.create_core({file.name(), uint32_t(i) * 0x100, 0xF000 - uint32_t(i) * 0x100}));
+    }
+    simulator.run();
+    return created;
+}
+
+// ---------------------------------------------------------------------------------------
+// Mapped files
+
+static std::vector<uint32_t> read_words(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    std::vector<uint32_t> words(static_cast<size_t>(in.tellg()) / 4);
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(words.data()), words.size() * sizeof(uint32_t));
+    return words;
+}
+
+static void test_mapped_file_copy_on_write() {
+    // Two whole pages, which map copy-on-write at a page-aligned address, and a partial one
+    const uint32_t page = RAM::PAGE_SIZE;
+    std::vector<uint32_t> words((2 * page + 64) / 4);
+    for (size_t i = 0; i < words.size(); i++) words[i] = 0x10000 + uint32_t(i);
+    ProgramFile file(words);
+    uint32_t size = uint32_t(words.size() * 4);
+
+    RAM first(test_layout());
+    RAM second(test_layout());
+    first.mapFile(0x8000, file.name(), 0, size);
+    second.mapFile(0x8000, file.name(), 0, size);
+    // Its second page again, at an address only a copy can put it
+    first.mapFile(0x3004, file.name(), page, page);
+    CHECK_EQ(ram_word(first, 0x8000), words[0]);
+    CHECK_EQ(ram_word(first, 0x8000 + 2 * page + 60), words.back());
+    CHECK_EQ(ram_word(first, 0x3004), words[page / 4]);
+
+    // Write the first page with a timed write, the others and the copy without
+    complete([&] { return first.write(0x8010, 0xDEADBEEF, 0, false); });
+    const uint32_t value = 0xCAFEF00D;
+    for (uint32_t address : {0x8000 + page + 8, 0x8000 + 2 * page + 4, 0x3004u}) {
+        first.writeBlock(address, &value, sizeof(value));
+    }
+    CHECK_EQ(ram_word(first, 0x8010), 0xDEADBEEFu);
+    CHECK_EQ(ram_word(first, 0x8000 + page + 8), value);
+    CHECK_EQ(ram_word(first, 0x3004), value);
+
+    // Neither the other guest memory nor the file sees the writes, nor does a later mapping
+    CHECK_EQ(ram_word(second, 0x8010), words[4]);
+    CHECK_EQ(ram_word(second, 0x8000 + page + 8), words[page / 4 + 2]);
+    CHECK_EQ(ram_word(second, 0x8000 + 2 * page + 4), words[2 * page / 4 + 1]);
+    CHECK(read_words(file.name()) == words);
+    RAM third(test_layout());
+    third.mapFile(0x8000, file.name(), 0, size);
+    CHECK_EQ(ram_word(third, 0x8010), words[4]);
+    CHECK_EQ(ram_word(third, 0x8000 + page + 8), words[page / 4 + 2]);
+}
+
+// ---------------------------------------------------------------------------------------
+// L1 caches
+
+static void test_cache_fill_and_hit() {
+    RAM ram(test_layout());
+    Membus membus(ram);
+    const uint32_t words[8] = {10, 11, 12, 13, 14, 15, 16, 0x80FF7F01};
+    ram.writeBlock(0x8000, words, sizeof(words));
+    Cache cache(parse_cache_config("size=256,line=32,ways=2,hit=2"), &membus, 0);
+
+    int polls = 0;
+    CHECK_EQ(complete([&] { return cache.read(0x8004); }, &polls).data, words[1]);
+    CHECK(polls > 2);
+    // The rest of the line came with it
+    CHECK_EQ(complete([&] { return cache.read(0x801C); }, &polls).data, words[7]);
+    CHECK_EQ(polls, 2);
+    CHECK_EQ(complete([&] { return cache.read(0x801D, 1); }).data, 0x7Fu);
+    CHECK_EQ(complete([&] { return cache.read(0x801E, 2); }).data, 0x80FFu);
+
+    const CacheStats& stats = cache.getStats();
+    CHECK_EQ(stats.misses, 1u);
+    CHECK_EQ(stats.hits, 3u);
+    CHECK_EQ(stats.transitions[MESI_INVALID][MESI_EXCLUSIVE], 1u);
+
+    // A word across two lines goes straight to memory
+    const uint32_t across = 0x44332211;
+    ram.writeBlock(0x803E, &across, sizeof(across));
+    CHECK_EQ(complete([&] { return cache.read(0x803E); }).data, across);
+    CHECK_EQ(stats.misses, 2u);
+}
+
+// Two ways per set: set 0 holds lines 0x8000, 0x8020 and 0x8040 two at a time
+static uint64_t replacement_hits(const char* policy) {
+    RAM ram(test_layout());
+    Membus membus(ram);
+    Cache cache(parse_cache_config(std::string("size=64,line=16,ways=2,policy=") + policy), &membus, 0);
+    for (uint32_t address : {0x8000, 0x8020, 0x8000, 0x8040, 0x8000, 0x8020}) {
+        complete([&] { return cache.read(address); });
+    }
+    CHECK_EQ(cache.getStats().hits + cache.getStats().misses, 6u);
+    return cache.getStats().hits;
+}
+
+static void test_cache_replacement() {
+    // LRU keeps 0x8000, which was used again; FIFO drops it as the oldest fill
+    CHECK_EQ(replacement_hits("lru"), 2u);
+    CHECK_EQ(replacement_hits("fifo"), 1u);
+}
+
+static void test_cache_write_back() {
+    RAM ram(test_layout());
+    Membus membus(ram);
+    const uint32_t old_value = 5;
+    ram.writeBlock(0x8000, &old_value, sizeof(old_value));
+    // Direct mapped: 0x8000 and 0x8040 share a set
+    Cache cache(parse_cache_config("size=64,line=16,ways=1"), &membus, 0);
+
+    complete([&] { return cache.write(0x8000, 0x11111111); });
+    CHECK_EQ(ram_word(ram, 0x8000), old_value);
+    CHECK_EQ(complete([&] { return cache.read(0x8000); }).data, 0x11111111u);
+
+    complete([&] { return cache.read(0x8040); });
+    CHECK_EQ(ram_word(ram, 0x8000), 0x11111111u);
+
+    const CacheStats& stats = cache.getStats();
+    CHECK_EQ(stats.evictions, 1u);
+    CHECK_EQ(stats.writebacks, 1u);
+    CHECK_EQ(stats.transitions[MESI_EXCLUSIVE][MESI_MODIFIED], 1u);
+    CHECK_EQ(stats.transitions[MESI_MODIFIED][MESI_INVALID], 1u);
+}
+
+static void test_cache_write_through() {
+    RAM ram(test_layout());
+    Membus membus(ram);
+    Cache cache(parse_cache_config("size=64,line=16,ways=1,write=through,allocate=0"), &membus, 0);
+
+    // A write miss goes to memory without filling the line
+    complete([&] { return cache.write(0x8000, 7); });
+    CHECK_EQ(ram_word(ram, 0x8000), 7u);
+    complete([&] { return cache.read(0x8000); });
+    CHECK_EQ(cache.getStats().misses, 2u);
+
+    // A write hit updates both the line and memory, and the line never turns dirty
+    complete([&] { return cache.write(0x8000, 9); });
+    CHECK_EQ(ram_word(ram, 0x8000), 9u);
+    CHECK_EQ(complete([&] { return cache.read(0x8000); }).data, 9u);
+    CHECK_EQ(cache.getStats().hits, 2u);
+    CHECK_EQ(cache.getStats().transitions[MESI_EXCLUSIVE][MESI_MODIFIED], 0u);
+}
+
+// ---------------------------------------------------------------------------------------
+// MESI coherence and the shared L2
+
+static void test_mesi_transitions() {
+    RAM ram(test_layout());
+    Membus membus(ram);
+    CacheConfig config = parse_cache_config("size=256,line=16,ways=2");
+    Cache first(config, &membus, 0);
+    Cache second(config, &membus, 1);
+    membus.attach(&first);
+    membus.attach(&second);
+    const CacheStats& a = first.getStats();
+    const CacheStats& b = second.getStats();
+
+    // Alone it is Exclusive; a second reader makes both Shared
+    complete([&] { return first.read(0x8000); });
+    CHECK_EQ(a.transitions[MESI_INVALID][MESI_EXCLUSIVE], 1u);
+    complete([&] { return second.read(0x8000); });
+    CHECK_EQ(a.transitions[MESI_EXCLUSIVE][MESI_SHARED], 1u);
+    CHECK_EQ(b.transitions[MESI_INVALID][MESI_SHARED], 1u);
+
+    // Writing a Shared line upgrades it and invalidates the other copy
+    complete([&] { return second.write(0x8000, 42); });
+    CHECK_EQ(b.upgrades, 1u);
+    CHECK_EQ(b.transitions[MESI_SHARED][MESI_MODIFIED], 1u);
+    CHECK_EQ(a.transitions[MESI_SHARED][MESI_INVALID], 1u);
+    CHECK_EQ(a.invalidations, 1u);
+    CHECK_EQ(a.falseSharing, 0u);
+
+    // Reading it back takes the modified data from the other cache, which drops to Shared
+    CHECK_EQ(complete([&] { return first.read(0x8000); }).data, 42u);
+    CHECK_EQ(b.snoopWritebacks, 1u);
+    CHECK_EQ(b.transitions[MESI_MODIFIED][MESI_SHARED], 1u);
+    CHECK_EQ(ram_word(ram, 0x8000), 42u);
+
+    // A write to a word the other cache never touched is false sharing
+    complete([&] { return first.write(0x8004, 1); });
+    CHECK_EQ(b.invalidations, 1u);
+    CHECK_EQ(b.falseSharing, 1u);
+    CHECK(!second.hitsLocally(0x8000, 4, false));
+}
+
+static void test_l2_inclusion() {
+    RAM ram(test_layout());
+    Membus membus(ram);
+    // Two direct-mapped lines: 0x8000 and 0x8020 share a set
+    membus.enableL2(parse_cache_config("size=32,line=16,ways=1"));
+    Cache cache(parse_cache_config("size=256,line=16,ways=2"), &membus, 0);
+    membus.attach(&cache);
+    const Cache* l2 = membus.getL2();
+
+    complete([&] { return cache.write(0x8000, 77); });
+    CHECK(l2->residentData(0x8000) != nullptr);
+    CHECK_EQ(ram_word(ram, 0x8000), 0u);
+
+    // Filling 0x8020 evicts 0x8000 from the L2, which takes the dirty L1 copy with it
+    complete([&] { return cache.read(0x8020); });
+    CHECK(l2->residentData(0x8000) == nullptr);
+    CHECK(!cache.hitsLocally(0x8000, 4, false));
+    CHECK_EQ(cache.getStats().backInvalidations, 1u);
+    CHECK_EQ(l2->getStats().writebacks, 1u);
+    CHECK_EQ(ram_word(ram, 0x8000), 77u);
+
+    // Every line the L1 still holds is in the L2
+    CHECK(cache.hitsLocally(0x8020, 4, false));
+    CHECK(l2->residentData(0x8020) != nullptr);
+    CHECK_EQ(complete([&] { return cache.read(0x8000); }).data, 77u);
+    CHECK_EQ(cache.getStats().misses, 3u);
+}
+
+// ---------------------------------------------------------------------------------------
+// Bus arbitration
+
+// Core 1 takes the bus at cycle 2 and holds it for 8 cycles while cores 3, 0 and 2 (in that
+// order) start waiting. Returns the order the cores' reads complete in, polling cores in
+// ascending or descending id order within each cycle.
+static std::vector<int> grant_order(const char* policy, bool descending) {
+    RAM ram(test_layout());
+    Membus membus(ram);
+    membus.enableArbiter(parse_bus_config(std::string("policy=") + policy + ",width=4,occupancy=8"));
+    const uint64_t first_poll[4] = {3, 1, 4, 2};
+
+    std::vector<int> order;
+    bool done[4] = {};
+    for (uint64_t cycle = 1; cycle < 100 && order.size() < 4; cycle++) {
+        membus.setCycle(cycle);
+        for (int n = 0; n < 4; n++) {
+            int core = descending ? 3 - n : n;
+            if (done[core] || cycle < first_poll[core]) continue;
+            if (membus.read(core, 0x8000 + 4 * core, false).status == MEM_DONE) {
+                done[core] = true;
+                order.push_back(core);
+            }
+        }
+    }
+    for (int core = 0; core < 4; core++) {
+        CHECK_EQ(membus.busStats(core).grants, 1u);
+    }
+    return order;
+}
+
+static void test_arbitration_order() {
+    for (bool descending : {false, true}) {
+        CHECK(grant_order("fixed", descending) == std::vector<int>({1, 0, 2, 3}));
+        CHECK(grant_order("age", descending) == std::vector<int>({1, 3, 0, 2}));
+        // Round-robin goes on from the last core granted
+        CHECK(grant_order("rr", descending) == std::vector<int>({1, 2, 3, 0}));
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// Branch prediction
+
+// Direction misses of a backward branch at 0x100 over the last `measured` of `runs` executions,
+// taken whenever taken(execution) says so
+static uint64_t direction_misses(const char* spec, bool (*taken)(int), int runs, int measured) {
+    BranchPredictor predictor(parse_bpred_config(spec));
+    DecodedOp branch = decode_standard(bne(T0, ZERO, -16));
+    uint64_t misses = 0;
+    for (int i = 0; i < runs; i++) {
+        Prediction prediction = predictor.predict(0x100, branch);
+        bool outcome = taken(i);
+        predictor.resolve(0x100, prediction, outcome, 0xF0);
+        if (i >= runs - measured && prediction.taken != outcome) misses++;
+    }
+    return misses;
+}
+
+static void test_gshare_learns_history() {
+    // A 2-bit counter per branch cannot follow taken, not taken, taken...; global history can
+    bool (*alternating)(int) = [](int i) { return i % 2 == 0; };
+    CHECK(direction_misses("predictor=bimodal", alternating, 2000, 200) >= 100);
+    CHECK_EQ(direction_misses("predictor=gshare,history=12", alternating, 2000, 200), 0u);
+}
+
+static void test_tage_learns_long_loops() {
+    // The exit of a 24-iteration loop is beyond 12 bits of history, but not TAGE's 64
+    bool (*loop)(int) = [](int i) { return i % 24 != 23; };
+    CHECK_EQ(direction_misses("predictor=gshare,history=12", loop, 12000, 2400), 100u);
+    CHECK_EQ(direction_misses("predictor=tage,history=64", loop, 12000, 2400), 0u);
+}
+
+static void test_return_stack() {
+    BranchPredictor predictor(parse_bpred_config("predictor=bimodal,ras=4"));
+    DecodedOp call = decode_standard(jal(RA, 0x100));
+    DecodedOp ret = decode_standard(jalr(ZERO, RA, 0));
+
+    // Nested calls from 0x100 and 0x204 return in reverse order; the cold BTB misses only the calls
+    Prediction outer = predictor.predict(0x100, call);
+    predictor.resolve(0x100, outer, true, 0x200);
+    Prediction inner = predictor.predict(0x204, call);
+    predictor.resolve(0x204, inner, true, 0x304);
+    Prediction first = predictor.predict(0x304, ret);
+    CHECK_EQ(first.next, 0x208u);
+    CHECK(!predictor.resolve(0x304, first, true, 0x208));
+    Prediction second = predictor.predict(0x20C, ret);
+    CHECK_EQ(second.next, 0x104u);
+    CHECK(!predictor.resolve(0x20C, second, true, 0x104));
+    CHECK_EQ(predictor.getStats().rasMisses, 0u);
+}
+
+// ---------------------------------------------------------------------------------------
+// RV32IM
+
+// Division by zero and overflow, which must not trap, and sub-word loads and stores; every
+// result goes to its own word from 0x8000
+static const std::vector<uint32_t> rv32im_program = {
+    lui(T1, 0x8000),
+    addi(T0, ZERO, -7),
+    div(T2, T0, ZERO),
+    sw(T2, T1, 0),
+    divu(T2, T0, ZERO),
+    sw(T2, T1, 4),
+    rem(T2, T0, ZERO),
+    sw(T2, T1, 8),
+    remu(T2, T0, ZERO),
+    sw(T2, T1, 12),
+    lui(T3, 0x80000000),
+    addi(T4, ZERO, -1),
+    div(T2, T3, T4),
+    sw(T2, T1, 16),
+    rem(T2, T3, T4),
+    sw(T2, T1, 20),
+    addi(A0, ZERO, 2),
+    div(T2, T0, A0),
+    sw(T2, T1, 24),
+    rem(T2, T0, A0),
+    sw(T2, T1, 28),
+    // 0x80F0: both the low byte and the low half have their sign bit set
+    addi(A0, ZERO, 0x80),
+    slli(A0, A0, 8),
+    addi(A0, A0, 0xF0),
+    sw(A0, T1, 32),
+    lb(T2, T1, 32),
+    sw(T2, T1, 36),
+    lbu(T2, T1, 32),
+    sw(T2, T1, 40),
+    lh(T2, T1, 32),
+    sw(T2, T1, 44),
+    lhu(T2, T1, 32),
+    sw(T2, T1, 48),
+    sw(ZERO, T1, 52),
+    sb(T0, T1, 53),
+    sw(ZERO, T1, 56),
+    sh(T0, T1, 58),
+};
+
+static void test_rv32im_edge_cases() {
+    for (const char* spec : {"legacy", "scoreboard", "ooo"}) {
+        // Results stay in registers that stores still read, which the cycles skipped must respect
+        std::unique_ptr<Simulator> cycle_by_cycle = test_simulator();
+        cycle_by_cycle->set_pipeline(parse_pipeline_config(spec));
+        cycle_by_cycle->set_event_driven(false);
+        int cycles = run_program(*cycle_by_cycle, rv32im_program)[0]->active_cycles;
+
+        std::unique_ptr<Simulator> simulator = test_simulator();
+        simulator->set_pipeline(parse_pipeline_config(spec));
+        CHECK_EQ(run_program(*simulator, rv32im_program)[0]->active_cycles, cycles);
+        const RAM& ram = *simulator->get_ram();
+
+        CHECK_EQ(ram_word(ram, 0x8000), 0xFFFFFFFFu);  // div by zero: -1
+        CHECK_EQ(ram_word(ram, 0x8004), 0xFFFFFFFFu);  // divu by zero: all ones
+        CHECK_EQ(ram_word(ram, 0x8008), uint32_t(-7)); // rem by zero: the dividend
+        CHECK_EQ(ram_word(ram, 0x800C), uint32_t(-7)); // remu by zero: the dividend
+        CHECK_EQ(ram_word(ram, 0x8010), 0x80000000u);  // INT_MIN / -1 overflows to INT_MIN
+        CHECK_EQ(ram_word(ram, 0x8014), 0u);           // with remainder 0
+        CHECK_EQ(ram_word(ram, 0x8018), uint32_t(-3)); // -7 / 2 rounds toward zero
+        CHECK_EQ(ram_word(ram, 0x801C), uint32_t(-1)); // and the remainder takes the dividend's sign
+        CHECK_EQ(ram_word(ram, 0x8024), 0xFFFFFFF0u);
+        CHECK_EQ(ram_word(ram, 0x8028), 0xF0u);
+        CHECK_EQ(ram_word(ram, 0x802C), 0xFFFF80F0u);
+        CHECK_EQ(ram_word(ram, 0x8030), 0x80F0u);
+        CHECK_EQ(ram_word(ram, 0x8034), 0xF900u);      // sb writes only its byte
+        CHECK_EQ(ram_word(ram, 0x8038), 0xFFF90000u);  // sh only its half
+    }
+
+    CHECK_EQ(load_result(OP_LB, 0x80), 0xFFFFFF80u);
+    CHECK_EQ(load_result(OP_LBU, 0x80), 0x80u);
+    CHECK_EQ(load_result(OP_LH, 0x8000), 0xFFFF8000u);
+    CHECK_EQ(load_result(OP_LHU, 0x8000), 0x8000u);
+    CHECK_EQ(load_result(OP_LW, 0x80000000), 0x80000000u);
+}
+
+// fence retires without effect; ecall and ebreak stop the core after the instructions before
+// them, so the store after them never happens
+static void test_system_instructions() {
+    struct Stop {
+        uint32_t word;
+        const char* trap;
+    };
+    for (const char* spec : {"legacy", "scoreboard", "ooo"}) {
+        for (Stop stop : {Stop{NOP, ""}, Stop{ECALL, "ecall at 0x18"}, Stop{EBREAK, "ebreak at 0x18"}}) {
+            std::unique_ptr<Simulator> simulator = test_simulator(10000);
+            simulator->set_pipeline(parse_pipeline_config(spec));
+            Core* core = run_program(*simulator, {
+                lui(T1, 0x8000),
+                addi(T0, ZERO, 5),
+                sw(T0, T1, 0),
+                FENCE,
+                addi(T0, T0, 1),
+                sw(T0, T1, 4),
+                stop.word,
+                sw(T0, T1, 8),
+            })[0];
+            const RAM& ram = *simulator->get_ram();
+
+            CHECK(core->is_complete());
+            CHECK_EQ(core->get_trap(), std::string(stop.trap));
+            CHECK_EQ(ram_word(ram, 0x8000), 5u);
+            CHECK_EQ(ram_word(ram, 0x8004), 6u);
+            CHECK_EQ(ram_word(ram, 0x8008), stop.word == NOP ? 6u : 0u);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// RV32F
+
+// Conversions out of range, fmin and fmax with NaN and signed zero operands, and the flags they
+// raise; every result goes to its own word from 0x8000
+static const std::vector<uint32_t> rv32f_program = {
+    lui(T1, 0x8000),
+    lui(T0, 0x7FC00000), fmv_w_x(1, T0),                    // f1 = quiet NaN
+    lui(T0, 0x7F800000), fmv_w_x(2, T0),                    // f2 = +inf
+    lui(T0, 0xFF800000), fmv_w_x(3, T0),                    // f3 = -inf
+    lui(T0, 0xBF800000), fmv_w_x(4, T0),                    // f4 = -1
+    lui(T0, 0x3F800000), fmv_w_x(5, T0),                    // f5 = 1
+    lui(T0, 0x7F800000), addi(T0, T0, 1), fmv_w_x(6, T0),   // f6 = signaling NaN
+    lui(T0, 0x80000000), fmv_w_x(8, T0),                    // f8 = -0
+    fmv_w_x(9, ZERO),                                       // f9 = +0
+    fcvt_w_s(T2, 1), sw(T2, T1, 0),
+    fcvt_w_s(T2, 2), sw(T2, T1, 4),
+    fcvt_w_s(T2, 3), sw(T2, T1, 8),
+    fcvt_wu_s(T2, 4), sw(T2, T1, 12),
+    csrrw(T2, CSR_FFLAGS, ZERO), sw(T2, T1, 16),
+    fmin_s(7, 1, 5), fmv_x_w(T2, 7), sw(T2, T1, 20),
+    fmax_s(7, 4, 1), fmv_x_w(T2, 7), sw(T2, T1, 24),
+    fmin_s(7, 1, 1), fmv_x_w(T2, 7), sw(T2, T1, 28),
+    csrrs(T2, CSR_FFLAGS, ZERO), sw(T2, T1, 32),
+    fmin_s(7, 6, 5), fmv_x_w(T2, 7), sw(T2, T1, 36),
+    csrrw(T2, CSR_FFLAGS, ZERO), sw(T2, T1, 40),
+    fmin_s(7, 9, 8), fmv_x_w(T2, 7), sw(T2, T1, 44),
+    fmax_s(7, 8, 9), fmv_x_w(T2, 7), sw(T2, T1, 48),
+};
+
+static void test_rv32f_edge_cases() {
+    const uint32_t NV = 0x10;
+    for (const char* spec : {"legacy", "scoreboard", "ooo"}) {
+        std::unique_ptr<Simulator> simulator = test_simulator();
+        simulator->set_pipeline(parse_pipeline_config(spec));
+        run_program(*simulator, rv32f_program);
+        const RAM& ram = *simulator->get_ram();
+
+        // Conversions saturate, NaN to the largest value, and flag invalid
+        CHECK_EQ(ram_word(ram, 0x8000), 0x7FFFFFFFu);
+        CHECK_EQ(ram_word(ram, 0x8004), 0x7FFFFFFFu);
+        CHECK_EQ(ram_word(ram, 0x8008), 0x80000000u);
+        CHECK_EQ(ram_word(ram, 0x800C), 0u);
+        CHECK_EQ(ram_word(ram, 0x8010), NV);
+        // A quiet NaN gives the other operand without a flag, two give the canonical NaN
+        CHECK_EQ(ram_word(ram, 0x8014), 0x3F800000u);
+        CHECK_EQ(ram_word(ram, 0x8018), 0xBF800000u);
+        CHECK_EQ(ram_word(ram, 0x801C), 0x7FC00000u);
+        CHECK_EQ(ram_word(ram, 0x8020), 0u);
+        // A signaling NaN still gives the other operand, but flags invalid
+        CHECK_EQ(ram_word(ram, 0x8024), 0x3F800000u);
+        CHECK_EQ(ram_word(ram, 0x8028), NV);
+        // -0 is less than +0
+        CHECK_EQ(ram_word(ram, 0x802C), 0x80000000u);
+        CHECK_EQ(ram_word(ram, 0x8030), 0u);
+    }
+}
+
+// A reserved rounding mode, in frm or the instruction, is an illegal instruction: the core
+// stops there, without running the load or the store after it
+static void test_reserved_rounding_modes() {
+    struct Case {
+        uint32_t set_frm;
+        uint32_t word;
+        const char* trap;
+    };
+    const Case cases[] = {
+        {csrrw(ZERO, CSR_FRM, T0), fadd_s(1, 2, 3, 7), "Illegal instruction fadd.s with reserved rounding mode 5 in frm at 0x14"},
+        {NOP, fadd_s(1, 2, 3, 5), "Illegal instruction 0x003150D3 at 0x14"},
+        {NOP, 0, "Illegal instruction 0x00000000 at 0x14"},
+    };
+    for (const char* spec : {"legacy", "scoreboard", "ooo"}) {
+        for (const Case& test : cases) {
+            std::unique_ptr<Simulator> simulator = test_simulator(10000);
+            simulator->set_pipeline(parse_pipeline_config(spec));
+            Core* core = run_program(*simulator, {
+                lui(T1, 0x8000),
+                addi(T0, ZERO, 5),
+                test.set_frm,
+                addi(T2, ZERO, 7),
+                sw(T2, T1, 0),
+                test.word,
+                lw(T3, T1, 0),
+                sw(T3, T1, 4),
+            })[0];
+            const RAM& ram = *simulator->get_ram();
+
+            CHECK(core->is_complete());
+            CHECK_EQ(core->get_trap(), std::string(test.trap));
+            CHECK_EQ(ram_word(ram, 0x8000), 7u);
+            CHECK_EQ(ram_word(ram, 0x8004), 0u);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// Vector unit
+
+// c = a + b over VECTOR_COUNT floats at 0x8000, 0x8100 and 0x8200, strip-mined: each pass
+// takes vl = min(remaining, VLMAX) elements and logs vl from 0x8300. After the loop, v3 is
+// stored at full length to 0x8400, showing what the short last pass left in its tail.
+const uint32_t VECTOR_COUNT = 10;
+
+static const std::vector<uint32_t> strip_mine_program = {
+    addi(A0, ZERO, VECTOR_COUNT),
+    lui(T1, 0x8000),
+    addi(T2, T1, 0x100),
+    addi(T3, T1, 0x200),
+    addi(A1, T1, 0x300),
+    vsetvli(T0, A0, VTYPE_E32_M1),
+    vle32_v(1, T1),
+    vle32_v(2, T2),
+    vfadd_vv(3, 2, 1),
+    vse32_v(3, T3),
+    sw(T0, A1, 0),
+    addi(A1, A1, 4),
+    slli(T4, T0, 2),
+    add(T1, T1, T4),
+    add(T2, T2, T4),
+    add(T3, T3, T4),
+    sub(A0, A0, T0),
+    bne(A0, ZERO, -48),
+    addi(A0, ZERO, -1),
+    vsetvli(ZERO, A0, VTYPE_E32_M1),
+    lui(T3, 0x8000),
+    addi(T3, T3, 0x400),
+    vse32_v(3, T3),
+};
+
+static float ram_float(const RAM& ram, uint32_t address) {
+    float value;
+    ram.readBlock(address, &value, sizeof(value));
+    return value;
+}
+
+static void test_vector_strip_mining() {
+    struct Config {
+        const char* pipeline;
+        uint32_t vlen;
+        std::vector<uint32_t> vl;
+    };
+    const Config configs[] = {
+        {"legacy", 128, {4, 4, 2}},
+        {"scoreboard", 128, {4, 4, 2}},
+        {"ooo", 128, {4, 4, 2}},
+        {"ooo", 256, {8, 2}},
+    };
+    for (const Config& config : configs) {
+        std::unique_ptr<Simulator> simulator = test_simulator();
+        simulator->set_pipeline(parse_pipeline_config(config.pipeline));
+        simulator->set_vlen(config.vlen);
+        RAM& ram = *simulator->get_ram();
+        // c has a sentinel past its end, which no pass may store over
+        for (uint32_t i = 0; i <= VECTOR_COUNT; i++) {
+            float a = float(i), b = 100.0f * i, c = -1.0f;
+            ram.writeBlock(0x8000 + 4 * i, &a, sizeof(a));
+            ram.writeBlock(0x8100 + 4 * i, &b, sizeof(b));
+            ram.writeBlock(0x8200 + 4 * i, &c, sizeof(c));
+        }
+        run_program(*simulator, strip_mine_program);
+
+        for (uint32_t i = 0; i < config.vl.size(); i++) {
+            CHECK_EQ(ram_word(ram, 0x8300 + 4 * i), config.vl[i]);
+        }
+        for (uint32_t i = 0; i < VECTOR_COUNT; i++) {
+            CHECK_EQ(ram_float(ram, 0x8200 + 4 * i), 101.0f * i);
+        }
+        CHECK_EQ(ram_float(ram, 0x8200 + 4 * VECTOR_COUNT), -1.0f);
+
+        // The last pass wrote its vl elements; the rest of v3 is still the pass before's
+        uint32_t vlmax = config.vlen / 32;
+        uint32_t last = config.vl.back();
+        for (uint32_t i = 0; i < vlmax; i++) {
+            uint32_t element = i < last ? VECTOR_COUNT - last + i : VECTOR_COUNT - last - vlmax + i;
+            CHECK_EQ(ram_float(ram, 0x8400 + 4 * i), 101.0f * element);
+        }
+    }
+}
+
+static void test_vector_fp_mask() {
+    float vd[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+    const float vs1[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    const float vs2[8] = {10, 20, 30, 40, 50, 60, 70, 80};
+    const uint8_t mask[1] = {0x5A};
+    vector_fp(OP_VFSUB_VV, vd, vs1, vs2, 7, mask);
+    for (int i = 0; i < 8; i++) {
+        bool active = i < 7 && (mask[0] >> i & 1);
+        CHECK_EQ(vd[i], active ? vs2[i] - vs1[i] : -1.0f);
+    }
+    vector_fp(OP_VFMACC_VV, vd, vs1, vs2, 8, nullptr);
+    CHECK_EQ(vd[0], -1.0f + 10.0f);
+    CHECK_EQ(vd[7], -1.0f + 8.0f * 80.0f);
+}
+
+// ---------------------------------------------------------------------------------------
+// ELF loader
+
+static void put(std::vector<uint8_t>& bytes, size_t offset, uint32_t value, size_t size = 4) {
+    if (bytes.size() < offset + size) bytes.resize(offset + size);
+    for (size_t i = 0; i < size; i++) bytes[offset + i] = uint8_t(value >> (8 * i));
+}
+
+// A RISC-V ELF32 executable: text at 0x2000 entered at its second word, and data at 0x9000
+// with 8 bytes in the file and 0x38 of .bss. The code adds one to the first data word and
+// stores the sum, and what the word before the entry sets, from 0x9080.
+static std::vector<uint8_t> elf_program() {
+    const std::vector<uint32_t> text = {
+        addi(T3, ZERO, 1),
+        lui(T1, 0x9000),
+        lw(T2, T1, 0),
+        addi(T2, T2, 1),
+        sw(T2, T1, 0x80),
+        sw(T3, T1, 0x84),
+    };
+    std::vector<uint8_t> bytes;
+    put(bytes, 0, 0x464C457F);                  // e_ident: magic, ELFCLASS32, little-endian, version 1
+    put(bytes, 4, 0x00010101);
+    put(bytes, 16, 2, 2);                       // ET_EXEC
+    put(bytes, 18, 243, 2);                     // EM_RISCV
+    put(bytes, 20, 1);
+    put(bytes, 24, 0x2004);                     // e_entry
+    put(bytes, 28, 52);                         // e_phoff
+    put(bytes, 32, 0x300);                      // e_shoff
+    put(bytes, 40, 52, 2);
+    put(bytes, 42, 32, 2);                      // e_phentsize, e_phnum
+    put(bytes, 44, 2, 2);
+    put(bytes, 46, 40, 2);                      // e_shentsize, e_shnum
+    put(bytes, 48, 3, 2);
+
+    // PT_LOAD: type, offset, vaddr, paddr, filesz, memsz, flags
+    const uint32_t segments[2][7] = {
+        {1, 0x100, 0x2000, 0x2000, uint32_t(4 * text.size()), uint32_t(4 * text.size()), 5},
+        {1, 0x200, 0x9000, 0x9000, 8, 0x40, 6},
+    };
+    for (int i = 0; i < 2; i++) {
+        for (int field = 0; field < 7; field++) put(bytes, 52 + 32 * i + 4 * field, segments[i][field]);
+    }
+    for (size_t i = 0; i < text.size(); i++) put(bytes, 0x100 + 4 * i, text[i]);
+    put(bytes, 0x200, 41);
+    put(bytes, 0x204, 0x12345678);
+
+    // Symbols: name, value, size, info, section. "$x" is a mapping symbol the loader skips.
+    const char strings[] = "\0main\0$x\0counter";
+    const uint32_t symbols[4][5] = {
+        {0, 0, 0, 0, 0},
+        {1, 0x2004, 20, 0x12, 1},
+        {6, 0x2000, 0, 0x00, 1},
+        {9, 0x9000, 4, 0x11, 2},
+    };
+    for (int i = 0; i < 4; i++) {
+        size_t base = 0x240 + 16 * i;
+        put(bytes, base, symbols[i][0]);
+        put(bytes, base + 4, symbols[i][1]);
+        put(bytes, base + 8, symbols[i][2]);
+        put(bytes, base + 12, symbols[i][3], 1);
+        put(bytes, base + 14, symbols[i][4], 2);
+    }
+    for (size_t i = 0; i < sizeof(strings); i++) put(bytes, 0x2C0 + i, uint8_t(strings[i]), 1);
+
+    // Sections: null, .symtab linked to .strtab (type, offset, size, link)
+    bytes.resize(0x300 + 3 * 40);
+    put(bytes, 0x300 + 40 + 4, 2);
+    put(bytes, 0x300 + 40 + 16, 0x240);
+    put(bytes, 0x300 + 40 + 20, 64);
+    put(bytes, 0x300 + 40 + 24, 2);
+    put(bytes, 0x300 + 80 + 4, 3);
+    put(bytes, 0x300 + 80 + 16, 0x2C0);
+    put(bytes, 0x300 + 80 + 20, sizeof(strings));
+    return bytes;
+}
+
+static void test_elf_headers() {
+    ProgramFile elf(elf_program());
+    ProgramFile raw(std::vector<uint32_t>{addi(T0, ZERO, 1)});
+    CHECK(is_elf_file(elf.name()));
+    CHECK(!is_elf_file(raw.name()));
+
+    ElfImage image = read_elf(elf.name());
+    CHECK_EQ(image.entry, 0x2004u);
+    CHECK_EQ(image.segments.size(), size_t(2));
+    CHECK_EQ(image.textStart(), 0x2000u);
+    CHECK_EQ(image.textEnd(), uint64_t(0x2018));
+    CHECK_EQ(image.end(), uint64_t(0x9040));
+    CHECK_EQ(image.symbols.size(), size_t(2));
+    CHECK_EQ(image.symbols.describe(0x2008), std::string("main+0x4"));
+    CHECK_EQ(image.symbols.describe(0x9000), std::string("counter"));
+    CHECK_EQ(image.symbols.describe(0x9004), std::string("0x9004"));
+
+    // More bytes in the file than in memory, and an entry outside the text
+    std::vector<uint8_t> bytes = elf_program();
+    put(bytes, 52 + 32 + 16, 0x80);
+    ProgramFile oversized(bytes);
+    bytes = elf_program();
+    put(bytes, 24, 0x9000);
+    ProgramFile misplaced(bytes);
+    for (const ProgramFile* bad : {&oversized, &misplaced}) {
+        bool rejected = false;
+        try {
+            read_elf(bad->name());
+        } catch (const std::invalid_argument&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+    }
+}
+
+static void test_elf_loading() {
+    std::unique_ptr<Simulator> simulator = test_simulator();
+    RAM& ram = *simulator->get_ram();
+    std::vector<uint8_t> stale(0x80, 0xAA);
+    ram.writeBlock(0x9000, stale.data(), stale.size());
+
+    ProgramFile file(elf_program());
+    Core* core = simulator->create_core({file.name(), 0, 0xF000});
+    CHECK_EQ(core->pc, 0x2004);
+    CHECK_EQ(core->symbols.size(), size_t(2));
+    simulator->run();
+
+    CHECK_EQ(ram_word(ram, 0x9000), 41u);
+    CHECK_EQ(ram_word(ram, 0x9004), 0x12345678u);
+    for (uint32_t address = 0x9008; address < 0x9040; address += 4) CHECK_EQ(ram_word(ram, address), 0u);
+    // The segment ends at memsz
+    CHECK_EQ(ram_word(ram, 0x9040), 0xAAAAAAAAu);
+    CHECK_EQ(ram_word(ram, 0x9080), 42u);
+    CHECK_EQ(ram_word(ram, 0x9084), 0u);
+}
+
+// ---------------------------------------------------------------------------------------
+// Scoreboard
+
+// Four multiplies, each waiting for the one before it
+static const std::vector<uint32_t> mul_chain_program = {
+    lui(T1, 0x8000),
+    addi(T0, ZERO, 3),
+    mul(T0, T0, T0),
+    mul(T0, T0, T0),
+    mul(T0, T0, T0),
+    mul(T0, T0, T0),
+    sw(T0, T1, 0),
+};
+
+// Four loads, each used by the next instruction
+static const std::vector<uint32_t> load_use_program = {
+    lui(T1, 0x8000),
+    addi(T0, ZERO, 5),
+    sw(T0, T1, 0),
+    lw(T0, T1, 0),
+    addi(T0, T0, 1),
+    sw(T0, T1, 0),
+    lw(T0, T1, 0),
+    addi(T0, T0, 1),
+    sw(T0, T1, 0),
+    lw(T0, T1, 0),
+    addi(T0, T0, 1),
+    sw(T0, T1, 0),
+    lw(T0, T1, 0),
+    addi(T0, T0, 1),
+    sw(T0, T1, 0),
+};
+
+// Writes to registers that a slow divide is still computing or a waiting store still reads
+static const std::vector<uint32_t> overwrite_program = {
+    lui(T1, 0x8000),
+    addi(T3, ZERO, 100),
+    addi(T2, ZERO, 7),
+    div(T4, T3, T2),
+    sw(T4, T1, 0),
+    addi(T4, ZERO, 9),
+    sw(T4, T1, 4),
+    div(A1, T3, T2),
+    addi(A1, ZERO, 11),
+    sw(A1, T1, 8),
+};
+
+// Run the program on a new simulator with the pipeline spec, kept in simulator for its memory
+static Core* run_scoreboard(const std::string& spec, const std::vector<uint32_t>& program, std::unique_ptr<Simulator>& simulator) {
+    simulator = test_simulator();
+    simulator->set_pipeline(parse_pipeline_config(spec));
+    return run_program(*simulator, program)[0];
+}
+
+static void test_scoreboard_forwarding() {
+    std::unique_ptr<Simulator> simulator;
+
+    // EX->EX forwarding saves a cycle on each multiply that waits for the one before it
+    Core* forwarded = run_scoreboard("scoreboard,forward=ex", mul_chain_program, simulator);
+    int cycles = forwarded->active_cycles;
+    CHECK_EQ(forwarded->get_hazard_stats().raw, 0u);
+    CHECK_EQ(run_scoreboard("scoreboard", mul_chain_program, simulator)->active_cycles, cycles);
+    for (const char* spec : {"scoreboard,forward=mem", "scoreboard,forward=none"}) {
+        Core* core = run_scoreboard(spec, mul_chain_program, simulator);
+        CHECK_EQ(core->active_cycles, cycles + 4);
+        CHECK(core->get_hazard_stats().raw > 0);
+        CHECK_EQ(ram_word(*simulator->get_ram(), 0x8000), 43046721u);
+    }
+
+    // MEM->EX forwarding lets each addi take its loaded value the cycle it arrives
+    for (const char* spec : {"scoreboard", "scoreboard,forward=mem", "scoreboard,forward=ex", "scoreboard,forward=none"}) {
+        Core* core = run_scoreboard(spec, load_use_program, simulator);
+        CHECK_EQ(core->get_hazard_stats().raw, core->get_pipeline().forward_memory ? 0u : 4u);
+        CHECK_EQ(ram_word(*simulator->get_ram(), 0x8000), 9u);
+    }
+}
+
+static void test_scoreboard_hazards() {
+    for (const char* spec : {"scoreboard", "scoreboard,forward=none", "scoreboard,width=2"}) {
+        std::unique_ptr<Simulator> simulator;
+        Core* core = run_scoreboard(spec, overwrite_program, simulator);
+        const RAM& ram = *simulator->get_ram();
+        const HazardStats& hazards = core->get_hazard_stats();
+
+        // The store reads the quotient, not the 9 written after it; the later write wins
+        CHECK(hazards.raw > 0);
+        CHECK(hazards.waw > 0);
+        CHECK(hazards.war > 0);
+        CHECK_EQ(ram_word(ram, 0x8000), 14u);
+        CHECK_EQ(ram_word(ram, 0x8004), 9u);
+        CHECK_EQ(ram_word(ram, 0x8008), 11u);
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// Superscalar issue
+
+// Two independent sums, 11 * (0 + 1 + 2 + 3) in a0 and 16 * (0 + 1 + 2 + 3) in a1, with
+// pairs of instructions that do not depend on each other
+static std::vector<uint32_t> independent_sums_program() {
+    std::vector<uint32_t> program = {lui(T1, 0x8000), addi(A0, ZERO, 0), addi(A1, ZERO, 0)};
+    for (int32_t i = 0; i < 4; i++) {
+        for (uint32_t word : {addi(T0, ZERO, i), addi(T2, ZERO, 10 * i), add(T3, T2, T0), slli(T4, T0, 4),
+                              add(A0, A0, T3), add(A1, A1, T4)}) {
+            program.push_back(word);
+        }
+    }
+    program.push_back(sw(A0, T1, 0));
+    program.push_back(sw(A1, T1, 4));
+    return program;
+}
+
+static void test_superscalar_issue() {
+    const std::vector<uint32_t> program = independent_sums_program();
+    for (const char* pipeline : {"scoreboard", "ooo"}) {
+        std::vector<int> cycles;
+        for (int width : {1, 2, 4}) {
+            std::unique_ptr<Simulator> simulator = test_simulator();
+            simulator->set_pipeline(parse_pipeline_config(std::string(pipeline) + ",width=" + std::to_string(width)));
+            Core* core = run_program(*simulator, program)[0];
+            cycles.push_back(core->active_cycles);
+
+            CHECK_EQ(core->instruction_count, int(program.size()));
+            CHECK_EQ(ram_word(*simulator->get_ram(), 0x8000), 66u);
+            CHECK_EQ(ram_word(*simulator->get_ram(), 0x8004), 96u);
+        }
+        // Issuing two at a time finishes sooner; four is limited by the front end, never slower
+        CHECK(cycles[1] < cycles[0]);
+        CHECK(cycles[2] <= cycles[1]);
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// Execution timing
+
+static void test_operation_classes() {
+    const std::vector<std::pair<const char*, std::vector<Operation>>> classes = {
+        {"alu", {OP_ADD, OP_ADDI, OP_LUI, OP_AUIPC, OP_SLTU, OP_SRAI, OP_VSETVLI}},
+        {"mul", {OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU}},
+        {"div", {OP_DIV, OP_DIVU, OP_REM, OP_REMU}},
+        {"branch", {OP_BEQ, OP_BGEU, OP_JAL, OP_JALR}},
+        {"load", {OP_LB, OP_LHU, OP_LW, OP_FLW, OP_VLE32_V}},
+        {"store", {OP_SB, OP_SW, OP_FSW, OP_VSE32_V}},
+        {"fadd", {OP_FADD_S, OP_FSUB_S, OP_VFADD_VV, OP_VFSUB_VV}},
+        {"fmul", {OP_FMUL_S, OP_FMADD_S, OP_FNMADD_S, OP_VFMUL_VV, OP_VFMACC_VV}},
+        {"fdiv", {OP_FDIV_S, OP_FSQRT_S}},
+        {"fmisc", {OP_FMIN_S, OP_FEQ_S, OP_FSGNJX_S, OP_FCLASS_S, OP_FCVT_W_S, OP_FCVT_S_WU, OP_FMV_X_W, OP_FMV_W_X}},
+        {"system", {OP_CSRRW, OP_CSRRCI, OP_ECALL, OP_EBREAK, OP_FENCE}},
+    };
+    for (const auto& opClass : classes) {
+        for (Operation op : opClass.second) {
+            CHECK_EQ(std::string(OpClassNames[op_class(op)]) + " " + OperationTable[op].name,
+                     std::string(opClass.first) + " " + OperationTable[op].name);
+        }
+    }
+}
+
+static void test_latency_file() {
+    const std::string text =
+        "# A slower multiplier\n"
+        "mul     latency=9\n"
+        "fdiv    latency=18 pipelined=0\n"
+        "fsqrt.s latency=24 pipelined=0   # after its class, so it wins\n"
+        "\n"
+        "addi    latency=2 interval=3\n";
+    ProgramFile file(std::vector<uint8_t>(text.begin(), text.end()));
+    LatencyTable table = read_latency_file(file.name());
+
+    CHECK_EQ(table[OP_MUL].latency, 9);
+    CHECK_EQ(table[OP_MULHU].latency, 9);
+    CHECK_EQ(table[OP_MULHU].interval, 1);
+    CHECK_EQ(table[OP_FDIV_S].latency, 18);
+    CHECK_EQ(table[OP_FDIV_S].interval, 18);
+    CHECK_EQ(table[OP_FSQRT_S].latency, 24);
+    CHECK_EQ(table[OP_FSQRT_S].interval, 24);
+    CHECK_EQ(table[OP_ADDI].latency, 2);
+    CHECK_EQ(table[OP_ADDI].interval, 3);
+    // Lines the file leaves out keep the built-in timing
+    CHECK_EQ(table[OP_ADD].latency, LatencyTable()[OP_ADD].latency);
+    CHECK_EQ(table[OP_DIV].latency, 20);
+    CHECK_EQ(table[OP_DIV].interval, 20);
+
+    for (const char* bad : {"mul\n", "mull latency=3\n", "mul latency=3 depth=2\n", "mul latency=3 interval=0\n"}) {
+        ProgramFile badFile(std::vector<uint8_t>(bad, bad + std::string(bad).size()));
+        bool threw = false;
+        try {
+            read_latency_file(badFile.name());
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+
+    // Each dependent multiply takes the 6 cycles more it was given, on every pipeline
+    for (const char* spec : {"legacy", "scoreboard", "ooo"}) {
+        std::unique_ptr<Simulator> baseline = test_simulator();
+        baseline->set_pipeline(parse_pipeline_config(spec));
+        int cycles = run_program(*baseline, mul_chain_program)[0]->active_cycles;
+
+        std::unique_ptr<Simulator> simulator = test_simulator();
+        simulator->set_pipeline(parse_pipeline_config(spec));
+        simulator->set_latency_table(table);
+        CHECK_EQ(run_program(*simulator, mul_chain_program)[0]->active_cycles, cycles + 4 * (9 - 3));
+        CHECK_EQ(ram_word(*simulator->get_ram(), 0x8000), 43046721u);
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// Out-of-order back end
+
+// A slow divide feeds the older of two stores to one word, and loads follow stores still in
+// the queue, one of them reading a byte in the middle of the stored word
+static const std::vector<uint32_t> store_order_program = {
+    lui(T1, 0x8000),
+    addi(T0, ZERO, 100),
+    addi(T2, ZERO, 7),
+    div(T3, T0, T2),
+    sw(T3, T1, 0),
+    sw(T2, T1, 0),
+    sw(T0, T1, 4),
+    lw(T4, T1, 4),
+    addi(T4, T4, 1),
+    sw(T4, T1, 8),
+    addi(T0, ZERO, 0x80),
+    slli(T0, T0, 8),
+    sw(T0, T1, 12),
+    lb(T4, T1, 13),
+    sw(T4, T1, 16),
+};
+
+static void test_ooo_commits_in_order() {
+    for (const char* spec : {"legacy", "ooo", "ooo,width=4,rob=8,lsq=4"}) {
+        std::unique_ptr<Simulator> simulator = test_simulator();
+        simulator->set_pipeline(parse_pipeline_config(spec));
+        Core* core = run_program(*simulator, store_order_program)[0];
+        const RAM& ram = *simulator->get_ram();
+
+        // The younger store reaches memory last, whatever finished first
+        CHECK_EQ(ram_word(ram, 0x8000), 7u);
+        CHECK_EQ(ram_word(ram, 0x8008), 101u);
+        CHECK_EQ(ram_word(ram, 0x8010), 0xFFFFFF80u);
+        CHECK_EQ(core->instruction_count, int(store_order_program.size()));
+        if (parse_pipeline_config(spec).out_of_order) CHECK_EQ(core->get_ooo_stats().forwarded, 2u);
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// Host threads
+
+// Each hart adds 20 + 19 + ... + 1 into its own word at 0x8000 + 64 * hart, through memory
+static const std::vector<uint32_t> hart_sum_program = {
+    slli(T0, A0, 6),
+    lui(T1, 0x8000),
+    add(T1, T1, T0),
+    addi(T2, ZERO, 20),
+    lw(T3, T1, 0),
+    add(T3, T3, T2),
+    sw(T3, T1, 0),
+    addi(T2, T2, -1),
+    bne(T2, ZERO, -16),
+};
+
+// Cycles each of eight cores took, checking the sums they stored
+static std::vector<int> hart_sum_cycles(unsigned threads, bool event_driven, bool caches) {
+    std::unique_ptr<Simulator> simulator = test_simulator();
+    simulator->set_event_driven(event_driven);
+    simulator->set_threads(threads);
+    CacheConfig l1 = parse_cache_config("size=1024");
+    if (caches) simulator->set_caches(&l1, &l1);
+
+    std::vector<int> cycles;
+    for (Core* core : run_program(*simulator, hart_sum_program, 8)) {
+        cycles.push_back(core->active_cycles);
+        CHECK_EQ(ram_word(*simulator->get_ram(), 0x8000 + 64 * core->core_id), 210u);
+    }
+    return cycles;
+}
+
+static void test_threads_match_serial() {
+    for (bool caches : {false, true}) {
+        std::vector<int> serial = hart_sum_cycles(1, false, caches);
+        CHECK(hart_sum_cycles(1, true, caches) == serial);
+        CHECK(hart_sum_cycles(4, true, caches) == serial);
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+static const TestCase tests[] = {
+    {"ram: mapped files are copy-on-write", test_mapped_file_copy_on_write},
+    {"cache: a miss fills the line, later words hit", test_cache_fill_and_hit},
+    {"cache: LRU and FIFO replacement", test_cache_replacement},
+    {"cache: write-back keeps dirty data until eviction", test_cache_write_back},
+    {"cache: write-through without write-allocate", test_cache_write_through},
+    {"coherence: MESI transitions between two L1s", test_mesi_transitions},
+    {"coherence: the L2 stays inclusive of the L1s", test_l2_inclusion},
+    {"bus: fixed, age and round-robin grant order", test_arbitration_order},
+    {"bpred: gshare follows global history", test_gshare_learns_history},
+    {"bpred: TAGE follows history gshare cannot hold", test_tage_learns_long_loops},
+    {"bpred: the return stack predicts nested returns", test_return_stack},
+    {"rv32im: division edge cases and sub-word memory access", test_rv32im_edge_cases},
+    {"rv32i: fence retires, ecall and ebreak stop the core", test_system_instructions},
+    {"rv32f: conversion saturation, fmin and fmax with NaNs, fflags", test_rv32f_edge_cases},
+    {"rv32f: reserved rounding modes stop the core", test_reserved_rounding_modes},
+    {"rvv: strip-mining leaves the tail undisturbed", test_vector_strip_mining},
+    {"rvv: masked and fused vector FP", test_vector_fp_mask},
+    {"elf: headers, segments and symbols", test_elf_headers},
+    {"elf: segments load where linked, .bss is zeroed", test_elf_loading},
+    {"scoreboard: forwarding paths and load-use stalls", test_scoreboard_forwarding},
+    {"scoreboard: RAW, WAW and WAR hazards keep results right", test_scoreboard_hazards},
+    {"superscalar: wider issue runs independent work sooner", test_superscalar_issue},
+    {"latency: operations map to their classes", test_operation_classes},
+    {"latency: a latency file times a dependent multiply chain", test_latency_file},
+    {"ooo: stores commit in order, loads forward from the queue", test_ooo_commits_in_order},
+    {"threads: parallel ticks match the serial kernels", test_threads_match_serial},
+};
+
+int main() {
+    int failed_tests = 0;
+    for (const TestCase& test : tests) {
+        int before = failures;
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            std::cout << "exception: " << e.what() << std::endl;
+            failures++;
+        }
+        bool passed = failures == before;
+        if (!passed) failed_tests++;
+        std::cout << (passed ? "ok      " : "FAILED  ") << test.name << std::endl;
+    }
+
+    std::cout << failed_tests << " of " << sizeof(tests) / sizeof(tests[0]) << " tests failed" << std::endl;
+    return failed_tests ? 1 : 0;
+}